@@ -0,0 +1,211 @@
+/// \file BarnesHut.cpp
+/// \brief Code for the Barnes-Hut quadtree CBarnesHutTree.
+
+#include "BarnesHut.h"
+
+#include <algorithm>
+
+/// Empty the tree.
+
+void CBarnesHutTree::clear(){
+  m_vNodes.clear();
+  m_vX.clear();
+  m_vY.clear();
+  m_vGM.clear();
+  m_vOrder.clear();
+} //clear
+
+/// Build the tree from packed arrays of bodies. The arrays are copied,
+/// so the caller is free to change them afterwards.
+/// \param x x coordinates of the bodies.
+/// \param y y coordinates of the bodies.
+/// \param gm Mass times gravitational constant of the bodies.
+/// \param n Number of bodies.
+/// \param softening Softening parameter added to the squared distance.
+
+void CBarnesHutTree::build(const float* x, const float* y, const float* gm, size_t n, float softening){
+  clear();
+  m_fSoftening = softening;
+  if(n == 0)return;
+
+  m_vX.assign(x, x + n);
+  m_vY.assign(y, y + n);
+  m_vGM.assign(gm, gm + n);
+
+  //bounding square of all bodies
+  float x0 = x[0], y0 = y[0], x1 = x[0], y1 = y[0];
+  for(size_t i=1; i<n; i++){
+    x0 = min(x0, x[i]); x1 = max(x1, x[i]);
+    y0 = min(y0, y[i]); y1 = max(y1, y[i]);
+  } //for
+  const float size = max(x1 - x0, y1 - y0)*1.001f + 1.0f; //a little slack so that nothing sits on the far edge
+
+  m_vOrder.resize(n);
+  for(size_t i=0; i<n; i++)
+    m_vOrder[i] = (int)i;
+
+  m_vNodes.reserve(2*n);
+  build(0, (int)n, x0, y0, size, 0);
+
+  //sort the bodies so that each node's bodies are contiguous
+  std::vector<float> sx(n), sy(n), sgm(n);
+  for(size_t i=0; i<n; i++){
+    sx[i] = m_vX[m_vOrder[i]];
+    sy[i] = m_vY[m_vOrder[i]];
+    sgm[i] = m_vGM[m_vOrder[i]];
+  } //for
+  m_vX.swap(sx);
+  m_vY.swap(sy);
+  m_vGM.swap(sgm);
+} //build
+
+/// Build the subtree over a range of m_vOrder, partitioning that range
+/// into quadrants as it goes.
+/// \param first Index into m_vOrder of the first body.
+/// \param count Number of bodies.
+/// \param x0 x coordinate of the left edge of the square.
+/// \param y0 y coordinate of the bottom edge of the square.
+/// \param size Width of the square.
+/// \param depth Depth of this node.
+/// \return Index of the new node.
+
+int CBarnesHutTree::build(int first, int count, float x0, float y0, float size, int depth){
+  const int index = (int)m_vNodes.size();
+  m_vNodes.push_back(CNode());
+
+  //total mass and center of mass
+  double total = 0, cx = 0, cy = 0;
+  for(int i=first; i<first + count; i++){
+    const int j = m_vOrder[i];
+    total += m_vGM[j];
+    cx += (double)m_vGM[j]*m_vX[j];
+    cy += (double)m_vGM[j]*m_vY[j];
+  } //for
+
+  CNode& node = m_vNodes[index];
+  node.m_fGM = (float)total;
+  node.m_fCX = total > 0? (float)(cx/total): x0 + size/2;
+  node.m_fCY = total > 0? (float)(cy/total): y0 + size/2;
+  node.m_fSize = size;
+  node.m_nFirst = first;
+  node.m_nCount = count;
+
+  if(count <= LEAF_SIZE || depth >= MAX_DEPTH)
+    return index;
+
+  //partition into quadrants: 0 = bottom left, 1 = bottom right, 2 = top left, 3 = top right
+  const float half = size/2;
+  const float mx = x0 + half;
+  const float my = y0 + half;
+  int* begin = m_vOrder.data() + first;
+  int* end = begin + count;
+
+  int* split_x = std::partition(begin, end, [&](int j){ return m_vX[j] < mx; });
+  int* split_left = std::partition(begin, split_x, [&](int j){ return m_vY[j] < my; });
+  int* split_right = std::partition(split_x, end, [&](int j){ return m_vY[j] < my; });
+
+  const int start[4] = {first, (int)(split_x - m_vOrder.data()), (int)(split_left - m_vOrder.data()), (int)(split_right - m_vOrder.data())};
+  const int number[4] = {(int)(split_left - begin), (int)(split_right - split_x), (int)(split_x - split_left), (int)(end - split_right)};
+  const float left[4] = {x0, mx, x0, mx};
+  const float bottom[4] = {y0, y0, my, my};
+
+  int child[4] = {-1, -1, -1, -1};
+  for(int k=0; k<4; k++)
+    if(number[k] > 0)
+      child[k] = build(start[k], number[k], left[k], bottom[k], half, depth + 1);
+
+  //the recursion may have reallocated m_vNodes, so node is no longer safe to use
+  for(int k=0; k<4; k++)
+    m_vNodes[index].m_nChild[k] = child[k];
+  m_vNodes[index].m_bLeaf = false;
+
+  return index;
+} //build
+
+/// Approximate the gravitational field at a position.
+/// \param pos Position at which to evaluate the field.
+/// \return The gravitational field (acceleration) at pos.
+
+Vector2 CBarnesHutTree::field(const Vector2& pos) const{
+  if(m_vNodes.empty())return Vector2::Zero;
+
+  const float theta2 = m_fOpeningAngle*m_fOpeningAngle;
+  float ax = 0, ay = 0;
+  int stack[4*MAX_DEPTH + 4];
+  int top = 0;
+  stack[top++] = 0;
+
+  while(top > 0){
+    const CNode& node = m_vNodes[stack[--top]];
+
+    if(node.m_bLeaf){ //add up the bodies directly
+      for(int i=node.m_nFirst; i<node.m_nFirst + node.m_nCount; i++){
+        const float dx = m_vX[i] - pos.x;
+        const float dy = m_vY[i] - pos.y;
+        const float r2 = dx*dx + dy*dy;
+        if(r2 > 0){
+          const float s = m_vGM[i]/((r2 + m_fSoftening)*sqrtf(r2));
+          ax += dx*s;
+          ay += dy*s;
+        } //if
+      } //for
+      continue;
+    } //if
+
+    const float dx = node.m_fCX - pos.x;
+    const float dy = node.m_fCY - pos.y;
+    const float r2 = dx*dx + dy*dy;
+
+    if(node.m_fSize*node.m_fSize < theta2*r2){ //far enough away to be a single point mass
+      const float s = node.m_fGM/((r2 + m_fSoftening)*sqrtf(r2));
+      ax += dx*s;
+      ay += dy*s;
+    } //if
+
+    else for(int k=0; k<4; k++) //too close, open it up
+      if(node.m_nChild[k] >= 0)
+        stack[top++] = node.m_nChild[k];
+  } //while
+
+  return Vector2(ax, ay);
+} //field
+
+/// Approximate the gravitational potential at a position.
+/// \param pos Position at which to evaluate the potential.
+/// \return The gravitational potential at pos.
+
+float CBarnesHutTree::potential(const Vector2& pos) const{
+  if(m_vNodes.empty())return 0;
+
+  const float theta2 = m_fOpeningAngle*m_fOpeningAngle;
+  float phi = 0;
+  int stack[4*MAX_DEPTH + 4];
+  int top = 0;
+  stack[top++] = 0;
+
+  while(top > 0){
+    const CNode& node = m_vNodes[stack[--top]];
+
+    if(node.m_bLeaf){ //add up the bodies directly
+      for(int i=node.m_nFirst; i<node.m_nFirst + node.m_nCount; i++){
+        const float dx = m_vX[i] - pos.x;
+        const float dy = m_vY[i] - pos.y;
+        phi += m_vGM[i]/sqrtf(dx*dx + dy*dy);
+      } //for
+      continue;
+    } //if
+
+    const float dx = node.m_fCX - pos.x;
+    const float dy = node.m_fCY - pos.y;
+    const float r2 = dx*dx + dy*dy;
+
+    if(node.m_fSize*node.m_fSize < theta2*r2) //far enough away to be a single point mass
+      phi += node.m_fGM/sqrtf(r2);
+
+    else for(int k=0; k<4; k++) //too close, open it up
+      if(node.m_nChild[k] >= 0)
+        stack[top++] = node.m_nChild[k];
+  } //while
+
+  return -phi;
+} //potential
@@ -0,0 +1,60 @@
+/// \file BarnesHut.h
+/// \brief Interface for the Barnes-Hut quadtree CBarnesHutTree.
+
+#pragma once
+
+#include <vector>
+
+#include "Defines.h"
+
+/// \brief A Barnes-Hut quadtree.
+///
+/// The tree stores point masses. Each node knows the total mass and center
+/// of mass of everything beneath it. When the field or potential is queried,
+/// a node that looks small from the query point (its width divided by its
+/// distance is less than the opening angle) is treated as a single point
+/// mass instead of being opened up, which takes a query from O(n)
+/// to roughly O(log n). An opening angle of 0 gives the exact sum.
+
+class CBarnesHutTree{
+  private:
+    /// \brief A node of the quadtree.
+
+    struct CNode{
+      float m_fCX = 0; ///< x coordinate of the center of mass.
+      float m_fCY = 0; ///< y coordinate of the center of mass.
+      float m_fGM = 0; ///< Total mass times the gravitational constant.
+      float m_fSize = 0; ///< Width of the node's square.
+      int m_nFirst = 0; ///< Index of the first body beneath this node in the sorted arrays.
+      int m_nCount = 0; ///< Number of bodies beneath this node.
+      int m_nChild[4] = {-1, -1, -1, -1}; ///< Indices of the children, -1 if none.
+      bool m_bLeaf = true; ///< Whether this node has no children.
+    }; //CNode
+
+    std::vector<CNode> m_vNodes; ///< All nodes. The root is node 0.
+    std::vector<float> m_vX; ///< x coordinates of the bodies, sorted so that each node's bodies are contiguous.
+    std::vector<float> m_vY; ///< y coordinates of the bodies, sorted the same way.
+    std::vector<float> m_vGM; ///< Mass times gravitational constant of the bodies, sorted the same way.
+    std::vector<int> m_vOrder; ///< Scratch space used to sort the bodies while building.
+
+    float m_fSoftening = 0; ///< Softening parameter added to the squared distance.
+    float m_fOpeningAngle = 0.5f; ///< Opening angle.
+
+    static const int MAX_DEPTH = 24; ///< Nodes this deep are leaves no matter how many bodies they hold.
+    static const int LEAF_SIZE = 4; ///< Nodes with this many bodies or fewer are leaves.
+
+    int build(int first, int count, float x0, float y0, float size, int depth); ///< Build a subtree.
+
+  public:
+    void build(const float* x, const float* y, const float* gm, size_t n, float softening); ///< Build the tree from packed arrays.
+    void clear(); ///< Empty the tree.
+
+    void set_opening_angle(float theta) { m_fOpeningAngle = theta; }; ///< Set the opening angle.
+    float get_opening_angle() { return m_fOpeningAngle; }; ///< Get the opening angle.
+
+    Vector2 field(const Vector2& pos) const; ///< Approximate gravitational field at a position.
+    float potential(const Vector2& pos) const; ///< Approximate gravitational potential at a position.
+
+    size_t size() const { return m_vGM.size(); }; ///< Number of bodies in the tree.
+    size_t node_count() const { return m_vNodes.size(); }; ///< Number of nodes in the tree.
+}; //CBarnesHutTree
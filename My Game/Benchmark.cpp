@@ -0,0 +1,1922 @@
+/// \file Benchmark.cpp
+/// \brief Code for the benchmark class CBenchmark.
+
+#include "Benchmark.h"
+#include "ComponentIncludes.h"
+#include "ObjectManager.h"
+#include "GravityField.h"
+#include "GravityGrid.h"
+#include "Random.h"
+#include "Deterministic.h"
+
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cfloat>
+#include <climits>
+
+CBenchmark::CBenchmark(){
+  m_fOut.open("bench_output.txt", std::ios::app);
+} //constructor
+
+/// Write a line of results to the debug output and the results file.
+/// \param line The line to write, without a newline.
+
+void CBenchmark::report(const std::string& line){
+  OutputDebugStringA((line + "\n").c_str());
+  if(m_fOut)
+    m_fOut << line << std::endl;
+} //report
+
+/// Start timing.
+
+void CBenchmark::start_timer(){
+  m_tStart = std::chrono::steady_clock::now();
+} //start_timer
+
+/// Stop timing.
+/// \return Seconds since the last call to start_timer.
+
+double CBenchmark::stop_timer(){
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_tStart).count();
+} //stop_timer
+
+/// Run all of the benchmarks, one after the other.
+
+void CBenchmark::run(){
+  report("---- benchmarks ----");
+  gravity_kernel();
+  barnes_hut();
+  gravity_grid();
+  integrators();
+  substeps();
+  conics();
+  early_termination();
+  determinism(); //these replace the level, so they go last
+  large_world();
+  threads();
+  broadphase();
+  collision_layers();
+  polar_intersects();
+  sector_levels();
+  planet_batches();
+  surface_index();
+  moving_planets();
+  terrain_resolution();
+  dirty_spans();
+  blast_kernels();
+  level_load();
+  terrain_snapshots();
+  report("---- done ----");
+} //run
+
+/// Time one evaluation of the gravitational field with 1 to 64 bodies
+/// scattered over a 15000 unit world, using the packed vector kernel,
+/// the packed scalar loop and the double precision reference, and report
+/// the worst relative error of the float paths against the reference.
+
+void CBenchmark::gravity_kernel(){
+  report("gravity_kernel: bodies, packed ns/call, scalar ns/call, double ns/call, max relative error");
+
+  const int calls = 200000; //evaluations per timing
+  const int num_points = 1024; //distinct query points, cycled through
+  const int sizes[] = {1, 2, 4, 8, 16, 32, 64};
+
+  for(int n: sizes){
+    CGravityField field;
+    for(int i=0; i<n; i++)
+      field.add(15000.0f*Vector2(m_pRandom->randf(), m_pRandom->randf()), 5.0e8f*m_pRandom->randf());
+
+    std::vector<Vector2> points(num_points);
+    for(auto& p: points)
+      p = 15000.0f*Vector2(m_pRandom->randf(), m_pRandom->randf());
+
+    Vector2 sink = Vector2::Zero; //so that the optimizer can't throw the loops away
+
+    start_timer();
+    for(int i=0; i<calls; i++)
+      sink += field.field(points[i%num_points]);
+    const double packed = stop_timer();
+
+    start_timer();
+    for(int i=0; i<calls; i++)
+      sink += field.field_scalar(points[i%num_points]);
+    const double scalar = stop_timer();
+
+    start_timer();
+    for(int i=0; i<calls; i++)
+      sink += field.field_reference(points[i%num_points]);
+    const double reference = stop_timer();
+
+    float max_error = 0;
+    for(auto const& p: points){
+      const Vector2 exact = field.field_reference(p);
+      if(exact.Length() > 0){
+        max_error = max(max_error, (field.field(p) - exact).Length()/exact.Length());
+        max_error = max(max_error, (field.field_scalar(p) - exact).Length()/exact.Length());
+      } //if
+    } //for
+
+    report(to_string(n) + ", " + to_string(1.0e9*packed/calls) + ", " + to_string(1.0e9*scalar/calls) + ", " +
+      to_string(1.0e9*reference/calls) + ", " + to_string(max_error));
+    m_fSink = sink.x + sink.y;
+  } //for
+} //gravity_kernel
+
+/// Compare the Barnes-Hut quadtree against the vectorized direct sum for
+/// 64 to 8192 bodies and a few opening angles. Reports the time taken to
+/// build the tree, the per-call cost of both, the speedup, and the mean and
+/// worst relative error of the tree's field and potential against the
+/// double precision reference.
+
+void CBenchmark::barnes_hut(){
+  report("barnes_hut: bodies, opening angle, build us, tree ns/call, direct ns/call, speedup, "
+    "mean field error, max field error, max potential error");
+
+  const int num_points = 1024; //distinct query points
+  const int sizes[] = {64, 256, 1024, 4096, 8192};
+  const float angles[] = {0.3f, 0.5f, 0.8f};
+
+  for(int n: sizes){
+    CGravityField field;
+    for(int i=0; i<n; i++)
+      field.add(15000.0f*Vector2(m_pRandom->randf(), m_pRandom->randf()), 5.0e8f*m_pRandom->randf());
+
+    std::vector<Vector2> points(num_points);
+    for(auto& p: points)
+      p = 15000.0f*Vector2(m_pRandom->randf(), m_pRandom->randf());
+
+    std::vector<Vector2> exact(num_points);
+    std::vector<float> exact_potential(num_points);
+    for(int i=0; i<num_points; i++){
+      exact[i] = field.field_reference(points[i]);
+      exact_potential[i] = field.potential_direct(points[i]);
+    } //for
+
+    const int calls = max(2000, 20000000/n); //fewer calls for more bodies
+    Vector2 sink = Vector2::Zero;
+
+    start_timer();
+    for(int i=0; i<calls; i++)
+      sink += field.field_direct(points[i%num_points]);
+    const double direct = stop_timer();
+
+    for(float theta: angles){
+      const int builds = 20;
+      start_timer();
+      for(int i=0; i<builds; i++)
+        field.set_tree(true, theta, 0); //threshold 0 forces the tree on
+      const double build = stop_timer();
+
+      start_timer();
+      for(int i=0; i<calls; i++)
+        sink += field.field(points[i%num_points]);
+      const double tree = stop_timer();
+
+      double mean_error = 0;
+      float max_error = 0, max_potential_error = 0;
+      for(int i=0; i<num_points; i++){
+        if(exact[i].Length() > 0){
+          const float e = (field.field(points[i]) - exact[i]).Length()/exact[i].Length();
+          mean_error += e;
+          max_error = max(max_error, e);
+        } //if
+        if(exact_potential[i] != 0)
+          max_potential_error = max(max_potential_error, fabsf(field.potential(points[i])/exact_potential[i] - 1.0f));
+      } //for
+      mean_error /= num_points;
+
+      report(to_string(n) + ", " + to_string(theta) + ", " + to_string(1.0e6*build/builds) + ", " +
+        to_string(1.0e9*tree/calls) + ", " + to_string(1.0e9*direct/calls) + ", " + to_string(direct/tree) + ", " +
+        to_string(mean_error) + ", " + to_string(max_error) + ", " + to_string(max_potential_error));
+    } //for
+
+    m_fSink = sink.x + sink.y;
+  } //for
+} //barnes_hut
+
+/// Build the gravity grid for random levels laid out the way the level
+/// manager lays them out, in worlds from 15000 to 45000 units across,
+/// and report the build time, memory used and the mean and worst relative
+/// error of the field outside the planets, for both interpolations. Then
+/// time phantom bullets fired by the first tank in the current level with
+/// the grid and without it.
+
+void CBenchmark::gravity_grid(){
+  report("gravity_grid: world size, planets, interpolation, build ms, patches, memory KB, mean error, max error");
+
+  const float worlds[] = {15000.0f, 30000.0f, 45000.0f};
+  const int num_points = 20000;
+
+  for(float w: worlds){
+    const int num_planets = 5;
+    const Vector2 center = Vector2(w, w)/2;
+    std::vector<float> x, y, gm, radius;
+    CGravityField field;
+
+    for(int i=0; i<num_planets; i++){
+      const Vector2 pos = center + m_pRandom->randn((int)w/12, (int)w/8)*m_pRandom->randv();
+      const float r = (float)m_pRandom->randn(500, 1500);
+      const float mass = powf(r, 3.0f)*100.0f/powf(900.0f, 3.0f);
+      x.push_back(pos.x);
+      y.push_back(pos.y);
+      radius.push_back(r);
+      gm.push_back(mass*m_pObjectManager->get_gravitational_constant());
+      field.add(pos, gm.back());
+    } //for
+
+    //query points outside the planets, since nothing gets evaluated inside them
+    std::vector<Vector2> points;
+    while(points.size() < num_points){
+      const Vector2 p = w*Vector2(m_pRandom->randf(), m_pRandom->randf());
+      bool inside = false;
+      for(int i=0; i<num_planets; i++)
+        inside = inside || (p - Vector2(x[i], y[i])).Length() < radius[i];
+      if(!inside)points.push_back(p);
+    } //while
+
+    for(int k=0; k<2; k++){
+      const bool cubic = k == 1;
+      CGravityGrid grid;
+      grid.set_interpolation(cubic? CGravityGrid::eInterpolation::BICUBIC: CGravityGrid::eInterpolation::BILINEAR);
+      grid.build(x, y, gm, 0, Vector2(w, w));
+
+      double mean_error = 0;
+      float max_error = 0;
+      for(auto const& p: points){
+        Vector2 a;
+        if(!grid.field(p, a))
+          a = field.field_direct(p);
+        const Vector2 exact = field.field_reference(p);
+        const float e = (a - exact).Length()/exact.Length();
+        mean_error += e;
+        max_error = max(max_error, e);
+      } //for
+
+      report(to_string((int)w) + ", " + to_string(num_planets) + ", " + (cubic? "bicubic": "bilinear") + ", " +
+        to_string(1000.0f*grid.build_time()) + ", " + to_string(grid.patch_count()) + ", " + to_string(grid.memory()/1024) + ", " +
+        to_string(mean_error/num_points) + ", " + to_string(max_error));
+    } //for
+  } //for
+
+  //phantom bullets in the current level
+  auto tanks = m_pObjectManager->get_tanks_list();
+  if(tanks.empty())return;
+  CTankObject* tank = tanks.front().get();
+  CGravityField& field = m_pObjectManager->get_gravity_field();
+
+  report("gravity_grid: phantom bullets, grid, seconds, phantoms/sec");
+  const int shots = 300;
+
+  for(int k=0; k<2; k++){
+    const bool grid = k == 1;
+    field.set_grid(grid, 0);
+    m_pObjectManager->build_gravity_grid(true);
+
+    float sink = 0;
+    start_timer();
+    for(int i=0; i<shots; i++)
+      sink += tank->FirePhantomGun(WATER_SPRITE, m_pRandom->randv(), (float)m_pRandom->randn(50, 1000));
+    const double t = stop_timer();
+
+    report(to_string(shots*3) + ", " + (grid? "on": "off") + ", " + to_string(t) + ", " + to_string(3*shots/t));
+    m_fSink = sink;
+  } //for
+
+  field.set_grid(true, 24); //back to the defaults
+} //gravity_grid
+
+/// Put a test particle on an elliptical orbit around the first planet in
+/// the current level and fly it for 60 seconds with each integrator and
+/// a few step sizes, ignoring collisions. Reports the cost per step, the
+/// mean change in total mechanical energy per step and the worst change
+/// from the starting energy, both relative to the starting energy.
+
+void CBenchmark::integrators(){
+  auto planets = m_pObjectManager->get_planets_list();
+  if(planets.empty())return;
+  CPlanetObject* planet = planets.front();
+
+  report("integrators: integrator, dt, steps, ns/step, mean drift/step, max drift");
+
+  const eIntegrator old_integrator = m_pObjectManager->get_integrator();
+  const float steps_per_second[] = {120.0f, 60.0f, 30.0f, 15.0f};
+  const float flight_time = 60.0f;
+
+  //start at periapsis, a little faster than a circular orbit
+  const Vector2 start = planet->GetPos() + Vector2(2.0f*planet->GetBoundingSphere().Radius, 0.0f);
+  const float r = (start - planet->GetPos()).Length();
+  const float speed = 1.1f*sqrtf(m_pObjectManager->calculate_gravity(start).Length()*r);
+
+  for(int k=0; k<(int)eIntegrator::NUM_INTEGRATORS; k++){
+    m_pObjectManager->set_integrator((eIntegrator)k);
+
+    for(float n: steps_per_second){
+      const float dt = 1.0f/n;
+      const int steps = (int)(flight_time*n);
+      Vector2 pos = start;
+      Vector2 vel = Vector2(0.0f, speed);
+
+      start_timer();
+      for(int i=0; i<steps; i++)
+        m_pObjectManager->integrate(pos, vel, dt);
+      const double time_integrating = stop_timer();
+      m_fSink = pos.x + vel.y;
+
+      //again, this time measuring the energy after each step
+      pos = start;
+      vel = Vector2(0.0f, speed);
+      const float e0 = m_pObjectManager->calculate_total_mechanical_energy(pos, vel);
+      float e = e0;
+      double total_drift = 0;
+      float max_drift = 0;
+
+      for(int i=0; i<steps; i++){
+        m_pObjectManager->integrate(pos, vel, dt);
+        const float e1 = m_pObjectManager->calculate_total_mechanical_energy(pos, vel);
+        total_drift += fabsf(e1 - e)/fabsf(e0);
+        max_drift = max(max_drift, fabsf(e1 - e0)/fabsf(e0));
+        e = e1;
+      } //for
+
+      report(m_pObjectManager->get_integrator_name() + ", " + to_string(dt) + ", " + to_string(steps) + ", " +
+        to_string(1.0e9*time_integrating/steps) + ", " + to_string(total_drift/steps) + ", " + to_string(max_drift));
+    } //for
+  } //for
+
+  m_pObjectManager->set_integrator(old_integrator);
+} //integrators
+
+/// Fly test particles past the first planet in the current level for
+/// 3 seconds each, starting just above the hills with roughly orbital
+/// speed so that most of them skim the surface. Each one is flown with
+/// one step per frame, with adaptive sub-steps, and with 256 steps per
+/// frame as the reference. Particles whose reference trajectory hits a
+/// planet are left out. Reports the steps per second of flight and the
+/// mean and worst distance from the reference at the end.
+
+void CBenchmark::substeps(){
+  auto planets = m_pObjectManager->get_planets_list();
+  if(planets.empty())return;
+  CPlanetObject* planet = planets.front();
+
+  report("substeps: mode, particles, steps per second of flight, mean error, max error");
+
+  const bool old_adaptive = m_pObjectManager->get_adaptive_steps();
+  const float dt = 1.0f/60.0f;
+  const int frames = 180;
+  const int fine = 256; //reference steps per frame
+  const int particles = 200;
+  const float radius = 0.75f;
+
+  //pick the starting conditions
+  std::vector<Vector2> start_pos, start_vel, end_pos;
+  while((int)start_pos.size() < particles){
+    const Vector2 dir = m_pRandom->randv();
+    const Vector2 pos = planet->GetPos() + (1.15f*planet->get_radius() + m_pRandom->randf()*0.3f*planet->get_radius())*dir;
+    const float r = (pos - planet->GetPos()).Length();
+    const float speed = (0.7f + 0.5f*m_pRandom->randf())*sqrtf(m_pObjectManager->calculate_gravity(pos).Length()*r);
+    const Vector2 tangent = Vector2(-dir.y, dir.x);
+    const Vector2 vel = speed*(tangent + (m_pRandom->randf() - 0.7f)*dir);
+
+    //reference
+    m_pObjectManager->set_adaptive_steps(false);
+    Vector2 p = pos, v = vel;
+    bool hit = false;
+    BoundingSphere sphere;
+    sphere.Radius = radius;
+    for(int i=0; i<frames*fine && !hit; i++){
+      m_pObjectManager->advance(p, v, radius, dt/fine);
+      sphere.Center = Vector3(p.x, p.y, 0);
+      for(auto const& q: planets)
+        hit = hit || q->Intersects(sphere);
+    } //for
+
+    if(!hit){
+      start_pos.push_back(pos);
+      start_vel.push_back(vel);
+      end_pos.push_back(p); //where the reference ended up
+    } //if
+  } //while
+
+  for(int k=0; k<2; k++){
+    const bool adaptive = k == 1;
+    m_pObjectManager->set_adaptive_steps(adaptive);
+    const unsigned long long steps = m_pObjectManager->get_integration_steps();
+    double mean_error = 0;
+    float max_error = 0;
+
+    for(int j=0; j<particles; j++){
+      Vector2 p = start_pos[j], v = start_vel[j];
+      for(int i=0; i<frames; i++)
+        m_pObjectManager->advance(p, v, radius, dt);
+      const float e = (p - end_pos[j]).Length();
+      mean_error += e;
+      max_error = max(max_error, e);
+    } //for
+
+    const double taken = (double)(m_pObjectManager->get_integration_steps() - steps);
+    report(string(adaptive? "adaptive": "one per frame") + ", " + to_string(particles) + ", " +
+      to_string(taken/(particles*frames*dt)) + ", " + to_string(mean_error/particles) + ", " + to_string(max_error));
+  } //for
+
+  m_pObjectManager->set_adaptive_steps(old_adaptive);
+} //substeps
+
+/// Fly a particle around the first planet in the current level for the
+/// 30 second lifetime of a bullet, and fire phantom bullets from the first
+/// tank, with and without Kepler orbits. Reports the cost per frame of the
+/// orbit and its drift in energy and radius, and the cost and number of
+/// integration steps per phantom bullet.
+
+void CBenchmark::conics(){
+  auto planets = m_pObjectManager->get_planets_list();
+  auto tanks = m_pObjectManager->get_tanks_list();
+  if(planets.empty() || tanks.empty())return;
+  CPlanetObject* planet = planets.front();
+  CTankObject* tank = tanks.front().get();
+
+  const bool old_conics = m_pObjectManager->get_patched_conics();
+  const float dt = 1.0f/60.0f;
+  const int frames = 1800;
+  const float radius = 0.75f;
+
+  //circular orbit a little above the hills
+  const Vector2 start = planet->GetPos() + Vector2(1.5f*planet->get_radius(), 0.0f);
+  const float r0 = (start - planet->GetPos()).Length();
+  const Vector2 start_vel = Vector2(0.0f, sqrtf(m_pObjectManager->calculate_gravity(start).Length()*r0));
+  const float e0 = m_pObjectManager->calculate_total_mechanical_energy(start, start_vel);
+
+  report("conics: Kepler orbits, frames, ns/frame, energy drift, radius drift");
+
+  for(int k=0; k<2; k++){
+    const bool conics = k == 1;
+    m_pObjectManager->set_patched_conics(conics);
+    Vector2 p = start, v = start_vel;
+
+    start_timer();
+    for(int i=0; i<frames; i++)
+      m_pObjectManager->advance(p, v, radius, dt);
+    const double t = stop_timer();
+
+    const float e = m_pObjectManager->calculate_total_mechanical_energy(p, v);
+    report(string(conics? "on": "off") + ", " + to_string(frames) + ", " + to_string(1.0e9*t/frames) + ", " +
+      to_string(fabsf(e - e0)/fabsf(e0)) + ", " + to_string(fabsf((p - planet->GetPos()).Length() - r0)/r0));
+  } //for
+
+  report("conics: Kepler orbits, phantom bullets, ms/phantom, steps/phantom");
+  const int shots = 200;
+
+  for(int k=0; k<2; k++){
+    const bool conics = k == 1;
+    m_pObjectManager->set_patched_conics(conics);
+    const unsigned long long steps = m_pObjectManager->get_integration_steps();
+    float sink = 0;
+
+    start_timer();
+    for(int i=0; i<shots; i++)
+      sink += tank->FirePhantomGun(WATER_SPRITE, m_pRandom->randv(), (float)m_pRandom->randn(50, 1000));
+    const double t = stop_timer();
+
+    const double taken = (double)(m_pObjectManager->get_integration_steps() - steps);
+    report(string(conics? "on": "off") + ", " + to_string(3*shots) + ", " + to_string(1000.0*t/(3*shots)) + ", " + to_string(taken/(3*shots)));
+    m_fSink = sink;
+  } //for
+
+  m_pObjectManager->set_patched_conics(old_conics);
+} //conics
+
+/// Fire random phantom bullets from the first tank in the current level,
+/// with and without settling the ones that will never hit anything as
+/// soon as that is known. Reports the cost per phantom bullet, the steps
+/// flown and saved per phantom bullet, and how many escaped, were stuck
+/// in orbit, and ran out of time.
+
+void CBenchmark::early_termination(){
+  auto tanks = m_pObjectManager->get_tanks_list();
+  if(tanks.empty())return;
+  CTankObject* tank = tanks.front().get();
+
+  const bool old_early = m_pObjectManager->get_early_termination();
+  const int shots = 200;
+  std::vector<Vector2> directions(shots);
+  std::vector<float> powers(shots);
+  for(int i=0; i<shots; i++){ //the same shots both times
+    directions[i] = m_pRandom->randv();
+    powers[i] = (float)m_pRandom->randn(50, 1000);
+  } //for
+
+  report("early_termination: on, phantom bullets, ms/phantom, steps/phantom, saved/phantom, escaped, in orbit, out of time");
+
+  for(int k=0; k<2; k++){
+    const bool early = k == 1;
+    m_pObjectManager->set_early_termination(early);
+    m_pObjectManager->reset_phantom_stats();
+    float sink = 0;
+
+    start_timer();
+    for(int i=0; i<shots; i++)
+      sink += tank->FirePhantomGun(WATER_SPRITE, directions[i], powers[i]);
+    const double t = stop_timer();
+
+    const CPhantomStats& stats = m_pObjectManager->get_phantom_stats();
+    const double n = max(1u, stats.m_nBullets);
+    report(string(early? "on": "off") + ", " + to_string(stats.m_nBullets) + ", " + to_string(1000.0*t/n) + ", " +
+      to_string(stats.m_nSteps/n) + ", " + to_string(stats.m_nStepsSaved/n) + ", " +
+      to_string(stats.m_nEscapes) + ", " + to_string(stats.m_nOrbits) + ", " + to_string(stats.m_nTimeouts));
+    m_fSink = sink;
+  } //for
+
+  m_pObjectManager->set_early_termination(old_early);
+  m_pObjectManager->reset_phantom_stats();
+} //early_termination
+
+/// Play out the same scripted battle for 10,000 frames and report a hash
+/// of the physics state every 1000 frames, along with the build it came
+/// from. Three planets, six tanks driving back and forth, and a shot from
+/// one of them every 150 frames from a fixed list of shells that dig and
+/// pile up terrain and bounce. Random numbers come from a fixed seed.
+/// With DETERMINISTIC_PHYSICS defined, every build (Debug or Release,
+/// x86 or x64, SSE2 or AVX2) should report the same hashes, so diff the
+/// bench_output.txt lines from two of them. Without it they will differ.
+
+void CBenchmark::determinism(){
+  const int frames = 10000;
+
+  string build;
+#ifdef DETERMINISTIC_PHYSICS
+  build = "deterministic";
+#else
+  build = "default";
+#endif
+#ifdef _DEBUG
+  build += " debug";
+#else
+  build += " release";
+#endif
+#if defined(_M_X64) || defined(__x86_64__)
+  build += " x64";
+#else
+  build += " x86";
+#endif
+#if defined(__AVX2__)
+  build += " AVX2";
+#elif defined(__AVX__)
+  build += " AVX";
+#else
+  build += " SSE2";
+#endif
+
+  const bool old_turns = m_bTurnsEnabled;
+  m_bTurnsEnabled = true; //so that only m_pPlayer thinks, and the player doesn't think
+  m_pRandom->srand(20211);
+
+  m_pObjectManager->clear();
+  m_vWorldSize = Vector2(15000, 15000);
+  const Vector2 center = m_vWorldSize/2;
+  CPlanetObject* planet = m_pObjectManager->create_planet(center, 100, 900);
+  CPlanetObject* planet2 = m_pObjectManager->create_planet(center + Vector2(1500.0f, 1500.0f), 10, 500);
+  CPlanetObject* planet3 = m_pObjectManager->create_planet(center + Vector2(-1800.0f, 900.0f), 40, 700);
+
+  std::vector<std::shared_ptr<CTankObject>> tanks = {
+    m_pObjectManager->create_tank(0.0f, planet), m_pObjectManager->create_tank(120.0f, planet),
+    m_pObjectManager->create_tank(240.0f, planet), m_pObjectManager->create_tank(90.0f, planet2),
+    m_pObjectManager->create_tank(270.0f, planet2), m_pObjectManager->create_tank(180.0f, planet3)};
+  for(auto const& tank: tanks)
+    tank->set_is_player_character(true); //nobody moves unless the script says so
+  m_pPlayer = tanks.front();
+
+  const eSpriteType shells[] = {BULLET_SPRITE, BULLET2_SPRITE, BULLET5_SPRITE, BULLET7_SPRITE, BULLET11_SPRITE};
+  const int num_shells = sizeof(shells)/sizeof(eSpriteType);
+
+  report("determinism: build, frames, state hash, ms/frame");
+  start_timer();
+
+  for(int frame=0; frame<frames; frame++){
+    if(frame%150 == 0){ //someone takes a shot
+      CTankObject* tank = tanks[(frame/150)%tanks.size()].get();
+      if(!tank->IsDead()){
+        CBulletObject* bullet = m_pObjectManager->create_bullet(shells[m_pRandom->randn(0, num_shells - 1)], tank->GetPos());
+        bullet->SetOwner(tank);
+        bullet->SetVelocity((300.0f + 500.0f*m_pRandom->randf())*tank->GetViewVector());
+        tank->set_angle(360.0f*m_pRandom->randf()); //aim the next one somewhere else
+      } //if
+    } //if
+
+    for(size_t i=0; i<tanks.size(); i++) //drive back and forth
+      if(((frame/300) + i)%2)tanks[i]->StrafeLeft();
+      else tanks[i]->StrafeRight();
+
+    m_pObjectManager->move();
+
+    if((frame + 1)%1000 == 0){
+      char hash[32];
+      snprintf(hash, sizeof(hash), "%016llx", m_pObjectManager->state_hash());
+      report(build + ", " + to_string(frame + 1) + ", " + hash + ", " + to_string(1000.0*stop_timer()/(frame + 1)));
+    } //if
+  } //for
+
+  m_bTurnsEnabled = old_turns;
+} //determinism
+
+/// Fly 100 projectiles in orbit around a planet for 1200 frames, once
+/// with the planet near the origin and twice with it out near the far
+/// corner of a 45,000 unit world, the biggest the level editor makes.
+/// Out there the orbits are flown with positions in single precision and
+/// then in double precision. The planet has the same terrain every time,
+/// and Kepler orbits are turned off so that every frame is integrated.
+/// Reports the cost per frame of each, and how far each strays from the
+/// orbits flown near the origin, measured relative to the planet.
+
+void CBenchmark::large_world(){
+  const int bullets = 100;
+  const int frames = 1200;
+  const float size = 45000.0f;
+
+  const bool old_conics = m_pObjectManager->get_patched_conics();
+  const float old_size = m_pObjectManager->get_large_world_size();
+  m_pObjectManager->set_patched_conics(false);
+  m_vWorldSize = Vector2(size, size);
+
+  std::vector<Vector2> offsets(bullets), velocities(bullets);
+  for(int i=0; i<bullets; i++){ //roughly circular orbits, clear of the hills
+    const Vector2 u = m_pRandom->randv();
+    const float r = 1800.0f + 1200.0f*m_pRandom->randf();
+    const float v = sqrtf(m_pObjectManager->get_gravitational_constant()*100.0f/r)*(0.9f + 0.2f*m_pRandom->randf());
+    offsets[i] = r*u;
+    velocities[i] = v*Vector2(-u.y, u.x);
+  } //for
+
+  //fly them all from a planet at center, return the final offsets from it and the time taken
+  auto fly = [&](const Vector2& center, float large_world_size, std::vector<CVector2d>& result){
+    m_pObjectManager->clear();
+    m_pRandom->srand(1234); //the same terrain every time
+    CPlanetObject* planet = m_pObjectManager->create_planet(center, 100, 900);
+    m_pObjectManager->set_large_world_size(large_world_size);
+
+    std::vector<CBulletObject*> flying(bullets);
+    for(int i=0; i<bullets; i++){
+      flying[i] = new CBulletObject(BULLET_SPRITE, center + offsets[i]);
+      flying[i]->set_is_phantom(true);
+      flying[i]->SetVelocity(velocities[i]);
+    } //for
+
+    start_timer();
+    for(int f=0; f<frames; f++)
+      for(auto p: flying)p->move();
+    const double t = stop_timer();
+
+    result.resize(bullets);
+    for(int i=0; i<bullets; i++){
+      result[i] = flying[i]->GetPrecisePos() - planet->GetPrecisePos();
+      delete flying[i];
+    } //for
+
+    return t;
+  }; //fly
+
+  std::vector<CVector2d> reference, single, precise;
+  const Vector2 near_center(3000.0f, 3000.0f);
+  const Vector2 far_center(size - 3000.0f, size - 3000.0f);
+  fly(near_center, 0, reference);
+  const double t_single = fly(far_center, FLT_MAX, single);
+  const double t_double = fly(far_center, 0, precise);
+
+  //how far the orbits flown far away stray from the ones flown near the origin
+  auto stray = [&](const std::vector<CVector2d>& result, double& worst){
+    double total = 0;
+    worst = 0;
+    for(int i=0; i<bullets; i++){
+      const double d = (result[i] - reference[i]).Length();
+      total += d;
+      worst = max(worst, d);
+    } //for
+    return total/bullets;
+  }; //stray
+
+  report("large_world: positions, ms/frame for " + to_string(bullets) + " projectiles, mean drift after " +
+    to_string(frames) + " frames, max drift");
+
+  double worst;
+  double mean = stray(single, worst);
+  report("single, " + to_string(1000.0*t_single/frames) + ", " + to_string(mean) + ", " + to_string(worst));
+  mean = stray(precise, worst);
+  report("double, " + to_string(1000.0*t_double/frames) + ", " + to_string(mean) + ", " + to_string(worst));
+  report("double precision overhead " + to_string(100.0*(t_double/t_single - 1.0)) + "%");
+
+  m_pObjectManager->set_large_world_size(old_size);
+  m_pObjectManager->set_patched_conics(old_conics);
+} //large_world
+
+/// Move 64, 256 and 1024 projectiles in orbit among three planets for
+/// 60 frames on 1, 2, 4, 8 and 16 threads, and report the cost per frame
+/// and the speedup over one thread. The projectiles start from the same
+/// place every time, and their final positions are compared bit for bit
+/// with the ones from a single thread, which they should always match.
+
+void CBenchmark::threads(){
+  const int frames = 60;
+  const int counts[] = {64, 256, 1024};
+  const unsigned thread_counts[] = {1, 2, 4, 8, 16};
+  const unsigned old_threads = m_pObjectManager->get_threads();
+
+  m_vWorldSize = Vector2(15000, 15000);
+  const Vector2 center = m_vWorldSize/2;
+
+  report("threads: projectiles, threads, ms/frame, speedup, same as one thread");
+
+  for(int n: counts){
+    m_pObjectManager->clear(); //get rid of the last lot
+    m_pRandom->srand(4321);
+    CPlanetObject* planet = m_pObjectManager->create_planet(center, 100, 900);
+    m_pObjectManager->create_planet(center + Vector2(4000.0f, 3000.0f), 20, 500);
+    m_pObjectManager->create_planet(center + Vector2(-3500.0f, -2500.0f), 40, 600);
+
+    std::vector<CBulletObject*> bullets(n);
+    std::vector<Vector2> start(n), velocity(n);
+    for(int i=0; i<n; i++){ //roughly circular orbits around the big planet
+      const Vector2 u = m_pRandom->randv();
+      const float r = 1800.0f + 1200.0f*m_pRandom->randf();
+      start[i] = planet->GetPos() + r*u;
+      velocity[i] = sqrtf(m_pObjectManager->get_gravitational_constant()*100.0f/r)*Vector2(-u.y, u.x);
+      bullets[i] = m_pObjectManager->create_bullet(BULLET_SPRITE, start[i]);
+      bullets[i]->set_is_phantom(true); //no smoke
+    } //for
+
+    std::vector<Vector2> reference(n);
+    double single = 0;
+
+    for(unsigned k: thread_counts){
+      m_pObjectManager->set_threads(k);
+      for(int i=0; i<n; i++){
+        bullets[i]->SetPrecisePos(start[i]);
+        bullets[i]->SetVelocity(velocity[i]);
+      } //for
+
+      start_timer();
+      for(int f=0; f<frames; f++)
+        m_pObjectManager->move_gravity_objects();
+      const double t = stop_timer();
+
+      bool same = true;
+      for(int i=0; i<n; i++){
+        if(k == 1)reference[i] = bullets[i]->GetPos();
+        else same = same && reference[i] == bullets[i]->GetPos();
+      } //for
+      if(k == 1)single = t;
+
+      report(to_string(n) + ", " + to_string(k) + ", " + to_string(1000.0*t/frames) + ", " +
+        to_string(single/t) + ", " + (same? "yes": "NO"));
+    } //for
+  } //for
+
+  m_pObjectManager->set_threads(old_threads);
+} //threads
+
+/// Run the broad phase on 10 to 5000 objects with and without the spatial
+/// hash, and report the number of narrow phase tests and the cost per
+/// frame of each. The objects are either spread evenly over a 15000 unit
+/// world with three planets and six tanks in it, or half of them are
+/// bunched up in a 300 unit cluster, like a cluster bomb going off. They
+/// are plain objects that nothing responds to, so every frame is the same,
+/// and both ways should find the same number of collisions. Collision
+/// layers are turned off, since they would skip every one of these pairs.
+
+void CBenchmark::broadphase(){
+  const int frames = 10;
+  const int counts[] = {10, 100, 1000, 5000};
+  const bool old_hash = m_pObjectManager->get_spatial_hash();
+  const bool old_layers = m_pObjectManager->get_collision_layers();
+  m_pObjectManager->set_collision_layers(false);
+
+  m_vWorldSize = Vector2(15000, 15000);
+  const Vector2 center = m_vWorldSize/2;
+
+  report("broadphase: layout, objects, all pairs tests/frame, hashed tests/frame, all pairs ms/frame, hashed ms/frame, speedup, same hits");
+
+  for(int cluster=0; cluster<2; cluster++)
+    for(int n: counts){
+      m_pObjectManager->clear(); //get rid of the last lot
+      m_pRandom->srand(2468);
+      CPlanetObject* planets[3] = {
+        m_pObjectManager->create_planet(center, 100, 900),
+        m_pObjectManager->create_planet(center + Vector2(4000.0f, 3000.0f), 20, 500),
+        m_pObjectManager->create_planet(center + Vector2(-3500.0f, -2500.0f), 40, 600)
+      };
+      for(int i=0; i<6; i++)
+        m_pObjectManager->create_tank(m_pRandom->randf()*XM_2PI, planets[i%3]);
+
+      const Vector2 blob = center + Vector2(2000.0f, -2000.0f);
+      for(int i=0; i<n; i++){
+        Vector2 pos;
+        if(cluster && i%2)
+          pos = blob + 150.0f*m_pRandom->randf()*m_pRandom->randv();
+        else pos = Vector2(m_vWorldSize.x*m_pRandom->randf(), m_vWorldSize.y*m_pRandom->randf());
+        m_pObjectManager->create(BULLET_SPRITE, pos);
+      } //for
+
+      double t[2];
+      unsigned long long tests[2], hits[2];
+
+      for(int hash=0; hash<2; hash++){
+        m_pObjectManager->set_spatial_hash(hash != 0);
+        const unsigned long long tests0 = m_pObjectManager->get_pair_tests();
+        const unsigned long long hits0 = m_pObjectManager->get_pair_hits();
+
+        start_timer();
+        for(int f=0; f<frames; f++)
+          m_pObjectManager->BroadPhase();
+        t[hash] = stop_timer();
+
+        tests[hash] = (m_pObjectManager->get_pair_tests() - tests0)/frames;
+        hits[hash] = m_pObjectManager->get_pair_hits() - hits0;
+      } //for
+
+      report(string(cluster? "cluster": "spread") + ", " + to_string(n) + ", " +
+        to_string(tests[0]) + ", " + to_string(tests[1]) + ", " +
+        to_string(1000.0*t[0]/frames) + ", " + to_string(1000.0*t[1]/frames) + ", " +
+        to_string(t[0]/t[1]) + ", " + (hits[0] == hits[1]? "yes": "NO"));
+    } //for
+
+  m_pObjectManager->set_spatial_hash(old_hash);
+  m_pObjectManager->set_collision_layers(old_layers);
+} //broadphase
+
+/// Run the broad phase on a mix of 2000 bullets, phantom bullets, turrets
+/// and debris with and without collision layers, and report for each pair
+/// of layers the narrow phase tests per frame without them, with them, and
+/// how many were skipped. Nothing is placed where it would hit a planet,
+/// tank or wormhole, so every frame is the same.
+
+void CBenchmark::collision_layers(){
+  const int frames = 10;
+  const int n = 2000;
+  const char* names[NUM_COLLISION_LAYERS] = {"bullet", "phantom", "tank", "planet", "wormhole", "turret", "debris"};
+  const bool old_layers = m_pObjectManager->get_collision_layers();
+
+  m_vWorldSize = Vector2(15000, 15000);
+  const Vector2 center = m_vWorldSize/2;
+
+  m_pObjectManager->clear(); //get rid of the last lot
+  m_pRandom->srand(1357);
+  CPlanetObject* planets[3] = {
+    m_pObjectManager->create_planet(center, 100, 900),
+    m_pObjectManager->create_planet(center + Vector2(4000.0f, 3000.0f), 20, 500),
+    m_pObjectManager->create_planet(center + Vector2(-3500.0f, -2500.0f), 40, 600)
+  };
+  for(int i=0; i<6; i++)
+    m_pObjectManager->create_tank(m_pRandom->randf()*XM_2PI, planets[i%3]);
+
+  CWormholeObject* w = m_pObjectManager->create_wormhole(center + Vector2(-5000.0f, 5000.0f), 100);
+  w->SetNextWormhole(m_pObjectManager->create_wormhole(center + Vector2(5000.0f, -5000.0f), 100, w));
+
+  for(int i=0; i<n; i++){
+    Vector2 pos;
+    bool clear;
+
+    do{ //somewhere that doesn't touch a planet or a wormhole
+      pos = Vector2(m_vWorldSize.x*m_pRandom->randf(), m_vWorldSize.y*m_pRandom->randf());
+      clear = (pos - w->GetPos()).Length() > 200.0f && (pos - w->GetNextWormhole()->GetPos()).Length() > 200.0f;
+      for(CPlanetObject* p: planets)
+        clear = clear && (pos - p->GetPos()).Length() > p->get_maximum_altitude() + 100.0f;
+    }while(!clear);
+
+    switch(i%10){
+      case 0: case 1: case 2: case 3: case 4:
+        m_pObjectManager->create_bullet(BULLET_SPRITE, pos);
+        break;
+      case 5: case 6:
+        m_pObjectManager->create_bullet(BULLET_SPRITE, pos)->set_is_phantom(true);
+        break;
+      case 7:
+        m_pObjectManager->create(TURRET_SPRITE, pos);
+        break;
+      default:
+        m_pObjectManager->create(SMOKE_SPRITE, pos);
+    } //switch
+  } //for
+
+  CCollisionStats stats[2];
+  double t[2];
+
+  for(int layers=0; layers<2; layers++){
+    m_pObjectManager->set_collision_layers(layers != 0);
+    m_pObjectManager->reset_collision_stats();
+
+    start_timer();
+    for(int f=0; f<frames; f++)
+      m_pObjectManager->BroadPhase();
+    t[layers] = stop_timer();
+
+    stats[layers] = m_pObjectManager->get_collision_stats();
+  } //for
+
+  report("collision layers: layer, layer, tests/frame without layers, tests/frame with layers, skipped/frame");
+
+  for(int a=0; a<NUM_COLLISION_LAYERS; a++)
+    for(int b=0; b<NUM_COLLISION_LAYERS; b++){
+      const unsigned long long without = stats[0].m_nTested[a][b]/frames;
+      if(without == 0)continue;
+      report(string(names[a]) + ", " + names[b] + ", " + to_string(without) + ", " +
+        to_string(stats[1].m_nTested[a][b]/frames) + ", " + to_string(stats[1].m_nSkipped[a][b]/frames));
+    } //for
+
+  report("collision layers: ms/frame without layers, with layers, speedup: " +
+    to_string(1000.0*t[0]/frames) + ", " + to_string(1000.0*t[1]/frames) + ", " + to_string(t[0]/t[1]));
+
+  m_pObjectManager->set_collision_layers(old_layers);
+} //collision_layers
+
+/// The old way of checking a sphere against a planet, which the polar
+/// test replaced: the core, then the sphere around the highest hill, then
+/// the four triangles between the center and the surface nearest the
+/// center of the sphere.
+/// \param planet The planet.
+/// \param object_boundary The sphere.
+/// \return true if they intersect.
+
+static bool intersects_triangles(CPlanetObject& planet, BoundingSphere& object_boundary){
+  if(det_intersects(planet.GetBoundingSphere(), object_boundary))
+    return true;
+
+  if(det_intersects(planet.get_maximum_altitude_sphere(), object_boundary)){
+    const Vector2 origin = planet.GetPos();
+    const int n = planet.get_number_of_altitudes();
+    const int altitude_index = planet.get_altitude_index_under_point(Vector2(object_boundary.Center.x, object_boundary.Center.y));
+
+    //the two triangles back and two forward from the altitude under the center
+    for(int i=-2; i<2; i++){
+      const int current_index = ((altitude_index + i)%n + n)%n;
+      const Vector2 v0 = planet.get_surface_vector_at_index(current_index);
+      const Vector2 v1 = planet.get_surface_vector_at_index(current_index + 1);
+      if(origin != v0 && origin != v1 && v0 != v1 && det_intersects(object_boundary, origin, v0, v1)) //skip degenerate triangles
+        return true;
+    } //for
+  } //if
+
+  return false;
+} //intersects_triangles
+
+/// Check the polar CPlanetObject::Intersects and its batched version against
+/// the old triangle test on 100,000 random spheres around each of three
+/// planets, and time all three. The planets get some craters and mounds
+/// first, so that the sector bounds have been updated after terrain edits.
+/// The spheres are anywhere from the core to just above the highest hill,
+/// where all of the work is. Bullet-sized ones (radius up to 0.75) should
+/// always agree. Bigger ones may not, since the old test only looked at
+/// the four triangles nearest the center of the sphere.
+
+void CBenchmark::polar_intersects(){
+  const int n = 100000;
+
+  m_vWorldSize = Vector2(15000, 15000);
+  const Vector2 center = m_vWorldSize/2;
+
+  m_pObjectManager->clear(); //get rid of the last lot
+  m_pRandom->srand(97531);
+  CPlanetObject* planets[3] = {
+    m_pObjectManager->create_planet(center, 100, 900),
+    m_pObjectManager->create_planet(center + Vector2(4000.0f, 3000.0f), 20, 500),
+    m_pObjectManager->create_planet(center + Vector2(-3500.0f, -2500.0f), 40, 225)
+  };
+
+  report("polar intersects: radius, small mismatches, big mismatches, batch mismatches, triangles ns/test, polar ns/test, batched ns/test, speedup");
+
+  std::vector<BoundingSphere> spheres(n);
+  std::vector<char> old_result(n);
+  bool* batch_result = new bool[n];
+
+  for(CPlanetObject* planet: planets){
+    for(int i=0; i<20; i++){ //rough it up
+      BoundingSphere crater;
+      const Vector2 u = m_pRandom->randv();
+      crater.Center = (Vector3)(planet->GetPos() + (float)planet->get_radius()*u);
+      crater.Radius = 10.0f + 40.0f*m_pRandom->randf();
+      if(i%4 == 3)planet->generate_terrain(crater);
+      else planet->destroy_terrain(crater);
+    } //for
+
+    const float core = planet->GetBoundingSphere().Radius;
+    const float top = (float)planet->get_maximum_altitude() + 10.0f;
+    for(int i=0; i<n; i++){
+      const float d = core + (top - core)*m_pRandom->randf();
+      spheres[i].Center = (Vector3)(planet->GetPos() + d*m_pRandom->randv());
+      spheres[i].Radius = i%2? 0.1f + 0.65f*m_pRandom->randf(): 0.75f + 7.25f*m_pRandom->randf();
+    } //for
+
+    start_timer();
+    for(int i=0; i<n; i++)
+      old_result[i] = intersects_triangles(*planet, spheres[i]);
+    const double t_old = stop_timer();
+
+    int small = 0, big = 0;
+    start_timer();
+    for(int i=0; i<n; i++)
+      if(planet->Intersects(spheres[i]) != (old_result[i] != 0))
+        (i%2? small: big)++;
+    const double t_new = stop_timer();
+
+    start_timer();
+    planet->Intersects(spheres.data(), n, batch_result);
+    const double t_batch = stop_timer();
+
+    int batch = 0;
+    for(int i=0; i<n; i++)
+      if(batch_result[i] != planet->Intersects(spheres[i]))
+        batch++;
+
+    report(to_string(planet->get_radius()) + ", " + to_string(small) + ", " + to_string(big) + ", " + to_string(batch) + ", " +
+      to_string(1e9*t_old/n) + ", " + to_string(1e9*t_new/n) + ", " + to_string(1e9*t_batch/n) + ", " + to_string(t_old/t_new));
+  } //for
+
+  delete [] batch_result;
+} //polar_intersects
+
+/// Find out where terrain queries get settled: by the core and the sphere
+/// around the highest hill, by one of the three levels of the sector
+/// hierarchy, or by the full test against the surface edges. Spheres are
+/// scattered between the core and the top of the highest hill, and
+/// sweeps are short hops like a bullet or phantom bullet makes in a
+/// physics step, which is what the trajectory preview does.
+
+void CBenchmark::sector_levels(){
+  const int n = 100000;
+  const char* level[5] = {"core/hill", "8 bins", "32 bins", "128 bins", "edges"};
+
+  m_vWorldSize = Vector2(15000, 15000);
+  const Vector2 center = m_vWorldSize/2;
+
+  m_pObjectManager->clear(); //get rid of the last lot
+  m_pRandom->srand(97531);
+  CPlanetObject* planets[3] = {
+    m_pObjectManager->create_planet(center, 100, 900),
+    m_pObjectManager->create_planet(center + Vector2(4000.0f, 3000.0f), 20, 500),
+    m_pObjectManager->create_planet(center + Vector2(-3500.0f, -2500.0f), 40, 225)
+  };
+
+  report("sector levels: radius, level, accepted %, rejected %, settled % of what reached it");
+
+  for(CPlanetObject* planet: planets){
+    for(int i=0; i<20; i++){ //rough it up
+      BoundingSphere crater;
+      const Vector2 u = m_pRandom->randv();
+      crater.Center = (Vector3)(planet->GetPos() + (float)planet->get_radius()*u);
+      crater.Radius = 10.0f + 40.0f*m_pRandom->randf();
+      if(i%4 == 3)planet->generate_terrain(crater);
+      else planet->destroy_terrain(crater);
+    } //for
+
+    const float core = planet->GetBoundingSphere().Radius;
+    const float top = (float)planet->get_maximum_altitude() + 10.0f;
+    planet->reset_sector_stats();
+
+    start_timer();
+    for(int i=0; i<n; i++){
+      BoundingSphere s;
+      const float d = core + (top - core)*m_pRandom->randf();
+      s.Center = (Vector3)(planet->GetPos() + d*m_pRandom->randv());
+      s.Radius = i%2? 0.1f + 0.65f*m_pRandom->randf(): 0.75f + 7.25f*m_pRandom->randf();
+      planet->Intersects(s);
+    } //for
+    const double t_intersects = stop_timer();
+
+    const CSectorStats stats = planet->get_sector_stats(); //the sweeps below call Intersects too
+    planet->reset_sector_stats();
+
+    start_timer();
+    for(int i=0; i<n; i++){
+      const float d = core + (top + 50.0f - core)*m_pRandom->randf();
+      const Vector2 from = planet->GetPos() + d*m_pRandom->randv();
+      const Vector2 to = from + (5.0f + 15.0f*m_pRandom->randf())*m_pRandom->randv();
+      float toi;
+      Vector2 contact;
+      planet->Sweep(from, to, 0.5f, toi, contact);
+    } //for
+    const double t_sweep = stop_timer();
+    const CSectorStats& sweeps = planet->get_sector_stats();
+
+    unsigned long long reached = n;
+    for(int l=0; l<5; l++){
+      const unsigned long long settled = stats.m_nAccepted[l] + stats.m_nRejected[l];
+      report(to_string(planet->get_radius()) + ", " + level[l] + ", " +
+        to_string(100.0*stats.m_nAccepted[l]/n) + ", " + to_string(100.0*stats.m_nRejected[l]/n) + ", " +
+        to_string(reached? 100.0*settled/reached: 0.0));
+      reached -= settled;
+    } //for
+
+    report(to_string(planet->get_radius()) + ", intersects ns/test " + to_string(1e9*t_intersects/n) +
+      ", sweep ns/test " + to_string(1e9*t_sweep/n) + ", 128 bins skipped by sweeps " +
+      to_string(sweeps.m_nSweepBins? 100.0*sweeps.m_nSweepBinsSkipped/sweeps.m_nSweepBins: 0.0) + "%");
+  } //for
+} //sector_levels
+
+/// Time sweeping bullets against a planet one at a time and in one batch,
+/// for batches of different sizes, and check that they agree. Half of the
+/// bullets are scattered around the planet, out to twice the top of its
+/// highest hill, and half are near the surface, which is where a batch
+/// has to do the real work.
+
+void CBenchmark::planet_batches(){
+  const int reps = 200000; //sweeps per timing
+  const size_t sizes[] = {16, 256, 4096};
+
+  m_vWorldSize = Vector2(15000, 15000);
+  const Vector2 center = m_vWorldSize/2;
+
+  m_pObjectManager->clear(); //get rid of the last lot
+  m_pRandom->srand(97531);
+  CPlanetObject* planets[3] = {
+    m_pObjectManager->create_planet(center, 100, 900),
+    m_pObjectManager->create_planet(center + Vector2(4000.0f, 3000.0f), 20, 500),
+    m_pObjectManager->create_planet(center + Vector2(-3500.0f, -2500.0f), 40, 225)
+  };
+
+  report("planet batches: radius, batch size, mismatches, single ns/bullet, batched ns/bullet, speedup");
+
+  std::vector<Vector2> from, to;
+  std::vector<float> radius, toi;
+
+  for(CPlanetObject* planet: planets){
+    for(int i=0; i<20; i++){ //rough it up
+      BoundingSphere crater;
+      const Vector2 u = m_pRandom->randv();
+      crater.Center = (Vector3)(planet->GetPos() + (float)planet->get_radius()*u);
+      crater.Radius = 10.0f + 40.0f*m_pRandom->randf();
+      if(i%4 == 3)planet->generate_terrain(crater);
+      else planet->destroy_terrain(crater);
+    } //for
+
+    const float core = planet->GetBoundingSphere().Radius;
+    const float top = (float)planet->get_maximum_altitude();
+
+    for(size_t n: sizes){
+      from.resize(n);
+      to.resize(n);
+      radius.resize(n);
+      toi.resize(n);
+
+      for(size_t k=0; k<n; k++){
+        const float d = k%2? core + (top + 20.0f - core)*m_pRandom->randf(): top*(1.0f + m_pRandom->randf());
+        from[k] = planet->GetPos() + d*m_pRandom->randv();
+        to[k] = from[k] + (5.0f + 15.0f*m_pRandom->randf())*m_pRandom->randv();
+        radius[k] = 0.5f + 4.0f*m_pRandom->randf();
+      } //for
+
+      const int rounds = max(1, reps/(int)n);
+
+      start_timer();
+      for(int r=0; r<rounds; r++)
+        for(size_t k=0; k<n; k++){
+          float t;
+          Vector2 contact;
+          planet->Sweep(from[k], to[k], radius[k], t, contact);
+        } //for
+      const double t_single = stop_timer();
+
+      start_timer();
+      for(int r=0; r<rounds; r++)
+        planet->Sweep(from.data(), to.data(), radius.data(), n, toi.data());
+      const double t_batch = stop_timer();
+
+      int mismatches = 0;
+      for(size_t k=0; k<n; k++){
+        float t;
+        Vector2 contact;
+        const bool hit = planet->Sweep(from[k], to[k], radius[k], t, contact);
+        if(hit != (toi[k] <= 1.0f) || (hit && t != toi[k]))
+          mismatches++;
+      } //for
+
+      const double bullets = (double)rounds*n;
+      report(to_string(planet->get_radius()) + ", " + to_string(n) + ", " + to_string(mismatches) + ", " +
+        to_string(1e9*t_single/bullets) + ", " + to_string(1e9*t_batch/bullets) + ", " + to_string(t_single/t_batch));
+    } //for
+  } //for
+} //planet_batches
+
+/// Time the tank and planet queries with and without the surface index,
+/// for a few tanks and for a lot of them, and check that they agree. The
+/// nearest tank query runs once for every phantom bullet the AI fires, so
+/// an AI turn is timed too, as a batch of phantom shots from one tank,
+/// scaled up to the 45,000 shots of a full turn.
+
+void CBenchmark::surface_index(){
+  const int n = 100000; //queries per timing
+  const int shots = 300; //phantom shots per timing
+  const int full_turn = 45000; //phantom shots in an AI turn
+  const int counts[] = {6, 60, 600};
+  const bool old_index = m_pObjectManager->get_surface_index();
+
+  report("surface index: tanks, index, nearest tank ns, nearest location ns, closest planet ns, explosion ns, mismatches, AI turn ms");
+
+  for(int tanks: counts){
+    m_vWorldSize = Vector2(15000, 15000);
+    const Vector2 center = m_vWorldSize/2;
+
+    m_pObjectManager->clear(); //get rid of the last lot
+    m_pRandom->srand(97531);
+    CPlanetObject* planets[3] = {
+      m_pObjectManager->create_planet(center, 100, 900),
+      m_pObjectManager->create_planet(center + Vector2(4000.0f, 3000.0f), 20, 500),
+      m_pObjectManager->create_planet(center + Vector2(-3500.0f, -2500.0f), 40, 225)
+    };
+
+    for(int i=0; i<tanks; i++)
+      m_pObjectManager->create_tank(360.0f*m_pRandom->randf(), planets[i%3]);
+    CTankObject* shooter = m_pObjectManager->get_tanks_list().front().get();
+
+    std::vector<Vector2> points(n);
+    for(int i=0; i<n; i++) //half near the ground, where shells land
+      points[i] = i%2? center + Vector2(7000.0f*m_pRandom->randf() - 3500.0f, 7000.0f*m_pRandom->randf() - 3500.0f):
+        planets[i%3]->GetPos() + (float)(planets[i%3]->get_radius() + 100)*m_pRandom->randv();
+
+    std::vector<Vector2> directions(shots);
+    std::vector<float> powers(shots);
+    for(int i=0; i<shots; i++){
+      directions[i] = m_pRandom->randv();
+      powers[i] = (float)m_pRandom->randn(50, 1000);
+    } //for
+
+    std::vector<float> location[2];
+    std::vector<CTankObject*> nearest[2];
+    std::vector<CPlanetObject*> closest[2];
+
+    for(int k=0; k<2; k++){
+      m_pObjectManager->set_surface_index(k == 1);
+      location[k].resize(n);
+      nearest[k].resize(n);
+      closest[k].resize(n);
+
+      start_timer();
+      for(int i=0; i<n; i++)
+        nearest[k][i] = m_pObjectManager->get_nearest_tank(points[i]).get();
+      const double t_nearest = stop_timer();
+
+      start_timer();
+      for(int i=0; i<n; i++)
+        location[k][i] = m_pObjectManager->get_nearest_tank_location(points[i], shooter);
+      const double t_location = stop_timer();
+
+      start_timer();
+      for(int i=0; i<n; i++)
+        closest[k][i] = m_pObjectManager->calculate_closest_planet(points[i]);
+      const double t_closest = stop_timer();
+
+      start_timer();
+      for(int i=0; i<n; i++){ //no damage, so that the tanks survive
+        BoundingSphere sphere;
+        sphere.Center = (Vector3)points[i];
+        sphere.Radius = 50.0f;
+        m_pObjectManager->DamagePlayersInSphere(sphere, 0);
+      } //for
+      const double t_explosion = stop_timer();
+
+      int mismatches = 0;
+      if(k == 1)
+        for(int i=0; i<n; i++)
+          if(nearest[0][i] != nearest[1][i] || closest[0][i] != closest[1][i] || location[0][i] != location[1][i])
+            mismatches++;
+
+      float sink = 0;
+      start_timer();
+      for(int i=0; i<shots; i++)
+        sink += shooter->FirePhantomGun(WATER_SPRITE, directions[i], powers[i]);
+      const double t_turn = stop_timer()*full_turn/shots;
+      m_fSink = sink;
+
+      report(to_string(tanks) + ", " + (k? "on": "off") + ", " + to_string(1e9*t_nearest/n) + ", " +
+        to_string(1e9*t_location/n) + ", " + to_string(1e9*t_closest/n) + ", " + to_string(1e9*t_explosion/n) + ", " +
+        to_string(mismatches) + ", " + to_string(1000.0*t_turn));
+    } //for
+  } //for
+
+  m_pObjectManager->set_surface_index(old_index);
+} //surface_index
+
+/// Move 2 to 50 planets in orbit about each other for 600 frames, with two
+/// tanks on each, and report the cost of a frame with the planets moving
+/// and with the same planets held still. A frame here is moving everything
+/// affected by gravity, moving the tanks and the broad phase. One planet
+/// is heavy and the rest are light moons in roughly circular orbits around
+/// it, with the heavy one given just enough of a kick the other way that
+/// the whole system doesn't drift off. The relative change in the total
+/// energy of the planets over the run shows how well the integrator keeps
+/// their orbits, and the furthest that a tank got from the height it
+/// started at above its planet's center, measured straight after the
+/// planets move and before the tanks do, shows that the tanks are carried
+/// along with their planets.
+
+void CBenchmark::moving_planets(){
+  const int frames = 600;
+  const int counts[] = {2, 5, 10, 20, 50};
+  const double G = m_pObjectManager->get_gravitational_constant();
+
+  m_vWorldSize = Vector2(15000, 15000);
+  const Vector2 center = m_vWorldSize/2;
+
+  report("moving planets: planets, still ms/frame, moving ms/frame, energy drift, worst tank drift");
+
+  for(int n: counts){
+    double t[2] = {0, 0};
+    double drift = 0;
+    float tank_drift = 0;
+
+    for(int moving=0; moving<2; moving++){
+      m_pObjectManager->clear(); //get rid of the last lot
+      m_pRandom->srand(97531);
+
+      std::vector<CPlanetObject*> planets(n);
+      planets[0] = m_pObjectManager->create_planet(center, 100, 900, moving == 1);
+      Vector2 momentum = Vector2::Zero;
+
+      for(int i=1; i<n; i++){
+        const Vector2 u = m_pRandom->randv();
+        const float r = 2200.0f + 4500.0f*i/n;
+        planets[i] = m_pObjectManager->create_planet(center + r*u, 1, 150, moving == 1);
+        planets[i]->SetVelocity((float)sqrt(G*100.0/r)*Vector2(-u.y, u.x));
+        momentum += planets[i]->GetVelocity();
+      } //for
+
+      planets[0]->SetVelocity(-momentum/100.0f);
+
+      std::vector<std::pair<CTankObject*, CPlanetObject*>> tanks;
+      std::vector<float> height;
+      for(int i=0; i<2*n; i++){
+        CPlanetObject* planet = planets[i%n];
+        tanks.push_back(std::make_pair(m_pObjectManager->create_tank(360.0f*m_pRandom->randf(), planet).get(), planet));
+        height.push_back((tanks.back().first->GetPos() - planet->GetPos()).Length());
+      } //for
+
+      auto energy = [&](){ //kinetic plus potential, in double precision
+        double e = 0;
+        for(int i=0; i<n; i++){
+          const double m = planets[i]->GetMass();
+          const Vector2 v = planets[i]->GetVelocity();
+          e += 0.5*m*((double)v.x*v.x + (double)v.y*v.y);
+          for(int j=i + 1; j<n; j++){
+            const CVector2d d = planets[j]->GetPrecisePos() - planets[i]->GetPrecisePos();
+            e -= G*m*planets[j]->GetMass()/sqrt(d.x*d.x + d.y*d.y);
+          } //for
+        } //for
+        return e;
+      }; //energy
+
+      const double e0 = energy();
+
+      start_timer();
+      for(int f=0; f<frames; f++){
+        m_pObjectManager->move_gravity_objects();
+
+        if(moving)
+          for(size_t k=0; k<tanks.size(); k++){
+            const float h = (tanks[k].first->GetPos() - tanks[k].second->GetPos()).Length();
+            tank_drift = max(tank_drift, fabsf(h - height[k]));
+          } //for
+
+        for(auto const& p: m_pObjectManager->get_tanks_list())
+          p->move();
+        m_pObjectManager->BroadPhase();
+      } //for
+      t[moving] = stop_timer();
+
+      if(moving)
+        drift = fabs(energy() - e0)/fabs(e0);
+    } //for
+
+    report(to_string(n) + ", " + to_string(1000.0*t[0]/frames) + ", " + to_string(1000.0*t[1]/frames) + ", " +
+      to_string(drift) + ", " + to_string(tank_drift));
+  } //for
+} //moving_planets
+
+/// Make planets from a radius of 60 up to 3000, rough them up, and report
+/// how many altitudes each gets, how wide that makes a column at sea level,
+/// and how much memory the terrain and its tables take. Then report the
+/// columns of the altitude pyramid that each consumer ends up using: how
+/// many draw_planet draws to be within a pixel, and how many the phantom
+/// bullets sweep against over the whole planet, with the cost of a short
+/// sweep near the surface against the altitudes and against those columns,
+/// how often the columns are hit where the altitudes are not, and how many
+/// hits on the altitudes the columns miss, which should be none, since the
+/// columns are meant to only ever hit early.
+
+void CBenchmark::terrain_resolution(){
+  const int n = 100000; //sweeps per timing
+  const int radii[] = {60, 225, 500, 900, 3000};
+  const float tolerance = m_pObjectManager->get_phantom_tolerance();
+
+  m_vWorldSize = Vector2(15000, 15000);
+  const Vector2 center = m_vWorldSize/2;
+
+  report("terrain resolution: radius, altitudes, column width, KB, pyramid levels, columns drawn, phantom columns, exact sweep ns, phantom sweep ns, early hit %, missed hits");
+
+  for(int radius: radii){
+    m_pObjectManager->clear(); //get rid of the last lot
+    m_pRandom->srand(97531);
+    CPlanetObject* planet = m_pObjectManager->create_planet(center, 100, radius);
+
+    for(int i=0; i<20; i++){ //rough it up
+      BoundingSphere crater;
+      const Vector2 u = m_pRandom->randv();
+      crater.Center = (Vector3)(planet->GetPos() + (float)planet->get_radius()*u);
+      crater.Radius = (0.02f + 0.08f*m_pRandom->randf())*radius;
+      if(i%4 == 3)planet->generate_terrain(crater);
+      else planet->destroy_terrain(crater);
+    } //for
+
+    std::vector<std::pair<int, int>> columns, phantom;
+    planet->get_render_columns(1.0f/m_pRenderer->get_scale_factor(), columns);
+    planet->get_render_columns(tolerance, phantom);
+
+    //short steps, like a bullet's in one frame, from anywhere between the core and just above the highest hill
+    const float core = planet->GetBoundingSphere().Radius;
+    const float top = (float)planet->get_maximum_altitude() + 20.0f;
+    std::vector<Vector2> from(n), to(n);
+    for(int i=0; i<n; i++){
+      from[i] = planet->GetPos() + (core + (top - core)*m_pRandom->randf())*m_pRandom->randv();
+      to[i] = from[i] + 20.0f*m_pRandom->randv();
+    } //for
+
+    std::vector<char> hit[2];
+    double t[2];
+    for(int k=0; k<2; k++){
+      hit[k].resize(n);
+      start_timer();
+      for(int i=0; i<n; i++){
+        float toi;
+        hit[k][i] = planet->Sweep(from[i], to[i], 1.0f, k? tolerance: 0.0f, toi);
+      } //for
+      t[k] = stop_timer();
+    } //for
+
+    int early = 0, missed = 0;
+    for(int i=0; i<n; i++)
+      if(hit[1][i] && !hit[0][i])early++;
+      else if(hit[0][i] && !hit[1][i])missed++;
+
+    const int altitudes = planet->get_number_of_altitudes();
+    report(to_string(radius) + ", " + to_string(altitudes) + ", " + to_string(2*XM_PI*radius/altitudes) + ", " +
+      to_string(planet->get_memory_bytes()/1024.0) + ", " + to_string(planet->get_pyramid_levels()) + ", " +
+      to_string(columns.size()) + ", " + to_string(phantom.size()) + ", " + to_string(1e9*t[0]/n) + ", " +
+      to_string(1e9*t[1]/n) + ", " + to_string(100.0*early/n) + ", " + to_string(missed) +
+      (missed > 0? " FAILED": ""));
+  } //for
+} //terrain_resolution
+
+/// Keep a cache of the surface points of a big planet up to date while
+/// batches of 1 to 64 craters are made in it, once from the spans of
+/// altitudes that the planet says changed and once by rebuilding it after
+/// every batch, and report how many altitudes each batch dirties and the
+/// cost of each. A second cache that only catches up every 16 batches,
+/// which falls off the end of the log now and then, is checked against
+/// the planet too.
+
+void CBenchmark::dirty_spans(){
+  const int batches = 200;
+  const int sizes[] = {1, 8, 64};
+
+  m_vWorldSize = Vector2(15000, 15000);
+  const Vector2 center = m_vWorldSize/2;
+
+  report("dirty spans: craters per batch, spans per batch, altitudes per batch, altitudes, incremental us, full us, mismatches");
+
+  for(int size: sizes){
+    m_pObjectManager->clear(); //get rid of the last lot
+    m_pRandom->srand(97531);
+    CPlanetObject* planet = m_pObjectManager->create_planet(center, 100, 3000);
+    const int n = planet->get_number_of_altitudes();
+
+    std::vector<Vector2> fast(n), slow(n);
+    for(int i=0; i<n; i++)
+      fast[i] = slow[i] = planet->get_surface_vector_at_index(i);
+    unsigned fast_version = planet->get_terrain_version();
+    unsigned slow_version = fast_version;
+
+    std::vector<std::pair<int, int>> spans;
+    unsigned long long span_count = 0, dirty = 0;
+    double t_incremental = 0, t_full = 0;
+    int mismatches = 0;
+
+    for(int b=0; b<batches; b++){
+      planet->begin_edits();
+      for(int i=0; i<size; i++){
+        BoundingSphere crater;
+        const Vector2 u = m_pRandom->randv();
+        crater.Center = (Vector3)(planet->GetPos() + (float)planet->get_radius()*u);
+        crater.Radius = 10.0f + 50.0f*m_pRandom->randf();
+        if(i%4 == 3)planet->generate_terrain(crater);
+        else planet->destroy_terrain(crater);
+      } //for
+      planet->end_edits();
+
+      start_timer();
+      planet->get_dirty_spans(fast_version, spans);
+      for(const std::pair<int, int>& span: spans)
+        for(int i=span.first; i<=span.second; i++)
+          fast[i] = planet->get_surface_vector_at_index(i);
+      t_incremental += stop_timer();
+
+      span_count += spans.size();
+      for(const std::pair<int, int>& span: spans)
+        dirty += span.second - span.first + 1;
+
+      start_timer();
+      for(int i=0; i<n; i++)
+        slow[i] = planet->get_surface_vector_at_index(i);
+      t_full += stop_timer();
+
+      for(int i=0; i<n; i++)
+        if(fast[i] != slow[i])mismatches++;
+    } //for
+
+    //a cache that falls behind, then catches up in one go
+    std::vector<Vector2> lagging(n);
+    unsigned lagging_version = 0; //never caught up, so everything
+    for(int b=0; b<batches; b++){
+      BoundingSphere crater;
+      crater.Center = (Vector3)(planet->GetPos() + (float)planet->get_radius()*m_pRandom->randv());
+      crater.Radius = 10.0f + 50.0f*m_pRandom->randf();
+      planet->destroy_terrain(crater);
+
+      if(b%16 == 15){
+        planet->get_dirty_spans(lagging_version, spans);
+        for(const std::pair<int, int>& span: spans)
+          for(int i=span.first; i<=span.second; i++)
+            lagging[i] = planet->get_surface_vector_at_index(i);
+        for(int i=0; i<n; i++)
+          if(lagging[i] != planet->get_surface_vector_at_index(i))mismatches++;
+      } //if
+    } //for
+
+    report(to_string(size) + ", " + to_string((double)span_count/batches) + ", " + to_string((double)dirty/batches) + ", " +
+      to_string(n) + ", " + to_string(1e6*t_incremental/batches) + ", " + to_string(1e6*t_full/batches) + ", " +
+      to_string(mismatches));
+  } //for
+} //dirty_spans
+
+/// The old way of carving a crater, which the closed form kernels
+/// replaced: two ray casts and a sine and cosine for each altitude under
+/// the blast. It works on a copy of a planet's altitudes, and doesn't draw
+/// smoke or update the sectors.
+/// \param planet The planet, which gives the geometry.
+/// \param altitudes [in, out] A copy of its altitudes.
+/// \param object_boundary The blast.
+
+static void destroy_terrain_rays(CPlanetObject& planet, std::vector<int>& altitudes, BoundingSphere& object_boundary){
+  const Vector2 origin = planet.GetPos();
+  const Vector2 center = Vector2(object_boundary.Center.x, object_boundary.Center.y);
+  const int n = (int)altitudes.size();
+  const int bedrock = (int)planet.GetBoundingSphere().Radius + 5; //don't expose the core
+
+  const float delta_angle = fabsf(det_asin(object_boundary.Radius/det_length(center - origin))); //angular radius of the blast
+  const int delta_altitude_index = (int)ceilf(delta_angle*n/(2*XM_PI));
+  const int altitude_index = planet.get_altitude_index_under_point(center);
+
+  for(int i=altitude_index - delta_altitude_index; i<altitude_index + delta_altitude_index; i++){
+    const float angle = 2*XM_PI*i/n;
+    const Vector2 direction = Vector2(det_cos(angle), det_sin(angle));
+    int& length = altitudes[(i%n + n)%n];
+
+    float f_length;
+    if(length > bedrock && det_intersects(object_boundary, origin, direction, f_length) && length >= f_length){
+      float f_length2; //the far side of the blast
+      det_intersects(object_boundary, origin + (f_length + 1)*direction, direction, f_length2);
+      length = (int)max(f_length, length - f_length2);
+    } //if
+
+    length = max(length, bedrock);
+  } //for
+} //destroy_terrain_rays
+
+/// The old way of dropping dirt, which the closed form kernels replaced:
+/// two ray casts and a sine and cosine for each altitude under the blast.
+/// It works on a copy of a planet's altitudes, and doesn't update the
+/// sectors.
+/// \param planet The planet, which gives the geometry.
+/// \param altitudes [in, out] A copy of its altitudes.
+/// \param object_boundary The blast.
+
+static void generate_terrain_rays(CPlanetObject& planet, std::vector<int>& altitudes, BoundingSphere& object_boundary){
+  const Vector2 origin = planet.GetPos();
+  const Vector2 center = Vector2(object_boundary.Center.x, object_boundary.Center.y);
+  const int n = (int)altitudes.size();
+
+  const float delta_angle = fabsf(det_asin(object_boundary.Radius/det_length(center - origin))); //angular radius of the blast
+  const int delta_altitude_index = (int)ceilf(delta_angle*n/(2*XM_PI));
+  const int altitude_index = planet.get_altitude_index_under_point(center);
+
+  for(int i=altitude_index - delta_altitude_index; i<altitude_index + delta_altitude_index; i++){
+    const float angle = 2*XM_PI*i/n;
+    const Vector2 direction = Vector2(det_cos(angle), det_sin(angle));
+    int& length = altitudes[(i%n + n)%n];
+    float f_length = (float)length;
+
+    if(det_intersects(object_boundary, origin, direction, f_length)){
+      if(length > f_length){ //the near side of the blast is underground, so drop the chord above the ground
+        if(det_intersects(object_boundary, origin + (float)length*direction, direction, f_length))
+          length += (int)f_length;
+      } //if
+      else if(length < f_length){ //all of the blast is above the ground here
+        if(det_intersects(object_boundary, origin + f_length*direction, direction, f_length))
+          length += (int)f_length;
+      } //else if
+    } //if
+  } //for
+} //generate_terrain_rays
+
+/// Make the same craters and dirt in a planet with the closed form kernels
+/// and in a copy of its altitudes with the old ray casts, for blasts from a
+/// radius of 10 up to 225, the size of a BULLET11 blast. The closed form
+/// edits are timed inside begin_edits and end_edits, so that the sector
+/// updates, which the ray casts on the copy don't do, are left out. The
+/// smoke is still in, which makes the closed form look a little slower
+/// than it is. Then check that the highest hill never sticks out of the
+/// sphere around it, even while the sector updates are held back, and
+/// that the bounds are exact again afterwards.
+
+void CBenchmark::blast_kernels(){
+  const int blasts = 200;
+  const int planet_radii[] = {500, 3000};
+  const float blast_radii[] = {10.0f, 50.0f, 225.0f};
+
+  m_vWorldSize = Vector2(15000, 15000);
+  const Vector2 center = m_vWorldSize/2;
+
+  report("blast kernels: planet radius, blast radius, altitudes per blast, closed form us, ray casts us, speedup, bound violations");
+
+  for(int planet_radius: planet_radii)
+    for(float blast_radius: blast_radii){
+      m_pObjectManager->clear(); //get rid of the last lot
+      m_pRandom->srand(97531);
+      CPlanetObject* planet = m_pObjectManager->create_planet(center, 100, planet_radius);
+      const int n = planet->get_number_of_altitudes();
+      std::vector<int> old_altitudes(n); //for the ray casts
+      for(int i=0; i<n; i++)
+        old_altitudes[i] = planet->get_altitude_at_index(i);
+
+      std::vector<BoundingSphere> craters(blasts);
+      for(BoundingSphere& crater: craters){
+        crater.Center = (Vector3)(planet->GetPos() + (float)planet_radius*m_pRandom->randv());
+        crater.Radius = blast_radius*(0.5f + m_pRandom->randf());
+      } //for
+
+      int violations = 0;
+      auto check = [&](bool exact){ //the bounds against the altitudes
+        int highest = INT_MIN, lowest = INT_MAX;
+        for(int i=0; i<n; i++){
+          highest = max(highest, planet->get_altitude_at_index(i));
+          lowest = min(lowest, planet->get_altitude_at_index(i));
+        } //for
+        if(planet->get_maximum_altitude() < highest || planet->get_minimum_altitude() > lowest ||
+          planet->get_maximum_altitude_sphere().Radius < (float)highest)violations++;
+        if(exact && (planet->get_maximum_altitude() != highest || planet->get_minimum_altitude() != lowest))violations++;
+      }; //check
+
+      planet->begin_edits();
+      start_timer();
+      for(int i=0; i<blasts; i++)
+        if(i%4 == 3)planet->generate_terrain(craters[i]);
+        else planet->destroy_terrain(craters[i]);
+      const double t_closed = stop_timer();
+      check(false);
+      planet->end_edits();
+      check(true);
+
+      start_timer();
+      for(int i=0; i<blasts; i++)
+        if(i%4 == 3)generate_terrain_rays(*planet, old_altitudes, craters[i]);
+        else destroy_terrain_rays(*planet, old_altitudes, craters[i]);
+      const double t_rays = stop_timer();
+
+      //and one edit at a time, checking after each
+      for(int i=0; i<blasts; i++){
+        if(i%4 == 3)planet->generate_terrain(craters[i]);
+        else planet->destroy_terrain(craters[i]);
+        check(true);
+      } //for
+
+      int first;
+      const int span = planet->get_blast_span(craters[0], first);
+      report(to_string(planet_radius) + ", " + to_string(blast_radius) + ", " + to_string(span) + ", " +
+        to_string(1e6*t_closed/blasts) + ", " + to_string(1e6*t_rays/blasts) + ", " + to_string(t_rays/t_closed) + ", " +
+        to_string(violations));
+    } //for
+} //blast_kernels
+
+/// The old way of generating a planet's surface with the planetary
+/// method, which generate_noise_planetary_method replaced. It raises or
+/// lowers half of the ring at a time, stepping along every altitude, with
+/// numbers drawn from the game's generator, so it can only be run on one
+/// thread. It only makes the altitudes, not the tables built from them.
+/// \param random The game's generator.
+/// \param radius Sea level radius of the planet.
+/// \param altitudes [in, out] The altitudes, already the right size.
+/// \param num_iterations Number of runs to raise or lower.
+/// \param height_step How much to raise or lower each run.
+
+static void generate_noise_planetary_method_walk(CRandom& random, int radius, std::vector<int>& altitudes, int num_iterations, int height_step){
+  const int n = (int)altitudes.size();
+  const int indices_to_move = n/2;
+  const float tallest_mountain_altitude = radius*.12f;
+
+  for(int& a: altitudes)
+    a = 0;
+  int maximum_altitude = 0, minimum_altitude = 0;
+
+  for(int i=0; i<num_iterations; i++){
+    const int random_index = random.randn(0, n);
+    const bool up = random.randn(0, 1) != 0;
+    for(int j=0; j<indices_to_move; j++){
+      int& a = altitudes[(random_index + j)%n];
+      if(up){
+        a += height_step;
+        maximum_altitude = max(maximum_altitude, a);
+      } //if
+      else{
+        a -= height_step;
+        minimum_altitude = min(minimum_altitude, a);
+      } //else
+    } //for
+  } //for
+
+  for(int& a: altitudes)
+    a = (int)(a*tallest_mountain_altitude/((float)maximum_altitude - minimum_altitude)) + radius;
+} //generate_noise_planetary_method_walk
+
+/// Make the planets of the Solar System level, and of five random maps
+/// with 5 planets of radius 500 to 1500, which is the most that a random
+/// map gets. Report how long that takes on one thread and on the worker
+/// pool, and how long the old generator, which walks along every run of
+/// altitudes, takes to make just the altitudes of the same planets. The
+/// terrain made on the worker pool is compared with the terrain made on
+/// one thread, which it should always match, since every planet has its
+/// own seed.
+
+void CBenchmark::level_load(){
+  const int reps = 10;
+  const unsigned old_threads = m_pObjectManager->get_threads();
+
+  m_vWorldSize = Vector2(25000, 25000);
+  const Vector2 center = m_vWorldSize/2;
+
+  std::vector<std::pair<std::string, std::vector<CPlanetDesc>>> maps;
+
+  //the Solar System level, read the way LoadMap reads it
+  std::ifstream infile("Levels\\Stage 2\\Solar System.txt");
+  std::vector<CPlanetDesc> solar_system;
+  std::string line;
+  while(std::getline(infile, line))
+    if(line.substr(0, 6) == "PLANET"){
+      std::istringstream iss(line);
+      std::string s;
+      int x, y;
+      float mass, radius;
+      if(iss >> s >> x >> y >> mass >> radius){
+        CPlanetDesc desc;
+        desc.m_vPos = Vector2((float)x, (float)y);
+        desc.m_fMass = mass;
+        desc.m_nRadius = (int)radius;
+        solar_system.push_back(desc);
+      } //if
+    } //if
+  if(solar_system.empty())report("level_load: can't read the Solar System level");
+  else maps.push_back(std::make_pair(std::string("Solar System"), solar_system));
+
+  m_pRandom->srand(24680);
+  for(int m=0; m<5; m++){
+    std::vector<CPlanetDesc> random_map(5);
+    for(int i=0; i<5; i++){
+      random_map[i].m_nRadius = m_pRandom->randn(500, 1500);
+      random_map[i].m_vPos = center + Vector2(4000.0f*(i - 2), 0.0f);
+      random_map[i].m_fMass = powf((float)random_map[i].m_nRadius, 3.f)*100.f/powf(900.f, 3.f);
+    } //for
+    maps.push_back(std::make_pair("random " + to_string(m + 1), random_map));
+  } //for
+
+  report("level load: map, planets, altitudes, old generator ms, one thread ms, worker pool ms, threads, speedup, same terrain");
+
+  for(auto& map: maps){
+    const std::vector<CPlanetDesc>& descs = map.second;
+    std::vector<CPlanetObject*> planets;
+    long long checksum[2] = {0, 0};
+    double t[2] = {0, 0};
+
+    for(int k=0; k<2; k++){
+      m_pObjectManager->set_threads(k == 0? 1: old_threads);
+
+      for(int r=0; r<reps; r++){
+        m_pObjectManager->clear(); //get rid of the last lot
+        m_pRandom->srand(13579); //the same seeds every time
+        start_timer();
+        m_pObjectManager->create_planets(descs, planets);
+        t[k] += stop_timer();
+      } //for
+
+      for(CPlanetObject* planet: planets)
+        for(int i=0; i<planet->get_number_of_altitudes(); i++)
+          checksum[k] = 31*checksum[k] + planet->get_altitude_at_index(i);
+    } //for
+
+    int altitudes = 0;
+    for(CPlanetObject* planet: planets)
+      altitudes += planet->get_number_of_altitudes();
+
+    //the old generator, on the same planets, one after the other
+    std::vector<int> walked;
+    start_timer();
+    for(int r=0; r<reps; r++)
+      for(CPlanetObject* planet: planets){
+        walked.resize(planet->get_number_of_altitudes());
+        generate_noise_planetary_method_walk(*m_pRandom, planet->get_radius(), walked, 2000, 2);
+      } //for
+    const double t_walk = stop_timer();
+    m_fSink = (float)walked[0];
+
+    report(map.first + ", " + to_string(descs.size()) + ", " + to_string(altitudes) + ", " +
+      to_string(1000.0*t_walk/reps) + ", " + to_string(1000.0*t[0]/reps) + ", " + to_string(1000.0*t[1]/reps) + ", " +
+      to_string(old_threads) + ", " + to_string(t[0]/t[1]) + ", " + (checksum[0] == checksum[1]? "yes": "NO"));
+  } //for
+
+  m_pObjectManager->clear();
+  m_pObjectManager->set_threads(old_threads);
+} //level_load
+
+/// Take a snapshot of a planet of radius 500 and 3000, make 1, 10 or 100
+/// craters of radius 50, and take another. Report how many chunks the
+/// second snapshot had to copy, what it cost, and what putting the
+/// terrain back to the first snapshot cost, against copying all of the
+/// altitudes out and back in, which is what keeping a plain copy would
+/// cost. Then check that every altitude came back, and that the planet
+/// shares every chunk with the first snapshot again.
+
+void CBenchmark::terrain_snapshots(){
+  const int reps = 100;
+  const int planet_radii[] = {500, 3000};
+  const int crater_counts[] = {1, 10, 100};
+
+  m_vWorldSize = Vector2(15000, 15000);
+  const Vector2 center = m_vWorldSize/2;
+
+  report("terrain snapshots: planet radius, craters, chunks, chunks copied, snapshot us, restore us, plain copy us, restored");
+
+  for(int planet_radius: planet_radii)
+    for(int craters: crater_counts){
+      m_pObjectManager->clear(); //get rid of the last lot
+      m_pRandom->srand(86420);
+      CPlanetObject* planet = m_pObjectManager->create_planet(center, 100, planet_radius);
+      const int n = planet->get_number_of_altitudes();
+
+      std::vector<BoundingSphere> blasts(craters);
+      for(BoundingSphere& blast: blasts){
+        blast.Center = (Vector3)(planet->GetPos() + (float)planet_radius*m_pRandom->randv());
+        blast.Radius = 50.0f;
+      } //for
+
+      std::vector<int> before(n);
+      for(int i=0; i<n; i++)
+        before[i] = planet->get_altitude_at_index(i);
+
+      double t_snapshot = 0, t_restore = 0;
+      int copied = 0;
+      bool restored = true;
+
+      for(int r=0; r<reps; r++){
+        const CTerrainSnapshot original = planet->get_terrain_snapshot();
+        for(BoundingSphere& blast: blasts)
+          planet->destroy_terrain(blast);
+
+        start_timer();
+        const CTerrainSnapshot cratered = planet->get_terrain_snapshot();
+        t_snapshot += stop_timer();
+
+        copied = 0;
+        for(int c=0; c<cratered.get_chunk_count(); c++)
+          if(!cratered.same_chunk(original, c))copied++;
+
+        start_timer();
+        planet->restore_terrain(original);
+        t_restore += stop_timer();
+
+        for(int i=0; i<n; i++)
+          restored = restored && planet->get_altitude_at_index(i) == before[i];
+        for(int c=0; c<original.get_chunk_count(); c++)
+          restored = restored && planet->get_terrain_snapshot().same_chunk(original, c);
+      } //for
+
+      //a plain copy of the altitudes, out and back in
+      std::vector<int> copy(n);
+      int sink = 0;
+      start_timer();
+      for(int r=0; r<reps; r++){
+        for(int i=0; i<n; i++)
+          copy[i] = planet->get_altitude_at_index(i);
+        sink += copy[r%n];
+      } //for
+      const double t_copy = 2*stop_timer(); //out and back in
+      m_fSink = (float)sink;
+
+      report(to_string(planet_radius) + ", " + to_string(craters) + ", " +
+        to_string(planet->get_terrain_snapshot().get_chunk_count()) + ", " + to_string(copied) + ", " +
+        to_string(1e6*t_snapshot/reps) + ", " + to_string(1e6*t_restore/reps) + ", " + to_string(1e6*t_copy/reps) + ", " +
+        (restored? "yes": "NO"));
+    } //for
+} //terrain_snapshots
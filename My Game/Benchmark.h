@@ -0,0 +1,61 @@
+/// \file Benchmark.h
+/// \brief Interface for the benchmark class CBenchmark.
+
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <chrono>
+
+#include "Component.h"
+#include "Common.h"
+
+/// \brief The benchmarks.
+///
+/// Headless timing runs for the physics code. Nothing is drawn while they
+/// run. Press F6 in a level with the debug text turned on (F2) to run them.
+/// Results go to the debug output and are appended to bench_output.txt in
+/// the working directory. Benchmarks that need a scene build their own, so
+/// the level is restarted afterwards.
+
+class CBenchmark:
+  public CComponent,
+  public CCommon{
+
+  private:
+    std::ofstream m_fOut; ///< Results file.
+    std::chrono::steady_clock::time_point m_tStart; ///< Start of the current timing.
+    volatile float m_fSink = 0; ///< Results of timed loops get written here so that the optimizer can't throw the loops away.
+
+    void report(const std::string& line); ///< Write a line of results.
+    void start_timer(); ///< Start timing.
+    double stop_timer(); ///< Stop timing. \return Seconds since start_timer.
+
+    void gravity_kernel(); ///< Per-call cost of the gravity field for 1 to 64 bodies.
+    void barnes_hut(); ///< Speed and accuracy of the Barnes-Hut quadtree against the direct sum.
+    void gravity_grid(); ///< Build time, memory and accuracy of the gravity grid, and phantom bullet throughput with and without it.
+    void integrators(); ///< Energy drift and cost per step of each integrator.
+    void substeps(); ///< Steps taken and trajectory error with and without adaptive sub-stepping.
+    void conics(); ///< Cost and drift of a long orbit, and phantom bullet cost, with and without Kepler orbits.
+    void early_termination(); ///< Phantom bullet cost and steps saved with and without early termination.
+    void determinism(); ///< State hashes of a scripted battle, to compare between builds.
+    void large_world(); ///< Cost and drift of orbits far from the origin with positions in single and double precision.
+    void threads(); ///< Cost of moving 64 to 1024 projectiles on 1 to 16 threads.
+    void broadphase(); ///< Narrow phase tests and cost of the broad phase for 10 to 5000 objects, with and without the spatial hash.
+    void collision_layers(); ///< Narrow phase tests made and skipped for each pair of collision layers.
+    void polar_intersects(); ///< Agreement and cost of the polar planet test against the old triangle test.
+    void sector_levels(); ///< How many terrain queries each level of the sector hierarchy settles.
+    void planet_batches(); ///< Cost of sweeping bullets against a planet in one batch against one at a time.
+    void surface_index(); ///< Cost of the tank and planet queries and of an AI turn, with and without the surface index.
+    void moving_planets(); ///< Cost of a frame with 2 to 50 planets orbiting each other, and how well their energy is kept.
+    void terrain_resolution(); ///< Memory and query cost of the terrain for planets of different sizes, using the altitude pyramid.
+    void dirty_spans(); ///< Cost of keeping a cache of the terrain up to date from the dirty spans against rebuilding it.
+    void blast_kernels(); ///< Cost of craters and dirt from small to BULLET11 sized blasts, closed form against ray casts, and whether the altitude bounds hold.
+    void level_load(); ///< Time to make the planets of the Solar System level and of random maps, on one thread and on the worker pool, against the old generator.
+    void terrain_snapshots(); ///< Cost of taking and restoring terrain snapshots after a few craters, against copying all of the altitudes, and whether restoring gets them back.
+
+  public:
+    CBenchmark(); ///< Constructor.
+
+    void run(); ///< Run all of the benchmarks.
+}; //CBenchmark
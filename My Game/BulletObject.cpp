@@ -6,6 +6,7 @@
 
 CBulletObject::CBulletObject(eSpriteType t, const Vector2& p) : CObject(t, p) {
     is_bullet = true;
+    SetCollisionLayer(BULLET_LAYER);
     affected_by_gravity = true; // For our purposes, all bullets should be affected by gravity.
     time_created = m_pStepTimer->GetTotalSeconds();
 
@@ -90,11 +91,16 @@ CBulletObject::CBulletObject(eSpriteType t, const Vector2& p, XMFLOAT4 trail_col
     smoke_color = trail_color;
 }
 
-void CBulletObject::move() {
+/// Do everything that has to happen before the bullet moves, which is
+/// everything that can create, kill or explode something, since that
+/// mustn't happen on a worker thread.
+/// \return false if the bullet has expired and isn't to move.
+
+bool CBulletObject::BeginMove() {
     //check if the time is past the ttl
     if (m_pStepTimer->GetTotalSeconds() - time_created >= time_to_live && time_to_live != -1.0f) {
         CBulletObject::kill();
-        return;
+        return false;
     }
 
     //do special stuff on move
@@ -133,11 +139,16 @@ void CBulletObject::move() {
             break;
     }
 
-    CObject::move();
+    return true;
+} //BeginMove
+
+/// Do everything that has to happen after the bullet moves.
+
+void CBulletObject::EndMove() {
     m_fRoll = (float)atan2(m_vVelocity.y, m_vVelocity.x);
     if (!is_phantom)
         EmitSmoke();
-}
+} //EndMove
 
 /// <summary>
 /// Kills the bullet like a normal object, but additionally damages any players in the explosion radius.
@@ -194,7 +205,19 @@ void CBulletObject::Explode(){
 /// </summary>
 /// <param name="planet">pointer to the planet whose terrain we need to affect. </param>
 void CBulletObject::kill(CPlanetObject* planet) {
-    //TODO: Implemenet terrain damage. I'm not sure where to start.
+    carve(planet);
+    CBulletObject::OnPlanetHit(planet);
+
+    //Normal bullet kill
+    CBulletObject::kill();
+}
+
+/// <summary>
+/// Does whatever terrain damage the bullet does to a planet where it is, defined by the bullet type. Split out of
+/// kill(CPlanetObject*) so that the collision queue can make all of the edits to a planet before anything else happens.
+/// </summary>
+/// <param name="planet">pointer to the planet whose terrain we need to affect. </param>
+void CBulletObject::carve(CPlanetObject* planet) {
     //Do whatever terrain damage that needs to happen, defined by the bullet type.
 
     BoundingSphere sphere;
@@ -225,11 +248,6 @@ void CBulletObject::kill(CPlanetObject* planet) {
     default:
         break;
     }
-
-    CBulletObject::OnPlanetHit(planet);
-
-    //Normal bullet kill
-    CBulletObject::kill();
 }
 
 /// <summary>
@@ -271,17 +289,15 @@ void CBulletObject::OnPlanetHit(CPlanetObject* planet) {
     switch (m_nSpriteIndex) {
         case BULLET7_SPRITE: {
             if (bounces < 2) { //can bounce only 2 times
-                //bounce along the surface of the planet
-                Vector2 planetPos = planet->GetPos(); //position of planet
-                Vector2 bulletPos = GetPos(); //position of bullet
+                //bounce off the surface of the planet, using the slope of the ground where it hit
                 Vector2 bulletVel = GetVelocity(); //velocity of bullet
 
-                Vector2 normalV = planetPos - bulletPos; //nomral vector of the surface
-                normalV.Normalize();
+                Vector2 normalV; //outward normal vector of the surface
+                planet->get_signed_distance(GetPos(), normalV);
 
-                CBulletObject* pBullet = m_pObjectManager->create_bullet(BULLET7_SPRITE, Vector2(m_vPos.x + (-normalV.x * 10), m_vPos.y + (-normalV.y * 10)), smoke_color); //create bullet
+                CBulletObject* pBullet = m_pObjectManager->create_bullet(BULLET7_SPRITE, m_vPos + normalV * 10, smoke_color); //create bullet
                 pBullet->SetOwner(owner);
-                pBullet->SetVelocity(-(2 * (normalV * bulletVel) * normalV - bulletVel)); //set correct velocity
+                pBullet->SetVelocity(bulletVel - 2 * bulletVel.Dot(normalV) * normalV); //set correct velocity
                 pBullet->bounces = this->bounces + 1;
             }
         }
@@ -27,9 +27,11 @@ public:
   CBulletObject(eSpriteType t, const Vector2& p, XMFLOAT4 trail_color);
 
   int GetDamage() { return damage; };
-  void move(); ///< Move the bullet object
+  bool BeginMove(); ///< Expire, or do whatever this kind of bullet does in flight. Returns false if it expired.
+  void EndMove(); ///< Point along the velocity and leave a trail of smoke.
   void kill(); ///< Kill the object like default, but additionally damage all players in the explosion radius.
   void kill(CPlanetObject* planet); ///< Kill the object like default, but additionally do whatever it needs to do to the planet terrain.
+  void carve(CPlanetObject* planet); ///< Do whatever the bullet does to the planet terrain where it is, without killing it.
   void OnDeath(); ///< Do some action on bullet death, depending on the sprite
   void OnPlanetHit(CPlanetObject* planet); ///< Do some action on planet collision, depeneding on the sprite
 
@@ -38,7 +40,8 @@ public:
   void SetOwner(CTankObject* owner) { this->owner = owner; }
   CTankObject* GetOwner() { return owner; };
 
-  void set_is_phantom(bool phantom) { is_phantom = phantom; };
+  void set_is_phantom(bool phantom) { is_phantom = phantom; SetCollisionLayer(phantom? PHANTOM_LAYER: BULLET_LAYER); };
   bool get_is_phantom() { return is_phantom; };
+  float get_time_to_live() { return time_to_live; }; ///< Seconds the bullet lives for, or -1 if it lives until it hits something.
 };
 
@@ -0,0 +1,197 @@
+/// \file ConicOrbit.cpp
+/// \brief Code for the Kepler orbit class CConicOrbit.
+
+#include "ConicOrbit.h"
+
+#include <limits>
+
+/// Stumpff function C(z), which is (1 - cos sqrt(z))/z, continued to
+/// negative z through cosh.
+/// \param z Argument.
+/// \return C(z).
+
+static double stumpff_c(double z){
+  if(z > 1.0e-6){
+    const double s = sqrt(z);
+    return (1.0 - cos(s))/z;
+  } //if
+  else if(z < -1.0e-6){
+    const double s = sqrt(-z);
+    return (cosh(s) - 1.0)/(-z);
+  } //else if
+  return 0.5 - z/24.0; //series
+} //stumpff_c
+
+/// Stumpff function S(z), which is (sqrt(z) - sin sqrt(z))/sqrt(z)^3,
+/// continued to negative z through sinh.
+/// \param z Argument.
+/// \return S(z).
+
+static double stumpff_s(double z){
+  if(z > 1.0e-6){
+    const double s = sqrt(z);
+    return (s - sin(s))/(s*s*s);
+  } //if
+  else if(z < -1.0e-6){
+    const double s = sqrt(-z);
+    return (sinh(s) - s)/(s*s*s);
+  } //else if
+  return 1.0/6.0 - z/120.0; //series
+} //stumpff_s
+
+/// Work out the orbital elements from a position and velocity.
+/// \param position Position relative to the planet.
+/// \param velocity Velocity relative to the planet.
+/// \param mu Gravitational constant times the mass of the planet.
+
+CConicOrbit::CConicOrbit(const Vector2& position, const Vector2& velocity, double mu):
+  m_dMu(mu), m_dX(position.x), m_dY(position.y), m_dVX(velocity.x), m_dVY(velocity.y)
+{
+  const double r = sqrt(m_dX*m_dX + m_dY*m_dY);
+  const double v2 = m_dVX*m_dVX + m_dVY*m_dVY;
+  const double rv = m_dX*m_dVX + m_dY*m_dVY;
+
+  m_dEnergy = v2/2 - mu/r;
+  m_dMomentum = m_dX*m_dVY - m_dY*m_dVX;
+  m_dEX = ((v2 - mu/r)*m_dX - rv*m_dVX)/mu;
+  m_dEY = ((v2 - mu/r)*m_dY - rv*m_dVY)/mu;
+  m_dE = sqrt(m_dEX*m_dEX + m_dEY*m_dEY);
+  m_dP = m_dMomentum*m_dMomentum/mu;
+} //constructor
+
+/// Furthest distance from the planet.
+/// \return The apoapsis, or infinity if the orbit is not bound.
+
+double CConicOrbit::apoapsis() const{
+  if(!is_bound())return std::numeric_limits<double>::infinity();
+  return m_dP/(1 - m_dE);
+} //apoapsis
+
+/// Orbital period.
+/// \return The period, or infinity if the orbit is not bound.
+
+double CConicOrbit::period() const{
+  if(!is_bound())return std::numeric_limits<double>::infinity();
+  const double a = -m_dMu/(2*m_dEnergy);
+  return 2*XM_PI*sqrt(a*a*a/m_dMu);
+} //period
+
+/// Angle from periapsis to the current position, measured in the
+/// direction of motion. For a circular orbit there is no periapsis,
+/// so the angle is measured from the x axis instead.
+/// \return The true anomaly in radians, from -pi to pi.
+
+double CConicOrbit::true_anomaly() const{
+  const double sign = m_dMomentum < 0? -1.0: 1.0;
+
+  if(m_dE < 1.0e-9)
+    return sign*atan2(m_dY, m_dX);
+
+  const double c = m_dEX*m_dX + m_dEY*m_dY;
+  const double s = sign*(m_dEX*m_dY - m_dEY*m_dX);
+  return atan2(s, c);
+} //true_anomaly
+
+/// Time of flight from periapsis to a true anomaly, negative before
+/// periapsis. For an ellipse this is within half a period of periapsis.
+/// \param nu True anomaly in radians, from -pi to pi.
+/// \return Time from periapsis.
+
+double CConicOrbit::time_from_periapsis(double nu) const{
+  const double e = m_dE;
+
+  if(e < 1.0 - 1.0e-9){ //ellipse
+    const double a = m_dP/(1 - e*e);
+    const double E = 2*atan(sqrt((1 - e)/(1 + e))*tan(nu/2));
+    return (E - e*sin(E))/sqrt(m_dMu/(a*a*a));
+  } //if
+
+  else if(e > 1.0 + 1.0e-9){ //hyperbola
+    const double a = m_dP/(e*e - 1);
+    const double F = 2*atanh(sqrt((e - 1)/(e + 1))*tan(nu/2));
+    return (e*sinh(F) - F)/sqrt(m_dMu/(a*a*a));
+  } //else if
+
+  else{ //parabola
+    const double D = tan(nu/2);
+    return 0.5*sqrt(m_dP*m_dP*m_dP/m_dMu)*(D + D*D*D/3);
+  } //else
+} //time_from_periapsis
+
+/// Work out the position and velocity some time later by solving
+/// Kepler's equation in universal variables with Newton's method, then
+/// applying the Lagrange coefficients.
+/// \param dt Time to propagate by.
+/// \param position [out] Position relative to the planet.
+/// \param velocity [out] Velocity relative to the planet.
+/// \return true if Newton's method converged, false if the caller should fall back to numerical integration.
+
+bool CConicOrbit::propagate(double dt, Vector2& position, Vector2& velocity) const{
+  const double mu = m_dMu;
+  const double root_mu = sqrt(mu);
+  const double r0 = sqrt(m_dX*m_dX + m_dY*m_dY);
+  const double vr0 = (m_dX*m_dVX + m_dY*m_dVY)/r0;
+  const double alpha = -2*m_dEnergy/mu; //reciprocal of the semimajor axis
+
+  //solve for the universal anomaly
+  double chi = root_mu*fabs(alpha)*dt;
+  bool converged = false;
+
+  for(int i=0; i<50 && !converged; i++){
+    const double chi2 = chi*chi;
+    const double z = alpha*chi2;
+    const double C = stumpff_c(z);
+    const double S = stumpff_s(z);
+    const double F = r0*vr0/root_mu*chi2*C + (1 - alpha*r0)*chi2*chi*S + r0*chi - root_mu*dt;
+    const double dF = r0*vr0/root_mu*chi*(1 - z*S) + (1 - alpha*r0)*chi2*C + r0;
+    const double step = F/dF;
+    chi -= step;
+    converged = fabs(step) <= 1.0e-10*max(1.0, fabs(chi));
+  } //for
+
+  if(!converged || !isfinite(chi))
+    return false;
+
+  //Lagrange coefficients
+  const double chi2 = chi*chi;
+  const double z = alpha*chi2;
+  const double C = stumpff_c(z);
+  const double S = stumpff_s(z);
+
+  const double f = 1 - chi2/r0*C;
+  const double g = dt - chi2*chi*S/root_mu;
+  const double x = f*m_dX + g*m_dVX;
+  const double y = f*m_dY + g*m_dVY;
+  const double r = sqrt(x*x + y*y);
+  const double df = root_mu/(r*r0)*(z*S - 1)*chi;
+  const double dg = 1 - chi2/r*C;
+
+  position = Vector2((float)x, (float)y);
+  velocity = Vector2((float)(df*m_dX + dg*m_dVX), (float)(df*m_dY + dg*m_dVY));
+  return true;
+} //propagate
+
+/// Time until the orbit next comes down through a given radius on its
+/// way in towards periapsis.
+/// \param radius The radius.
+/// \param t [out] The time until then.
+/// \return true if the orbit ever comes down through that radius again, false if it doesn't.
+
+bool CConicOrbit::time_to_radius(double radius, double& t) const{
+  if(m_dE < 1.0e-9) //circular, so the radius never changes
+    return false;
+
+  const double c = (m_dP/radius - 1)/m_dE; //cosine of the true anomaly at that radius
+  if(c < -1 || c > 1) //inside periapsis or outside apoapsis
+    return false;
+
+  const double nu = -acos(c); //on the way in
+  t = time_from_periapsis(nu) - time_from_periapsis(true_anomaly());
+
+  if(t < 0){ //already past it
+    if(!is_bound())return false; //and never coming back
+    t += period();
+  } //if
+
+  return true;
+} //time_to_radius
@@ -0,0 +1,49 @@
+/// \file ConicOrbit.h
+/// \brief Interface for the Kepler orbit class CConicOrbit.
+
+#pragma once
+
+#include "Defines.h"
+
+/// \brief A Kepler orbit about a single point mass.
+///
+/// When one planet's gravity swamps everything else, a projectile follows
+/// a conic section (an ellipse or a hyperbola) around it, and where it is
+/// at any time can be worked out in closed form instead of being stepped
+/// there. CConicOrbit is built from a position and velocity relative to
+/// the planet, and can propagate them forward by any amount of time using
+/// universal variables, which handle ellipses and hyperbolas alike. All of
+/// the arithmetic is in double precision, so propagating doesn't drift.
+
+class CConicOrbit{
+  private:
+    double m_dMu = 0; ///< Gravitational constant times the mass of the planet.
+    double m_dX = 0; ///< x coordinate of the position relative to the planet.
+    double m_dY = 0; ///< y coordinate of the position relative to the planet.
+    double m_dVX = 0; ///< x component of the velocity.
+    double m_dVY = 0; ///< y component of the velocity.
+
+    double m_dEnergy = 0; ///< Specific orbital energy.
+    double m_dMomentum = 0; ///< Specific angular momentum. Positive for counterclockwise orbits.
+    double m_dEX = 0; ///< x component of the eccentricity vector, which points at periapsis.
+    double m_dEY = 0; ///< y component of the eccentricity vector.
+    double m_dE = 0; ///< Eccentricity.
+    double m_dP = 0; ///< Semi-latus rectum.
+
+    double true_anomaly() const; ///< Angle from periapsis to the current position.
+    double time_from_periapsis(double nu) const; ///< Time of flight from periapsis to a true anomaly.
+
+  public:
+    CConicOrbit(const Vector2& position, const Vector2& velocity, double mu); ///< Constructor.
+
+    bool propagate(double dt, Vector2& position, Vector2& velocity) const; ///< Position and velocity after some time.
+    bool time_to_radius(double radius, double& t) const; ///< Time until the orbit next comes down to a radius.
+
+    bool is_bound() const { return m_dEnergy < 0; }; ///< Whether the orbit is an ellipse.
+    double periapsis() const { return m_dP/(1 + m_dE); }; ///< Closest approach to the planet.
+    double apoapsis() const; ///< Furthest distance from the planet, or infinity if not bound.
+    double energy() const { return m_dEnergy; }; ///< Specific orbital energy.
+    double momentum() const { return m_dMomentum; }; ///< Specific angular momentum.
+    double eccentricity() const { return m_dE; }; ///< Eccentricity.
+    double period() const; ///< Orbital period, or infinity if not bound.
+}; //CConicOrbit
@@ -0,0 +1,293 @@
+/// \file Deterministic.cpp
+/// \brief Code for the math functions of the deterministic physics mode.
+///
+/// Everything is worked out in double precision using only addition,
+/// subtraction, multiplication, division and square root, in an order that
+/// the compiler isn't allowed to change, and rounded to float at the end.
+/// The polynomials are truncated Taylor series, which are more than
+/// accurate enough once the argument has been reduced. Speed is not the
+/// point here.
+
+#include "Deterministic.h"
+
+#include <cfloat>
+
+#ifdef DETERMINISTIC_PHYSICS
+
+static const double HALF_PI_HI = 1.57079632673412561417e+00; ///< First 33 bits of pi/2.
+static const double HALF_PI_LO = 6.07710050650619224932e-11; ///< pi/2 minus HALF_PI_HI.
+static const double HALF_PI = 1.57079632679489655800e+00; ///< pi/2.
+static const double QUARTER_PI = 7.85398163397448278999e-01; ///< pi/4.
+static const double LN2_HI = 6.93147180369123816490e-01; ///< First 32 bits of log 2.
+static const double LN2_LO = 1.90821492927058770002e-10; ///< log 2 minus LN2_HI.
+static const double TAN_EIGHTH_PI = 4.14213562373095145475e-01; ///< tan(pi/8).
+
+/// Round to the nearest integer, halves away from zero, without the C runtime.
+/// \param x A number small enough to fit in an int.
+/// \return The nearest integer.
+
+static int nearest(double x){
+  return x < 0? -(int)(0.5 - x): (int)(x + 0.5);
+} //nearest
+
+/// Sine for arguments between -pi/4 and pi/4.
+/// \param x The argument.
+/// \return sin(x).
+
+static double sin_kernel(double x){
+  const double x2 = x*x;
+  double s = 1.0/6227020800.0; //1/13!
+  s = s*x2 - 1.0/39916800.0;
+  s = s*x2 + 1.0/362880.0;
+  s = s*x2 - 1.0/5040.0;
+  s = s*x2 + 1.0/120.0;
+  s = s*x2 - 1.0/6.0;
+  return x + x*x2*s;
+} //sin_kernel
+
+/// Cosine for arguments between -pi/4 and pi/4.
+/// \param x The argument.
+/// \return cos(x).
+
+static double cos_kernel(double x){
+  const double x2 = x*x;
+  double c = 1.0/87178291200.0; //1/14!
+  c = c*x2 - 1.0/479001600.0;
+  c = c*x2 + 1.0/3628800.0;
+  c = c*x2 - 1.0/40320.0;
+  c = c*x2 + 1.0/720.0;
+  c = c*x2 - 1.0/24.0;
+  c = c*x2 + 0.5;
+  return 1.0 - x2*c;
+} //cos_kernel
+
+/// Reduce an angle to between -pi/4 and pi/4 by taking off a whole
+/// number of quarter turns.
+/// \param x The angle.
+/// \param quadrant [out] Number of quarter turns taken off, modulo 4.
+/// \return What's left.
+
+static double reduce(double x, int& quadrant){
+  const int k = nearest(x/HALF_PI);
+  quadrant = k & 3;
+  return (x - k*HALF_PI_HI) - k*HALF_PI_LO;
+} //reduce
+
+/// Arc tangent for arguments between 0 and 1.
+/// \param x The argument.
+/// \return atan(x).
+
+static double atan_kernel(double x){
+  double offset = 0;
+  if(x > TAN_EIGHTH_PI){ //atan(x) = pi/4 + atan((x - 1)/(x + 1))
+    x = (x - 1.0)/(x + 1.0);
+    offset = QUARTER_PI;
+  } //if
+
+  //now |x| <= tan(pi/8), where 25 terms of the series are plenty
+  const double x2 = x*x;
+  double s = 0;
+  for(int n=24; n>=1; n--)
+    s = (n & 1? -1.0: 1.0)/(2*n + 1) + x2*s;
+  return offset + (x + x*x2*s);
+} //atan_kernel
+
+/// Arc tangent of y/x in double precision.
+/// \param y Numerator.
+/// \param x Denominator.
+/// \return The angle from the positive x axis to (x, y), between -pi and pi.
+
+static double atan2_double(double y, double x){
+  const double ax = x < 0? -x: x;
+  const double ay = y < 0? -y: y;
+  if(ax == 0 && ay == 0)return 0;
+
+  double a = ay <= ax? atan_kernel(ay/ax): HALF_PI - atan_kernel(ax/ay);
+  if(x < 0)a = 2.0*HALF_PI - a;
+  return y < 0? -a: a;
+} //atan2_double
+
+/// Sine.
+/// \param x Angle in radians.
+/// \return sin(x).
+
+float det_sin(float x){
+  int q;
+  const double r = reduce(x, q);
+  switch(q){
+    case 0: return (float)sin_kernel(r);
+    case 1: return (float)cos_kernel(r);
+    case 2: return (float)-sin_kernel(r);
+    default: return (float)-cos_kernel(r);
+  } //switch
+} //det_sin
+
+/// Cosine.
+/// \param x Angle in radians.
+/// \return cos(x).
+
+float det_cos(float x){
+  int q;
+  const double r = reduce(x, q);
+  switch(q){
+    case 0: return (float)cos_kernel(r);
+    case 1: return (float)-sin_kernel(r);
+    case 2: return (float)-cos_kernel(r);
+    default: return (float)sin_kernel(r);
+  } //switch
+} //det_cos
+
+/// Arc tangent of y/x, in the right quadrant.
+/// \param y Numerator.
+/// \param x Denominator.
+/// \return The angle from the positive x axis to (x, y), between -pi and pi.
+
+float det_atan2(float y, float x){
+  return (float)atan2_double(y, x);
+} //det_atan2
+
+/// Arc sine.
+/// \param x The argument, between -1 and 1.
+/// \return asin(x), between -pi/2 and pi/2.
+
+float det_asin(float x){
+  const double d = x;
+  return (float)atan2_double(d, sqrt((1.0 - d)*(1.0 + d)));
+} //det_asin
+
+/// Exponential.
+/// \param x The argument.
+/// \return e to the power x.
+
+float det_exp(float x){
+  if(x > 88.8f)return FLT_MAX;
+  if(x < -103.9f)return 0;
+
+  //e^x = 2^k e^r with |r| <= log(2)/2
+  const int k = nearest(x/(LN2_HI + LN2_LO));
+  const double r = (x - k*LN2_HI) - k*LN2_LO;
+
+  double term = 1;
+  double sum = 1;
+  for(int n=1; n<=13; n++){
+    term = term*r/n;
+    sum += term;
+  } //for
+
+  //multiply by 2^k a halving or doubling at a time, which is exact
+  double scale = 1;
+  for(int i=0; i<k; i++)scale *= 2.0;
+  for(int i=0; i>k; i--)scale *= 0.5;
+  return (float)(sum*scale);
+} //det_exp
+
+/// Length of a vector.
+/// \param v The vector.
+/// \return Its length.
+
+float det_length(const Vector2& v){
+  return sqrtf(v.x*v.x + v.y*v.y);
+} //det_length
+
+/// Dot product.
+/// \param u A vector.
+/// \param v Another vector.
+/// \return u dot v.
+
+float det_dot(const Vector2& u, const Vector2& v){
+  return u.x*v.x + u.y*v.y;
+} //det_dot
+
+/// Make a vector unit length. The zero vector is left alone.
+/// \param v [in, out] The vector.
+
+void det_normalize(Vector2& v){
+  const float length = det_length(v);
+  if(length > 0){
+    v.x /= length;
+    v.y /= length;
+  } //if
+} //det_normalize
+
+/// Whether two circles overlap, including touching. Only x and y of the
+/// bounding spheres are used, since everything in the game is at z = 0.
+/// \param s0 A circle.
+/// \param s1 Another circle.
+/// \return true if they overlap.
+
+bool det_intersects(const BoundingSphere& s0, const BoundingSphere& s1){
+  const float dx = s1.Center.x - s0.Center.x;
+  const float dy = s1.Center.y - s0.Center.y;
+  const float r = s0.Radius + s1.Radius;
+  return dx*dx + dy*dy <= r*r;
+} //det_intersects
+
+/// Squared distance from a point to the nearest point on a line segment.
+/// \param p The point.
+/// \param a One end of the segment.
+/// \param b The other end of the segment.
+/// \return Squared distance.
+
+static float segment_distance_sq(const Vector2& p, const Vector2& a, const Vector2& b){
+  const float abx = b.x - a.x, aby = b.y - a.y;
+  const float apx = p.x - a.x, apy = p.y - a.y;
+  const float len2 = abx*abx + aby*aby;
+  float t = len2 > 0? (apx*abx + apy*aby)/len2: 0;
+  t = t < 0? 0: (t > 1? 1: t);
+  const float dx = apx - t*abx;
+  const float dy = apy - t*aby;
+  return dx*dx + dy*dy;
+} //segment_distance_sq
+
+/// Whether a circle and a triangle overlap. They do if the center of the
+/// circle is inside the triangle or close enough to one of its edges.
+/// \param s The circle.
+/// \param v0 A corner of the triangle.
+/// \param v1 Another corner of the triangle.
+/// \param v2 The last corner of the triangle.
+/// \return true if they overlap.
+
+bool det_intersects(const BoundingSphere& s, const Vector2& v0, const Vector2& v1, const Vector2& v2){
+  const Vector2 c(s.Center.x, s.Center.y);
+
+  //inside, whichever way round the corners go
+  const float d0 = (v1.x - v0.x)*(c.y - v0.y) - (v1.y - v0.y)*(c.x - v0.x);
+  const float d1 = (v2.x - v1.x)*(c.y - v1.y) - (v2.y - v1.y)*(c.x - v1.x);
+  const float d2 = (v0.x - v2.x)*(c.y - v2.y) - (v0.y - v2.y)*(c.x - v2.x);
+  if((d0 >= 0 && d1 >= 0 && d2 >= 0) || (d0 <= 0 && d1 <= 0 && d2 <= 0))
+    return true;
+
+  //close to an edge
+  const float r2 = s.Radius*s.Radius;
+  return segment_distance_sq(c, v0, v1) <= r2 || segment_distance_sq(c, v1, v2) <= r2 ||
+    segment_distance_sq(c, v2, v0) <= r2;
+} //det_intersects
+
+/// Whether a ray hits a circle, the same way BoundingSphere::Intersects
+/// does it: if the ray starts outside the circle the distance is to where
+/// it goes in, and if it starts inside it is to where it comes out.
+/// \param s The circle.
+/// \param origin Start of the ray.
+/// \param direction Direction of the ray, which must be unit length.
+/// \param dist [out] Distance along the ray to the intersection, or 0 if there is none.
+/// \return true if the ray hits the circle.
+
+bool det_intersects(const BoundingSphere& s, const Vector2& origin, const Vector2& direction, float& dist){
+  const float lx = s.Center.x - origin.x;
+  const float ly = s.Center.y - origin.y;
+  const float proj = lx*direction.x + ly*direction.y; //distance along the ray to the nearest point to the center
+  const float l2 = lx*lx + ly*ly;
+  const float r2 = s.Radius*s.Radius;
+  const float m2 = l2 - proj*proj; //squared distance from the center to the ray
+
+  if((proj < 0 && l2 > r2) || m2 > r2){ //pointing away from it, or passing it by
+    dist = 0;
+    return false;
+  } //if
+
+  const float q = sqrtf(r2 - m2);
+  dist = l2 <= r2? proj + q: proj - q;
+  return true;
+} //det_intersects
+
+#endif //DETERMINISTIC_PHYSICS
@@ -0,0 +1,71 @@
+/// \file Deterministic.h
+/// \brief Math functions for the deterministic physics mode.
+
+#pragma once
+
+#include "GameDefines.h"
+
+/// \brief Deterministic physics.
+///
+/// The physics has to come out bit-for-bit the same in every build for
+/// replays and lockstep multiplayer to work. Plain IEEE arithmetic and
+/// square roots are correctly rounded, so they already agree everywhere,
+/// as long as the compiler neither reorders them nor fuses a multiply and
+/// an add. What doesn't agree is everything else: the C runtime's sin,
+/// cos, atan2, asin and exp differ from one library to the next, and
+/// DirectXMath's lengths, dot products and bounding sphere tests differ
+/// depending on whether it was built for SSE2, SSE4, AVX2 or no
+/// intrinsics at all.
+///
+/// With DETERMINISTIC_PHYSICS defined, the functions declared here are
+/// written out in Deterministic.cpp using nothing but IEEE arithmetic in
+/// a fixed order, and the physics code calls them instead. Without it,
+/// they are thin inline wrappers around the usual functions, so the code
+/// that calls them is exactly as fast as it was. Include this header
+/// after everything else, since in the deterministic mode it also turns
+/// off floating point contractions for the rest of the file.
+
+#ifdef DETERMINISTIC_PHYSICS
+
+#if defined(_MSC_VER)
+  #pragma float_control(precise, on)
+  #pragma fp_contract(off)
+#endif
+
+float det_sin(float x); ///< Sine.
+float det_cos(float x); ///< Cosine.
+float det_atan2(float y, float x); ///< Arc tangent of y/x in the right quadrant.
+float det_asin(float x); ///< Arc sine.
+float det_exp(float x); ///< Exponential.
+float det_length(const Vector2& v); ///< Length of a vector.
+float det_dot(const Vector2& u, const Vector2& v); ///< Dot product.
+void det_normalize(Vector2& v); ///< Make a vector unit length.
+
+bool det_intersects(const BoundingSphere& s0, const BoundingSphere& s1); ///< Whether two circles overlap.
+bool det_intersects(const BoundingSphere& s, const Vector2& v0, const Vector2& v1, const Vector2& v2); ///< Whether a circle and a triangle overlap.
+bool det_intersects(const BoundingSphere& s, const Vector2& origin, const Vector2& direction, float& dist); ///< Whether a ray hits a circle.
+
+#else
+
+inline float det_sin(float x){ return sinf(x); };
+inline float det_cos(float x){ return cosf(x); };
+inline float det_atan2(float y, float x){ return atan2f(y, x); };
+inline float det_asin(float x){ return asinf(x); };
+inline float det_exp(float x){ return expf(x); };
+inline float det_length(const Vector2& v){ return v.Length(); };
+inline float det_dot(const Vector2& u, const Vector2& v){ return u.Dot(v); };
+inline void det_normalize(Vector2& v){ v.Normalize(); };
+
+inline bool det_intersects(const BoundingSphere& s0, const BoundingSphere& s1){
+  return s0.Intersects(s1);
+}; //det_intersects
+
+inline bool det_intersects(const BoundingSphere& s, const Vector2& v0, const Vector2& v1, const Vector2& v2){
+  return s.Intersects(v0, v1, v2);
+}; //det_intersects
+
+inline bool det_intersects(const BoundingSphere& s, const Vector2& origin, const Vector2& direction, float& dist){
+  return s.Intersects(origin, direction, dist);
+}; //det_intersects
+
+#endif //DETERMINISTIC_PHYSICS
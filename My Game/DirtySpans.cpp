@@ -0,0 +1,94 @@
+/// \file DirtySpans.cpp
+/// \brief Code for the dirty span log CDirtySpans.
+
+#include "DirtySpans.h"
+
+#include <algorithm>
+
+/// Mark every value as changed, and change the number of values. All of
+/// the spans are thrown away, and every consumer will be told to redo the
+/// lot the next time that it collects.
+/// \param size Number of values in the ring.
+
+void CDirtySpans::reset(int size){
+  m_nSize = size;
+  m_vSpans.clear();
+  m_nOldest = ++m_nVersion;
+} //reset
+
+/// Mark a span of values as changed, giving it the next version number.
+/// If there are too many spans, the oldest half are thrown away.
+/// \param first First value that changed. Can be negative; it wraps around.
+/// \param last Last value that changed, which may be past the end; it wraps around too.
+
+void CDirtySpans::add(int first, int last){
+  if(m_nSize <= 0 || last < first)return;
+
+  if(last - first + 1 >= m_nSize){ //the lot
+    first = 0;
+    last = m_nSize - 1;
+  } //if
+
+  else{
+    const int length = last - first;
+    first = (first%m_nSize + m_nSize)%m_nSize;
+    last = first + length;
+  } //else
+
+  if(m_vSpans.size() >= MAX_SPANS){
+    const size_t dropped = MAX_SPANS/2;
+    m_nOldest = m_vSpans[dropped - 1].m_nVersion + 1; //anyone before that has missed a span
+    m_vSpans.erase(m_vSpans.begin(), m_vSpans.begin() + dropped);
+  } //if
+
+  m_vSpans.push_back({++m_nVersion, first, last});
+} //add
+
+/// Find the values that changed since a version, as spans that are in
+/// order, don't wrap, and don't overlap or touch each other, and bring the
+/// version up to date. A consumer that is too far behind gets one span
+/// covering everything.
+/// \param version [in, out] Version that the consumer is up to. Set to the latest version.
+/// \param result [out] The spans, as the first and last value in each.
+/// \return true if anything changed since the version.
+
+bool CDirtySpans::collect(unsigned& version, std::vector<std::pair<int, int>>& result) const{
+  result.clear();
+  if(version == m_nVersion)return false; //up to date
+
+  if(version < m_nOldest){ //missed some
+    version = m_nVersion;
+    if(m_nSize > 0)result.push_back(std::make_pair(0, m_nSize - 1));
+    return !result.empty();
+  } //if
+
+  //the spans after the version, with the ones that go past the end split in two
+  size_t i = m_vSpans.size();
+  while(i > 0 && m_vSpans[i - 1].m_nVersion > version)
+    i--;
+
+  for(; i<m_vSpans.size(); i++){
+    const CSpan& span = m_vSpans[i];
+    if(span.m_nLast < m_nSize)result.push_back(std::make_pair(span.m_nFirst, span.m_nLast));
+    else{
+      result.push_back(std::make_pair(span.m_nFirst, m_nSize - 1));
+      result.push_back(std::make_pair(0, span.m_nLast - m_nSize));
+    } //else
+  } //for
+
+  version = m_nVersion;
+
+  //merge the ones that overlap or touch
+  std::sort(result.begin(), result.end());
+  size_t merged = 0;
+  for(size_t j=0; j<result.size(); j++){
+    if(merged > 0 && result[j].first <= result[merged - 1].second + 1){
+      if(result[j].second > result[merged - 1].second)
+        result[merged - 1].second = result[j].second;
+    } //if
+    else result[merged++] = result[j];
+  } //for
+
+  result.resize(merged);
+  return !result.empty();
+} //collect
@@ -0,0 +1,51 @@
+/// \file DirtySpans.h
+/// \brief Interface for the dirty span log CDirtySpans.
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+/// \brief A versioned log of which spans of a ring of values have changed.
+///
+/// A planet's altitudes go round in a ring, and each terrain edit changes
+/// a span of them. Every span that is added gets the next version number.
+/// Anything that keeps a cache built from the altitudes holds on to the
+/// version that its cache is up to, and asks for the spans added since,
+/// merged and unwrapped, so that it only has to redo the values that
+/// changed. Each consumer keeps its own version, so they can catch up at
+/// different times without getting in each other's way, and none of them
+/// has to clear anything for the others.
+///
+/// Only the last few hundred spans are kept. A consumer that is further
+/// behind than that, or one that has never caught up at all, is told that
+/// everything changed, which is what it would have to redo anyway. The same
+/// goes for everyone after a reset, which is for when all of the values
+/// change at once, such as a newly generated planet.
+
+class CDirtySpans{
+  private:
+    /// \brief A span of values that changed.
+
+    struct CSpan{
+      unsigned m_nVersion; ///< Version number that the change got.
+      int m_nFirst; ///< First value that changed, from 0 to one less than the size.
+      int m_nLast; ///< Last value that changed, which may be past the end if it wraps round.
+    }; //CSpan
+
+    static const size_t MAX_SPANS = 256; ///< Most spans kept before the oldest half are thrown away.
+
+    int m_nSize = 0; ///< Number of values in the ring.
+    unsigned m_nVersion = 0; ///< Version number of the latest change.
+    unsigned m_nOldest = 0; ///< Consumers at a version before this have missed changes and need everything.
+    std::vector<CSpan> m_vSpans; ///< The spans kept, oldest first.
+
+  public:
+    void reset(int size); ///< Mark everything as changed.
+    void add(int first, int last); ///< Mark a span as changed.
+    bool collect(unsigned& version, std::vector<std::pair<int, int>>& result) const; ///< Spans changed since a version.
+
+    unsigned get_version() const { return m_nVersion; }; ///< Version number of the latest change.
+    size_t get_span_count() const { return m_vSpans.size(); }; ///< Number of spans kept.
+}; //CDirtySpans
@@ -14,6 +14,7 @@
 #include "SmoothCamera.h"
 #include "LevelManager.h"
 #include "LevelEditor.h"
+#include "Benchmark.h"
 
 #include <conio.h>
 #include <Random.h>
@@ -81,6 +82,7 @@ void CGame::Release(){
 void CGame::CreateObjects(){
   m_pLevelManager->LoadMap(m_nCurrentLevel);
   //m_pLevelManager->LoadMap(0);
+  m_pObjectManager->build_gravity_grid(); //planets don't move, so the gravity field can be worked out once
 
   //Turns (based on tanks)
   if (m_eGameState == GameState::PLAYING) {
@@ -163,6 +165,18 @@ void CGame::KeyboardHandler(){
   if (m_pKeyboard->TriggerDown(VK_F4))
       NextLevel();
 
+  if (m_pKeyboard->TriggerDown(VK_F7) && m_bDebugText) //Cycle through the integrators
+      m_pObjectManager->set_integrator((eIntegrator)(((int)m_pObjectManager->get_integrator() + 1) % (int)eIntegrator::NUM_INTEGRATORS));
+
+  if (m_pKeyboard->TriggerDown(VK_F8) && m_bDebugText) //Put the terrain back to the start of the turn, or the turn before if it already is
+      m_pObjectManager->rewind_terrain();
+
+  if (m_pKeyboard->TriggerDown(VK_F6) && m_bDebugText) { //Run the physics benchmarks, then restart the level they trampled on
+      CBenchmark().run();
+      BeginGame();
+      return;
+  }
+
   //make sure the player cannot move ai
   if (!m_pPlayer->get_is_player_character())
       return;
@@ -538,6 +552,10 @@ void CGame::StateBasedText() {
                 s = "Angle: " + to_string(m_pPlayer->get_angle()) + "\n";
                 s += "Power: " + to_string(m_pPlayer->get_power()) + "\n";
                 s += "Health: " + to_string(m_pPlayer->get_health_points()) + "\n";
+                s += "Integrator: " + m_pObjectManager->get_integrator_name() + " (F7)\n";
+                s += "Terrain saves: " + to_string(m_pObjectManager->get_terrain_saves()) + " (F8 rewinds)\n";
+                s += "AI steps saved: " + to_string(m_pObjectManager->get_phantom_stats().m_nStepsSaved) + " of " +
+                  to_string(m_pObjectManager->get_phantom_stats().m_nStepsSaved + m_pObjectManager->get_phantom_stats().m_nSteps) + "\n";
                 m_pRenderer->DrawScreenText(s.c_str(), Vector2(30.0f, 30.0f), Colors::White);
 
                 //Frame Count
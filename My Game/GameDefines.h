@@ -5,6 +5,8 @@
 
 #include "Defines.h"
 
+//#define DETERMINISTIC_PHYSICS ///< Make the physics come out bit-for-bit the same in every build, at some cost in speed. See Deterministic.h.
+
 /// \brief Sprite type.
 ///
 /// Note: NUM_SPRITES must be last.
@@ -31,3 +33,22 @@ enum eSpriteType{
   STARFIELD1_SPRITE, STARFIELD2_SPRITE, YELLOW_STAR_SPRITE, LMB_SPRITE, RMB_SPRITE, ARROWKEY_SPRITE, AKEY_SPRITE, DKEY_SPRITE, TABKEY_SPRITE,
   NUM_SPRITES //MUST BE LAST
 }; //eSpriteType
+
+/// \brief Collision layer.
+///
+/// Every object is on one collision layer, which depends on what kind of
+/// object it is, and has a mask of the layers that it can collide with.
+/// The broad phase doesn't bother testing a pair of objects unless one
+/// is in the other's mask. The masks are in CObject::SetCollisionLayer.
+/// Note: NUM_COLLISION_LAYERS must be last.
+
+enum eCollisionLayer{
+  BULLET_LAYER, ///< Live bullets.
+  PHANTOM_LAYER, ///< Bullets that the AI fires to see where they land. They only hit planets and go through wormholes.
+  TANK_LAYER, ///< Tanks, and the player.
+  PLANET_LAYER, ///< Planets.
+  WORMHOLE_LAYER, ///< Wormholes.
+  TURRET_LAYER, ///< Turrets.
+  DEBRIS_LAYER, ///< Everything else, which doesn't collide with anything.
+  NUM_COLLISION_LAYERS //MUST BE LAST
+}; //eCollisionLayer
@@ -0,0 +1,359 @@
+/// \file GravityField.cpp
+/// \brief Code for the gravity field class CGravityField.
+
+#include "GravityField.h"
+#include "Object.h"
+#include "Deterministic.h"
+
+#if defined(__AVX__)
+  #define GRAVITY_USE_AVX ///< 8 bodies per instruction.
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define GRAVITY_USE_SSE ///< 4 bodies per instruction.
+#endif
+
+#if defined(GRAVITY_USE_AVX) || defined(GRAVITY_USE_SSE)
+  #include <immintrin.h>
+#endif
+
+/// Remove all of the bodies.
+
+void CGravityField::clear(){
+  m_vX.clear();
+  m_vY.clear();
+  m_vGM.clear();
+  m_vSources.clear();
+  m_nFixed = 0;
+  m_cTree.clear();
+  m_bTreeValid = false;
+  clear_grid();
+} //clear
+
+/// Add a body to the packed arrays. Fixed bodies go after the other
+/// fixed bodies, and moving ones go on the end.
+/// \param pos Position of the body.
+/// \param gm Mass of the body times the gravitational constant.
+/// \param source The object that this body mirrors, if any.
+/// \param moving Whether the body is going to move.
+
+void CGravityField::add(const Vector2& pos, float gm, CObject* source, bool moving){
+  const size_t i = moving? m_vGM.size(): m_nFixed;
+  m_vX.insert(m_vX.begin() + i, pos.x);
+  m_vY.insert(m_vY.begin() + i, pos.y);
+  m_vGM.insert(m_vGM.begin() + i, gm);
+  m_vSources.insert(m_vSources.begin() + i, source);
+  if(!moving)m_nFixed++;
+  m_bTreeValid = false; //call build_tree when done adding
+} //add
+
+/// Throw away the packed arrays and mirror a list of massive objects.
+/// This should be called whenever a massive object is created or culled.
+/// \param massive_objects The massive objects.
+/// \param gravitational_constant The gravitational constant.
+/// \param softening The softening parameter.
+
+void CGravityField::rebuild(const std::list<CObject*>& massive_objects, double gravitational_constant, double softening){
+  const bool grid = m_bGridWanted; //clear forgets this
+  clear();
+  m_fSoftening = (float)softening;
+
+  for(auto const& p: massive_objects)
+    add(p->GetPos(), (float)(p->GetMass()*gravitational_constant), p, p->GetAffectedByGravity());
+
+  build_tree();
+  if(grid) //the grid is out of date, so start again
+    build_grid(m_vGridWorldSize);
+} //rebuild
+
+/// Copy the positions of the mirrored objects into the packed arrays.
+/// Only needed if the massive objects can move. The quadtree is rebuilt
+/// and the grid is thrown away only if one of the fixed bodies was moved,
+/// since the moving bodies aren't in either of them.
+
+void CGravityField::update_positions(){
+  bool moved = false; //whether a fixed body moved
+
+  for(size_t i=0; i<m_vSources.size(); i++)
+    if(m_vSources[i]){
+      const Vector2& pos = m_vSources[i]->GetPos();
+      if(m_vX[i] != pos.x || m_vY[i] != pos.y){
+        m_vX[i] = pos.x;
+        m_vY[i] = pos.y;
+        moved = moved || i < m_nFixed;
+      } //if
+    } //if
+
+  if(moved){
+    build_tree();
+    clear_grid();
+  } //if
+} //update_positions
+
+/// Rebuild the quadtree over the fixed bodies in the packed arrays, but
+/// only if queries are going to use it.
+
+void CGravityField::build_tree(){
+  m_bTreeValid = false;
+  m_cTree.clear();
+
+  if(m_bUseTree && m_nFixed >= m_nTreeThreshold){
+    m_cTree.build(m_vX.data(), m_vY.data(), m_vGM.data(), m_nFixed, m_fSoftening);
+    m_bTreeValid = true;
+  } //if
+} //build_tree
+
+/// Set the quadtree parameters and rebuild the quadtree.
+/// \param use Whether to use the quadtree at all.
+/// \param opening_angle Opening angle. Smaller is more accurate but slower, 0 is exact.
+/// \param threshold Use the direct sum with fewer bodies than this.
+
+void CGravityField::set_tree(bool use, float opening_angle, size_t threshold){
+  m_bUseTree = use;
+  m_cTree.set_opening_angle(opening_angle);
+  m_nTreeThreshold = threshold;
+  build_tree();
+} //set_tree
+
+/// Precompute the field of the fixed bodies on a grid over the world, on
+/// a background thread unless asked to wait. Queries use the direct sum
+/// or the quadtree until the grid is ready. Nothing is built if there are
+/// too few fixed bodies for the grid to pay.
+/// \param world_size Size of the world.
+/// \param wait Whether to wait for the grid to be finished.
+
+void CGravityField::build_grid(const Vector2& world_size, bool wait){
+  clear_grid();
+  m_bGridWanted = true;
+  m_vGridWorldSize = world_size;
+
+  if(m_bUseGrid && m_nFixed >= m_nGridThreshold){
+    const std::vector<float> x(m_vX.begin(), m_vX.begin() + m_nFixed);
+    const std::vector<float> y(m_vY.begin(), m_vY.begin() + m_nFixed);
+    const std::vector<float> gm(m_vGM.begin(), m_vGM.begin() + m_nFixed);
+    if(wait)
+      m_cGrid.build(x, y, gm, m_fSoftening, world_size);
+    else m_cGrid.build_async(x, y, gm, m_fSoftening, world_size);
+  } //if
+} //build_grid
+
+/// Throw away the grid, stopping the build if it is still going.
+
+void CGravityField::clear_grid(){
+  m_cGrid.clear();
+  m_bGridWanted = false;
+} //clear_grid
+
+/// Set the grid parameters. They take effect at the next build_grid.
+/// \param use Whether to use the grid at all.
+/// \param threshold Don't build the grid with fewer bodies than this.
+
+void CGravityField::set_grid(bool use, size_t threshold){
+  m_bUseGrid = use;
+  m_nGridThreshold = threshold;
+} //set_grid
+
+/// Whether queries should go through the quadtree.
+/// \return true if the tree is wanted, up to date, and there are enough fixed bodies to make it pay.
+
+bool CGravityField::use_tree() const{
+  return m_bUseTree && m_bTreeValid && m_nFixed >= m_nTreeThreshold;
+} //use_tree
+
+/// Evaluate the gravitational field at a position. The field of the
+/// fixed bodies comes from the grid if it is ready and covers the
+/// position, else the quadtree if there are enough bodies, and the direct
+/// sum otherwise. The moving bodies are added on directly. In the
+/// deterministic mode it is always the scalar direct sum, since the vector
+/// paths add the bodies up in a different order depending on how wide the
+/// vectors are.
+/// \param pos Position at which to evaluate the field.
+/// \return The gravitational field (acceleration) at pos.
+
+Vector2 CGravityField::field(const Vector2& pos) const{
+#ifdef DETERMINISTIC_PHYSICS
+  return field_scalar(pos); //one body at a time in list order, which every build adds up the same way
+#else
+  Vector2 result;
+  if(!m_cGrid.field(pos, result))
+    result = use_tree()? m_cTree.field(pos): field_range(pos, 0, m_nFixed);
+  if(m_nFixed < m_vGM.size())
+    result += field_range(pos, m_nFixed, m_vGM.size());
+  return result;
+#endif
+} //field
+
+/// Evaluate the gravitational field at a position by adding up every
+/// body directly.
+/// \param pos Position at which to evaluate the field.
+/// \return The gravitational field (acceleration) at pos.
+
+Vector2 CGravityField::field_direct(const Vector2& pos) const{
+  return field_range(pos, 0, m_vGM.size());
+} //field_direct
+
+/// Evaluate the gravitational field due to a range of the bodies at a
+/// position using the widest vector instructions available, falling back
+/// to a scalar loop for the bodies left over at the end.
+/// \param pos Position at which to evaluate the field.
+/// \param first Index of the first body.
+/// \param last Index of the body after the last one.
+/// \return The gravitational field (acceleration) at pos.
+
+Vector2 CGravityField::field_range(const Vector2& pos, size_t first, size_t last) const{
+  const size_t n = last - first;
+  const float* x = m_vX.data() + first;
+  const float* y = m_vY.data() + first;
+  const float* gm = m_vGM.data() + first;
+  size_t i = 0;
+  float ax = 0, ay = 0;
+
+#if defined(GRAVITY_USE_AVX)
+  const __m256 px = _mm256_set1_ps(pos.x);
+  const __m256 py = _mm256_set1_ps(pos.y);
+  const __m256 soft = _mm256_set1_ps(m_fSoftening);
+  const __m256 zero = _mm256_setzero_ps();
+  __m256 sumx = zero, sumy = zero;
+
+  for(; i + 8 <= n; i += 8){
+    const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + i), px);
+    const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + i), py);
+    const __m256 r2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+    const __m256 denom = _mm256_mul_ps(_mm256_add_ps(r2, soft), _mm256_sqrt_ps(r2));
+    __m256 s = _mm256_div_ps(_mm256_loadu_ps(gm + i), denom);
+    s = _mm256_and_ps(s, _mm256_cmp_ps(r2, zero, _CMP_GT_OQ)); //a body exactly at pos exerts no force
+    sumx = _mm256_add_ps(sumx, _mm256_mul_ps(dx, s));
+    sumy = _mm256_add_ps(sumy, _mm256_mul_ps(dy, s));
+  } //for
+
+  __m128 hx = _mm_add_ps(_mm256_castps256_ps128(sumx), _mm256_extractf128_ps(sumx, 1));
+  __m128 hy = _mm_add_ps(_mm256_castps256_ps128(sumy), _mm256_extractf128_ps(sumy, 1));
+  hx = _mm_add_ps(hx, _mm_movehl_ps(hx, hx));
+  hy = _mm_add_ps(hy, _mm_movehl_ps(hy, hy));
+  ax = _mm_cvtss_f32(_mm_add_ss(hx, _mm_shuffle_ps(hx, hx, 1)));
+  ay = _mm_cvtss_f32(_mm_add_ss(hy, _mm_shuffle_ps(hy, hy, 1)));
+
+#elif defined(GRAVITY_USE_SSE)
+  const __m128 px = _mm_set1_ps(pos.x);
+  const __m128 py = _mm_set1_ps(pos.y);
+  const __m128 soft = _mm_set1_ps(m_fSoftening);
+  const __m128 zero = _mm_setzero_ps();
+  __m128 sumx = zero, sumy = zero;
+
+  for(; i + 4 <= n; i += 4){
+    const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i), px);
+    const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i), py);
+    const __m128 r2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+    const __m128 denom = _mm_mul_ps(_mm_add_ps(r2, soft), _mm_sqrt_ps(r2));
+    __m128 s = _mm_div_ps(_mm_loadu_ps(gm + i), denom);
+    s = _mm_and_ps(s, _mm_cmpgt_ps(r2, zero)); //a body exactly at pos exerts no force
+    sumx = _mm_add_ps(sumx, _mm_mul_ps(dx, s));
+    sumy = _mm_add_ps(sumy, _mm_mul_ps(dy, s));
+  } //for
+
+  sumx = _mm_add_ps(sumx, _mm_movehl_ps(sumx, sumx));
+  sumy = _mm_add_ps(sumy, _mm_movehl_ps(sumy, sumy));
+  ax = _mm_cvtss_f32(_mm_add_ss(sumx, _mm_shuffle_ps(sumx, sumx, 1)));
+  ay = _mm_cvtss_f32(_mm_add_ss(sumy, _mm_shuffle_ps(sumy, sumy, 1)));
+#endif
+
+  //whatever is left over, or everything if there are no vector instructions
+  for(; i<n; i++){
+    const float dx = x[i] - pos.x;
+    const float dy = y[i] - pos.y;
+    const float r2 = dx*dx + dy*dy;
+    if(r2 > 0){
+      const float s = gm[i]/((r2 + m_fSoftening)*sqrtf(r2));
+      ax += dx*s;
+      ay += dy*s;
+    } //if
+  } //for
+
+  return Vector2(ax, ay);
+} //field_range
+
+/// Evaluate the gravitational field at a position one body at a time.
+/// \param pos Position at which to evaluate the field.
+/// \return The gravitational field (acceleration) at pos.
+
+Vector2 CGravityField::field_scalar(const Vector2& pos) const{
+  float ax = 0, ay = 0;
+
+  for(size_t i=0; i<m_vGM.size(); i++){
+    const float dx = m_vX[i] - pos.x;
+    const float dy = m_vY[i] - pos.y;
+    const float r2 = dx*dx + dy*dy;
+    if(r2 > 0){
+      const float s = m_vGM[i]/((r2 + m_fSoftening)*sqrtf(r2));
+      ax += dx*s;
+      ay += dy*s;
+    } //if
+  } //for
+
+  return Vector2(ax, ay);
+} //field_scalar
+
+/// Evaluate the gravitational field at a position in double precision.
+/// This is what the other two are measured against.
+/// \param pos Position at which to evaluate the field.
+/// \return The gravitational field (acceleration) at pos.
+
+Vector2 CGravityField::field_reference(const Vector2& pos) const{
+  double ax = 0, ay = 0;
+
+  for(size_t i=0; i<m_vGM.size(); i++){
+    const double dx = (double)m_vX[i] - pos.x;
+    const double dy = (double)m_vY[i] - pos.y;
+    const double r2 = dx*dx + dy*dy;
+    if(r2 > 0){
+      const double s = m_vGM[i]/((r2 + m_fSoftening)*sqrt(r2));
+      ax += dx*s;
+      ay += dy*s;
+    } //if
+  } //for
+
+  return Vector2((float)ax, (float)ay);
+} //field_reference
+
+/// Evaluate the gravitational potential at a position, the same way
+/// as field.
+/// \param pos Position at which to evaluate the potential.
+/// \return The gravitational potential at pos.
+
+float CGravityField::potential(const Vector2& pos) const{
+#ifdef DETERMINISTIC_PHYSICS
+  return potential_direct(pos);
+#else
+  float result;
+  if(!m_cGrid.potential(pos, result))
+    result = use_tree()? m_cTree.potential(pos): potential_range(pos, 0, m_nFixed);
+  if(m_nFixed < m_vGM.size())
+    result += potential_range(pos, m_nFixed, m_vGM.size());
+  return result;
+#endif
+} //potential
+
+/// Evaluate the gravitational potential at a position by adding up every body.
+/// \param pos Position at which to evaluate the potential.
+/// \return The gravitational potential at pos.
+
+float CGravityField::potential_direct(const Vector2& pos) const{
+  return potential_range(pos, 0, m_vGM.size());
+} //potential_direct
+
+/// Evaluate the gravitational potential due to a range of the bodies at
+/// a position.
+/// \param pos Position at which to evaluate the potential.
+/// \param first Index of the first body.
+/// \param last Index of the body after the last one.
+/// \return The gravitational potential at pos.
+
+float CGravityField::potential_range(const Vector2& pos, size_t first, size_t last) const{
+  float phi = 0;
+
+  for(size_t i=first; i<last; i++){
+    const float dx = m_vX[i] - pos.x;
+    const float dy = m_vY[i] - pos.y;
+    phi += m_vGM[i]/sqrtf(dx*dx + dy*dy);
+  } //for
+
+  return -phi;
+} //potential_range
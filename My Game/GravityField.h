@@ -0,0 +1,89 @@
+/// \file GravityField.h
+/// \brief Interface for the gravity field class CGravityField.
+
+#pragma once
+
+#include <vector>
+#include <list>
+
+#include "Defines.h"
+#include "BarnesHut.h"
+#include "GravityGrid.h"
+
+class CObject;
+
+/// \brief The gravity field.
+///
+/// CGravityField keeps a packed structure-of-arrays copy of the position
+/// and mass of every massive object, so that evaluating the field is a
+/// straight walk over three float arrays instead of a pointer chase down
+/// a std::list. The field is evaluated with AVX or SSE when the compiler
+/// targets them, and with a plain scalar loop otherwise. All three paths
+/// agree with the double precision reference sum to within a relative error
+/// of about 1e-5, which is float round-off.
+///
+/// Once there are enough bodies that the direct sum gets expensive, queries
+/// go through a Barnes-Hut quadtree instead. The tree is rebuilt only when
+/// the bodies change, that is, when a body is added, dies or moves.
+///
+/// If the bodies stay put, the field can instead be precomputed on a grid
+/// by calling build_grid, after which queries are interpolated from the
+/// grid. The grid is thrown away as soon as a body moves. It is only
+/// built if there are enough bodies that the direct sum costs more than
+/// an interpolated lookup.
+///
+/// Bodies that are affected by gravity themselves, such as orbiting
+/// planets, are kept at the end of the arrays, after the fixed ones. The
+/// quadtree and the grid only cover the fixed bodies, and the moving ones
+/// are always added up directly on top, so that moving them costs no more
+/// than copying their positions. There are never more than a few dozen of
+/// them, which the direct sum handles faster than any cache could be kept
+/// up to date.
+
+class CGravityField{
+  private:
+    std::vector<float> m_vX; ///< x coordinates of the massive bodies.
+    std::vector<float> m_vY; ///< y coordinates of the massive bodies.
+    std::vector<float> m_vGM; ///< Mass of each body premultiplied by the gravitational constant.
+    std::vector<CObject*> m_vSources; ///< The object that each entry mirrors, or nullptr for synthetic bodies.
+
+    size_t m_nFixed = 0; ///< Number of bodies at the front of the arrays that don't move. The rest are summed directly.
+    float m_fSoftening = 0; ///< Softening parameter added to the squared distance.
+
+    CBarnesHutTree m_cTree; ///< Quadtree over the bodies.
+    bool m_bUseTree = true; ///< Whether to use the quadtree at all.
+    bool m_bTreeValid = false; ///< Whether the quadtree matches the packed arrays.
+    size_t m_nTreeThreshold = 2048; ///< Use the direct sum with fewer bodies than this. The vectorized direct sum wins below about 2000 bodies.
+
+    CGravityGrid m_cGrid; ///< Precomputed field.
+    bool m_bUseGrid = true; ///< Whether to use the grid at all.
+    bool m_bGridWanted = false; ///< Whether build_grid has been called since the bodies last moved.
+    Vector2 m_vGridWorldSize = Vector2::Zero; ///< World size the grid was asked to cover.
+    size_t m_nGridThreshold = 24; ///< Don't build the grid with fewer bodies than this. The vectorized direct sum wins below about 24 bodies.
+
+    bool use_tree() const; ///< Whether queries should go through the quadtree.
+    Vector2 field_range(const Vector2& pos, size_t first, size_t last) const; ///< Field at a position due to a range of the bodies, vectorized.
+    float potential_range(const Vector2& pos, size_t first, size_t last) const; ///< Potential at a position due to a range of the bodies.
+
+  public:
+    void clear(); ///< Remove all bodies.
+    void add(const Vector2& pos, float gm, CObject* source = nullptr, bool moving = false); ///< Add a body.
+    void rebuild(const std::list<CObject*>& massive_objects, double gravitational_constant, double softening); ///< Mirror a list of massive objects.
+    void update_positions(); ///< Copy the current positions of the mirrored objects into the packed arrays.
+    void build_tree(); ///< Rebuild the quadtree from the packed arrays.
+    void set_tree(bool use, float opening_angle, size_t threshold); ///< Set the quadtree parameters.
+    void build_grid(const Vector2& world_size, bool wait = false); ///< Precompute the field on a grid over the world.
+    void clear_grid(); ///< Throw away the precomputed grid.
+    void set_grid(bool use, size_t threshold); ///< Set the grid parameters.
+    const CGravityGrid& get_grid() const { return m_cGrid; }; ///< Get the grid, for reporting.
+
+    Vector2 field(const Vector2& pos) const; ///< Gravitational field at a position, through the quadtree if there are enough bodies.
+    Vector2 field_direct(const Vector2& pos) const; ///< Gravitational field at a position, direct sum, vectorized.
+    Vector2 field_scalar(const Vector2& pos) const; ///< Gravitational field at a position, scalar reference.
+    Vector2 field_reference(const Vector2& pos) const; ///< Gravitational field at a position in double precision.
+    float potential(const Vector2& pos) const; ///< Gravitational potential at a position, through the quadtree if there are enough bodies.
+    float potential_direct(const Vector2& pos) const; ///< Gravitational potential at a position, direct sum.
+
+    size_t size() const { return m_vGM.size(); }; ///< Number of bodies.
+    size_t moving() const { return m_vGM.size() - m_nFixed; }; ///< Number of bodies that move.
+}; //CGravityField
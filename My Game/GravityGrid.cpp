@@ -0,0 +1,289 @@
+/// \file GravityGrid.cpp
+/// \brief Code for the precomputed gravity grid CGravityGrid.
+
+#include "GravityGrid.h"
+
+#include <chrono>
+
+/// Add up the field and potential of every body at a position in double
+/// precision. Only used while building, so speed is not a concern.
+/// \param px x coordinate of the position.
+/// \param py y coordinate of the position.
+/// \param x x coordinates of the bodies.
+/// \param y y coordinates of the bodies.
+/// \param gm Mass times gravitational constant of the bodies.
+/// \param softening Softening parameter added to the squared distance.
+/// \param ax [out] x component of the field.
+/// \param ay [out] y component of the field.
+/// \param phi [out] Potential.
+
+static void exact(double px, double py, const std::vector<float>& x, const std::vector<float>& y,
+  const std::vector<float>& gm, float softening, float& ax, float& ay, float& phi)
+{
+  double sx = 0, sy = 0, sphi = 0;
+
+  for(size_t i=0; i<gm.size(); i++){
+    const double dx = x[i] - px;
+    const double dy = y[i] - py;
+    const double r2 = dx*dx + dy*dy;
+    if(r2 > 0){
+      const double r = sqrt(r2);
+      const double s = gm[i]/((r2 + softening)*r);
+      sx += dx*s;
+      sy += dy*s;
+      sphi -= gm[i]/r;
+    } //if
+  } //for
+
+  ax = (float)sx;
+  ay = (float)sy;
+  phi = (float)sphi;
+} //exact
+
+CGravityGrid::CGravityGrid(){
+  m_bReady = false;
+  m_bCancel = false;
+} //constructor
+
+CGravityGrid::~CGravityGrid(){
+  clear();
+} //destructor
+
+/// Stop any background build, wait for it to finish, and throw the grid away.
+
+void CGravityGrid::clear(){
+  m_bReady = false;
+  m_bCancel = true;
+  if(m_cThread.joinable())
+    m_cThread.join();
+  m_bCancel = false;
+
+  m_vNodes.clear();
+  m_vPatchNodes.clear();
+  m_vCells.clear();
+  m_nWidth = m_nHeight = 0;
+} //clear
+
+/// Build the grid and wait for it to finish.
+/// \param x x coordinates of the bodies.
+/// \param y y coordinates of the bodies.
+/// \param gm Mass times gravitational constant of the bodies.
+/// \param softening Softening parameter added to the squared distance.
+/// \param world_size Size of the world. The grid covers it from the origin.
+
+void CGravityGrid::build(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& gm, float softening, const Vector2& world_size){
+  clear();
+  compute(x, y, gm, softening, world_size);
+} //build
+
+/// Build the grid on a background thread and return immediately. The
+/// bodies are copied, so the caller is free to change them afterwards.
+/// Lookups fail until the build is done.
+/// \param x x coordinates of the bodies.
+/// \param y y coordinates of the bodies.
+/// \param gm Mass times gravitational constant of the bodies.
+/// \param softening Softening parameter added to the squared distance.
+/// \param world_size Size of the world. The grid covers it from the origin.
+
+void CGravityGrid::build_async(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& gm, float softening, const Vector2& world_size){
+  clear();
+  m_cThread = std::thread([this, x, y, gm, softening, world_size](){
+    compute(x, y, gm, softening, world_size);
+  });
+} //build_async
+
+/// Build the grid. First the coarse nodes are sampled, then each coarse
+/// cell is checked by comparing the interpolated field against the exact
+/// field at a few points inside it, and refined if it is out by more than
+/// the tolerance. Cells with a body in them or close enough to it to
+/// reach into an interpolation stencil are marked EXACT instead.
+/// \param x x coordinates of the bodies.
+/// \param y y coordinates of the bodies.
+/// \param gm Mass times gravitational constant of the bodies.
+/// \param softening Softening parameter added to the squared distance.
+/// \param world_size Size of the world. The grid covers it from the origin.
+
+void CGravityGrid::compute(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& gm, float softening, const Vector2& world_size){
+  const auto start = std::chrono::steady_clock::now();
+  const float h = m_fCellSize;
+  const float fine = h/SUBDIVISIONS;
+
+  m_vOrigin = Vector2::Zero;
+  m_nWidth = max(1, (int)ceilf(world_size.x/h));
+  m_nHeight = max(1, (int)ceilf(world_size.y/h));
+
+  //coarse nodes, including a border of one node all round
+  const int stride = m_nWidth + 3;
+  std::vector<CGridNode> nodes(stride*(m_nHeight + 3));
+  double mean_field = 0;
+
+  for(int j=0; j<m_nHeight + 3; j++){
+    if(m_bCancel)return;
+    for(int i=0; i<stride; i++){
+      CGridNode& n = nodes[j*stride + i];
+      exact(m_vOrigin.x + (i - 1)*h, m_vOrigin.y + (j - 1)*h, x, y, gm, softening, n.m_fAX, n.m_fAY, n.m_fPhi);
+      mean_field += sqrt(n.m_fAX*n.m_fAX + n.m_fAY*n.m_fAY);
+    } //for
+  } //for
+
+  mean_field /= nodes.size();
+  m_vNodes.swap(nodes);
+
+  //so that the cells around the zeros of the field don't all get refined
+  const float floor = 0.01f*(float)mean_field;
+
+  //check each cell and refine it if need be
+  const float test[5][2] = {{0.5f, 0.5f}, {0.25f, 0.25f}, {0.75f, 0.25f}, {0.25f, 0.75f}, {0.75f, 0.75f}};
+  const float margin = 2*fine; //the reach of a bicubic stencil in a patch
+  std::vector<CGridNode> patches;
+  m_vCells.assign(m_nWidth*m_nHeight, COARSE);
+
+  for(int j=0; j<m_nHeight; j++){
+    if(m_bCancel)return;
+    for(int i=0; i<m_nWidth; i++){
+      const float x0 = m_vOrigin.x + i*h;
+      const float y0 = m_vOrigin.y + j*h;
+      int& cell = m_vCells[j*m_nWidth + i];
+
+      for(size_t k=0; k<gm.size() && cell == COARSE; k++)
+        if(x[k] > x0 - margin && x[k] < x0 + h + margin && y[k] > y0 - margin && y[k] < y0 + h + margin)
+          cell = EXACT;
+      if(cell == EXACT)continue;
+
+      bool refine = false;
+      for(int t=0; t<5 && !refine; t++){
+        CGridNode e;
+        exact(x0 + test[t][0]*h, y0 + test[t][1]*h, x, y, gm, softening, e.m_fAX, e.m_fAY, e.m_fPhi);
+        const CGridNode a = interpolate(&m_vNodes[stride + 1], stride, i, j, test[t][0], test[t][1]);
+        const float error = sqrtf((a.m_fAX - e.m_fAX)*(a.m_fAX - e.m_fAX) + (a.m_fAY - e.m_fAY)*(a.m_fAY - e.m_fAY));
+        refine = error > m_fTolerance*max(floor, sqrtf(e.m_fAX*e.m_fAX + e.m_fAY*e.m_fAY));
+      } //for
+      if(!refine)continue;
+
+      cell = (int)(patches.size()/(PATCH_STRIDE*PATCH_STRIDE));
+      for(int b=0; b<PATCH_STRIDE; b++)
+        for(int a=0; a<PATCH_STRIDE; a++){
+          CGridNode n;
+          exact(x0 + (a - 1)*fine, y0 + (b - 1)*fine, x, y, gm, softening, n.m_fAX, n.m_fAY, n.m_fPhi);
+          patches.push_back(n);
+        } //for
+    } //for
+  } //for
+
+  m_vPatchNodes.swap(patches);
+  m_fBuildTime = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+  m_bReady.store(true, std::memory_order_release);
+} //compute
+
+/// Interpolate the nodes around a cell.
+/// \param base Pointer to node (0, 0). Nodes one to the left of and below it, and two to the right and above the cell, must exist.
+/// \param stride Number of nodes in a row.
+/// \param i Column of the cell.
+/// \param j Row of the cell.
+/// \param u Horizontal position inside the cell, from 0 to 1.
+/// \param v Vertical position inside the cell, from 0 to 1.
+/// \return The interpolated node.
+
+CGravityGrid::CGridNode CGravityGrid::interpolate(const CGridNode* base, int stride, int i, int j, float u, float v) const{
+  CGridNode result;
+
+  if(m_eInterpolation == eInterpolation::BILINEAR){
+    const CGridNode* p = base + j*stride + i;
+    const float w[4] = {(1 - u)*(1 - v), u*(1 - v), (1 - u)*v, u*v};
+    const CGridNode* n[4] = {p, p + 1, p + stride, p + stride + 1};
+
+    for(int k=0; k<4; k++){
+      result.m_fAX += w[k]*n[k]->m_fAX;
+      result.m_fAY += w[k]*n[k]->m_fAY;
+      result.m_fPhi += w[k]*n[k]->m_fPhi;
+    } //for
+  } //if
+
+  else{ //Catmull-Rom
+    const float wu[4] = {
+      0.5f*((-u + 2)*u - 1)*u, 0.5f*((3*u - 5)*u*u + 2),
+      0.5f*((-3*u + 4)*u + 1)*u, 0.5f*(u - 1)*u*u};
+    const float wv[4] = {
+      0.5f*((-v + 2)*v - 1)*v, 0.5f*((3*v - 5)*v*v + 2),
+      0.5f*((-3*v + 4)*v + 1)*v, 0.5f*(v - 1)*v*v};
+
+    for(int b=0; b<4; b++){
+      const CGridNode* row = base + (j + b - 1)*stride + i - 1;
+      for(int a=0; a<4; a++){
+        const float w = wu[a]*wv[b];
+        result.m_fAX += w*row[a].m_fAX;
+        result.m_fAY += w*row[a].m_fAY;
+        result.m_fPhi += w*row[a].m_fPhi;
+      } //for
+    } //for
+  } //else
+
+  return result;
+} //interpolate
+
+/// Interpolate the grid at a position.
+/// \param pos The position.
+/// \param result [out] The interpolated field and potential.
+/// \return true if the grid covers pos, false if the caller must work it out some other way.
+
+bool CGravityGrid::lookup(const Vector2& pos, CGridNode& result) const{
+  if(!ready())return false;
+
+  const float fx = (pos.x - m_vOrigin.x)/m_fCellSize;
+  const float fy = (pos.y - m_vOrigin.y)/m_fCellSize;
+  if(!(fx >= 0 && fy >= 0 && fx < m_nWidth && fy < m_nHeight))
+    return false; //off the grid, or not a number
+
+  const int i = (int)fx;
+  const int j = (int)fy;
+  const int cell = m_vCells[j*m_nWidth + i];
+
+  if(cell == EXACT)
+    return false;
+
+  else if(cell == COARSE)
+    result = interpolate(&m_vNodes[m_nWidth + 4], m_nWidth + 3, i, j, fx - i, fy - j);
+
+  else{ //look in the patch
+    const float gx = (fx - i)*SUBDIVISIONS;
+    const float gy = (fy - j)*SUBDIVISIONS;
+    const int a = min((int)gx, SUBDIVISIONS - 1);
+    const int b = min((int)gy, SUBDIVISIONS - 1);
+    const CGridNode* base = &m_vPatchNodes[cell*PATCH_STRIDE*PATCH_STRIDE + PATCH_STRIDE + 1];
+    result = interpolate(base, PATCH_STRIDE, a, b, gx - a, gy - b);
+  } //else
+
+  return true;
+} //lookup
+
+/// Look up the gravitational field at a position.
+/// \param pos The position.
+/// \param result [out] The gravitational field at pos.
+/// \return true if the grid covers pos, false if the caller must work it out some other way.
+
+bool CGravityGrid::field(const Vector2& pos, Vector2& result) const{
+  CGridNode n;
+  if(!lookup(pos, n))return false;
+  result = Vector2(n.m_fAX, n.m_fAY);
+  return true;
+} //field
+
+/// Look up the gravitational potential at a position.
+/// \param pos The position.
+/// \param result [out] The gravitational potential at pos.
+/// \return true if the grid covers pos, false if the caller must work it out some other way.
+
+bool CGravityGrid::potential(const Vector2& pos, float& result) const{
+  CGridNode n;
+  if(!lookup(pos, n))return false;
+  result = n.m_fPhi;
+  return true;
+} //potential
+
+/// Bytes used by the grid, not counting the class itself.
+/// \return Number of bytes.
+
+size_t CGravityGrid::memory() const{
+  if(!ready())return 0;
+  return m_vNodes.size()*sizeof(CGridNode) + m_vPatchNodes.size()*sizeof(CGridNode) + m_vCells.size()*sizeof(int);
+} //memory
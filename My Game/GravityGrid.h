@@ -0,0 +1,91 @@
+/// \file GravityGrid.h
+/// \brief Interface for the precomputed gravity grid CGravityGrid.
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "Defines.h"
+
+/// \brief A precomputed gravity grid.
+///
+/// When none of the massive bodies move, the gravitational field is the
+/// same for the whole level, so it can be computed once and looked up
+/// afterwards. CGravityGrid samples the field and potential on a coarse
+/// grid over the world. Coarse cells where interpolation would be out by
+/// more than a set tolerance, which in practice means near planets, get a
+/// finer patch of their own. Cells with a body in them are left to the
+/// caller to evaluate directly, since the field is singular there.
+///
+/// The grid can be built on a background thread. Until it is ready, or
+/// if the position asked for is off the grid, the lookups return false
+/// and the caller is expected to fall back to the direct sum.
+
+class CGravityGrid{
+  public:
+    /// \brief How to interpolate between grid nodes.
+
+    enum class eInterpolation{
+      BILINEAR, BICUBIC
+    }; //eInterpolation
+
+  private:
+    /// \brief A sample of the field and potential at one grid node.
+
+    struct CGridNode{
+      float m_fAX = 0; ///< x component of the field.
+      float m_fAY = 0; ///< y component of the field.
+      float m_fPhi = 0; ///< Potential.
+    }; //CGridNode
+
+    /// \brief Values in m_vCells that are not patch indices.
+
+    enum{
+      COARSE = -1, ///< The cell has no patch.
+      EXACT = -2 ///< The cell must be evaluated directly.
+    };
+    static const int SUBDIVISIONS = 8; ///< Fine cells along each side of a patch.
+    static const int PATCH_STRIDE = SUBDIVISIONS + 3; ///< Nodes along each side of a patch, including a border of one node for bicubic interpolation.
+
+    std::vector<CGridNode> m_vNodes; ///< Coarse nodes, row major, with a border of one node all round.
+    std::vector<CGridNode> m_vPatchNodes; ///< Nodes of all of the fine patches, one patch after another.
+    std::vector<int> m_vCells; ///< For each coarse cell, the index of its patch, or COARSE or EXACT.
+
+    Vector2 m_vOrigin = Vector2::Zero; ///< Bottom left corner of the grid.
+    float m_fCellSize = 128.0f; ///< Width of a coarse cell.
+    float m_fTolerance = 1.0e-3f; ///< Relative interpolation error above which a coarse cell gets refined.
+    int m_nWidth = 0; ///< Number of coarse cells across.
+    int m_nHeight = 0; ///< Number of coarse cells down.
+    eInterpolation m_eInterpolation = eInterpolation::BILINEAR; ///< Interpolation used by the lookups. Bicubic needs a third of the memory for the same tolerance, but lookups take about twice as long.
+
+    std::thread m_cThread; ///< Background build thread.
+    std::atomic<bool> m_bReady; ///< Whether the grid has been built and can be used.
+    std::atomic<bool> m_bCancel; ///< Set to ask the background build to give up.
+    float m_fBuildTime = 0; ///< Seconds taken by the last build.
+
+    void compute(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& gm, float softening, const Vector2& world_size); ///< Do the work of building the grid.
+    bool lookup(const Vector2& pos, CGridNode& result) const; ///< Interpolate the grid at a position.
+    CGridNode interpolate(const CGridNode* base, int stride, int i, int j, float u, float v) const; ///< Interpolate inside one cell.
+
+  public:
+    CGravityGrid(); ///< Constructor.
+    ~CGravityGrid(); ///< Destructor.
+
+    void build(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& gm, float softening, const Vector2& world_size); ///< Build the grid.
+    void build_async(const std::vector<float>& x, const std::vector<float>& y, const std::vector<float>& gm, float softening, const Vector2& world_size); ///< Build the grid on a background thread.
+    void clear(); ///< Stop any build in progress and throw the grid away.
+
+    bool field(const Vector2& pos, Vector2& result) const; ///< Look up the gravitational field at a position.
+    bool potential(const Vector2& pos, float& result) const; ///< Look up the gravitational potential at a position.
+
+    void set_interpolation(eInterpolation e) { m_eInterpolation = e; }; ///< Set the interpolation. Set it before building, since refinement is tested with it.
+    void set_cell_size(float size) { m_fCellSize = size; }; ///< Set the coarse cell size for the next build.
+    void set_tolerance(float tolerance) { m_fTolerance = tolerance; }; ///< Set the refinement tolerance for the next build.
+
+    bool ready() const { return m_bReady.load(std::memory_order_acquire); }; ///< Whether the grid can be used.
+    float build_time() const { return m_fBuildTime; }; ///< Seconds taken by the last build.
+    size_t patch_count() const { return m_vPatchNodes.size()/(PATCH_STRIDE*PATCH_STRIDE); }; ///< Number of refined cells.
+    size_t memory() const; ///< Bytes used by the grid.
+}; //CGravityGrid
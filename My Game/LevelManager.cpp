@@ -41,7 +41,15 @@ void CLevelManager::LoadMap(string filename){
     int AICounted = 0;
 
     vector<CPlanetObject*> planets; //vector of planets to reference for the tanks
+    vector<CPlanetDesc> planet_descs; //planets read but not made yet
 
+    //Make the planets read so far, all at once so that their terrain is generated in parallel.
+    auto create_planets = [&]() {
+        vector<CPlanetObject*> created;
+        m_pObjectManager->create_planets(planet_descs, created);
+        planets.insert(planets.end(), created.begin(), created.end());
+        planet_descs.clear();
+    };
 
 
     string line;
@@ -69,15 +77,20 @@ void CLevelManager::LoadMap(string filename){
             std::istringstream iss(line); //create string stream
             if (!(iss >> s >> xPos >> yPos >> mass >> radius)) { break; }
 
-            CPlanetObject* p = m_pObjectManager->create_planet(Vector2(xPos, yPos), mass, radius);
-
-            planets.push_back(p);
+            CPlanetDesc desc;
+            desc.m_vPos = Vector2(xPos, yPos);
+            desc.m_fMass = mass;
+            desc.m_nRadius = (int)radius;
+            planet_descs.push_back(desc); //made when the first tank needs them, or at the end
 
         }
         else if (line.substr(0, 4) == "TANK") { //line is tank info
             //create planets before tanks!
             //format: TANK <angle> <planet no.> <color> <player?>
 
+            if (!planet_descs.empty())
+                create_planets();
+
             if (tPlayers > 0)
                 tPlayers--;
             else
@@ -136,6 +149,9 @@ void CLevelManager::LoadMap(string filename){
     
     }
 
+    if (!planet_descs.empty())
+        create_planets();
+
 } //LoadMap (string overload)
 
 void CLevelManager::LoadMap(int level_number) {
@@ -471,7 +487,6 @@ void CLevelManager::LoadMap(int level_number) {
       float angle;
       CPlanetObject* planet_pointer;
       XMFLOAT4 color;
-      BoundingSphere bs;
       bool intersects = false;
 
       //back button
@@ -487,18 +502,18 @@ void CLevelManager::LoadMap(int level_number) {
       }
 
       //Create Random Planets
-      vector<CPlanetObject*> planets;
+      //They are laid out first and made all at once, so that their terrain is generated in parallel. The terrain doesn't
+      //exist yet to test against, so new planets are kept clear of the highest that the terrain of the others can be.
+      vector<CPlanetDesc> planet_descs;
       for (int i = 0; i < num_planets; i++) {
         //Find planet parameters
         do {
           intersects = false; //Trying new coordinates. We don't know if they intersect or not
           location = center + m_pRandom->randn(world_radius/12, world_radius / 8) * m_pRandom->randv(); //We want planets clustered near the center. So start at center, choose a random angle, go at most 1/4 of the worldsize away.
           radius = m_pRandom->randn(500, 1500);
-          bs.Center = Vector3(location.x, location.y, 0);
-          bs.Radius = radius;
           //Make sure that this does not intersect an already existing planet.
-          for (auto planet : planets) {
-            if (planet->Intersects(bs)) {
+          for (const CPlanetDesc& other : planet_descs) {
+            if ((location - other.m_vPos).Length() <= radius + CPlanetObject::get_altitude_limit(other.m_nRadius)) {
               intersects = true;
               break;
             }
@@ -506,9 +521,16 @@ void CLevelManager::LoadMap(int level_number) {
         } while (intersects);
 
         mass = powf((float)radius, 3.f) * 100.f / powf(900.f, 3.f); // Mass is proportional to radius cubed. This constant is so that a radius 900 planet has a mass of 100. In play testing, this is a good size.
-        planets.push_back(m_pObjectManager->create_planet(location, (double)mass, radius));
+        CPlanetDesc desc;
+        desc.m_vPos = location;
+        desc.m_fMass = (double)mass;
+        desc.m_nRadius = radius;
+        planet_descs.push_back(desc);
       }
 
+      vector<CPlanetObject*> planets;
+      m_pObjectManager->create_planets(planet_descs, planets);
+
       //Players
       vector<std::shared_ptr<CTankObject>> players;
       for (int i = 0; i < num_tanks; i++) {
@@ -6,9 +6,13 @@
 #include "GameDefines.h"
 #include "Particle.h"
 #include "ParticleEngineScaling.h"
+#include "ObjectManager.h"
+#include "Deterministic.h"
 
 std::vector<XMFLOAT4> colors = { XMFLOAT4(Colors::Red),XMFLOAT4(Colors::Purple),XMFLOAT4(Colors::Blue),XMFLOAT4(Colors::Green),XMFLOAT4(Colors::Black) };
 
+unsigned CObject::m_nNextSerial = 0;
+
 
 /// Create and initialize an object given its sprite type
 /// and initial position.
@@ -18,6 +22,10 @@ std::vector<XMFLOAT4> colors = { XMFLOAT4(Colors::Red),XMFLOAT4(Colors::Purple),
 CObject::CObject(eSpriteType t, const Vector2& p){ 
   m_nSpriteIndex = t;
   m_vPos = p; 
+  m_dPos = p;
+  m_vOldPos = p; //hasn't moved yet
+  m_dOldPos = p;
+  m_nSerial = m_nNextSerial++;
 
   m_pRenderer->GetSize(t, m_vRadius.x, m_vRadius.y);
   m_vRadius *= 0.5f;
@@ -27,6 +35,10 @@ CObject::CObject(eSpriteType t, const Vector2& p){
 
   m_Sphere.Radius = max(m_vRadius.x, m_vRadius.y);
   m_Sphere.Center = (Vector3)m_vPos;
+
+  if(t == PLAYER_SPRITE)SetCollisionLayer(TANK_LAYER);
+  else if(t == TURRET_SPRITE)SetCollisionLayer(TURRET_LAYER);
+  else SetCollisionLayer(DEBRIS_LAYER);
   
   m_fGunTimer = m_pStepTimer->GetTotalSeconds();
   //smoke_color = XMFLOAT4(Colors::Red);
@@ -37,27 +49,54 @@ CObject::CObject(eSpriteType t, const Vector2& p){
 /// Move and update all bounding shapes.
 /// The player object gets moved by the controller, everything
 /// else moves an amount that depends on its velocity and the
-/// frame time.
+/// frame time. Moving is split into BeginMove, Integrate and EndMove
+/// so that CObjectManager can run the middle part on worker threads.
 
 void CObject::move(){
-  m_vOldPos = m_vPos;
+  if(!BeginMove())return;
   m_pStepTimer->SetFixedTimeStep(true);
-  const float t = m_pStepTimer->GetElapsedSeconds();
+  Integrate(m_pStepTimer->GetElapsedSeconds());
+  EndMove();
+} //move
+
+/// Update the position and velocity by one frame, and the bounding
+/// sphere to match. This writes nothing but the object's own state, and
+/// reads nothing that changes while objects are moving, so it may be
+/// called for many objects at once from different threads. In a large
+/// world the position is moved in double precision and rounded to m_vPos
+/// afterwards. Code that sets m_vPos directly, such as a wormhole, is
+/// noticed here and m_dPos follows it.
+/// \param t Frame time.
+
+void CObject::Integrate(float t){
+  if(Vector2(m_dPos) != m_vPos) //somebody moved us behind our back
+    m_dPos = m_vPos;
+
+  m_vOldPos = m_vPos;
+  m_dOldPos = m_dPos;
   
+  if(m_pObjectManager->get_large_world()){
+    if(affected_by_gravity)
+      m_vAcceleration = m_pObjectManager->advance(m_dPos, m_vVelocity, m_Sphere.Radius, t);
+    else m_dPos += m_vVelocity * t;
+    m_vPos = Vector2(m_dPos);
+  } //if
 
-  if (affected_by_gravity) {
-    // Calculate effect of gravity for all the gravationally affected objects
-    // TODO: implement orbit calculation if only one source of gravity. Analytic astrodynamics solutions are more stable than numerical integration. Patched Conics may be good enough.
-    // SetVelocity(GetVelocity() + calculate_gravity(p->GetPos()));
-    m_vPos += m_vVelocity * t;// + m_vAcceleration * t * t;
-  }
-  else m_vPos += m_vVelocity * t;// + m_vAcceleration * t*t;
+  else{
+    if (affected_by_gravity) {
+      // Calculate effect of gravity for all the gravationally affected objects
+      m_vAcceleration = m_pObjectManager->advance(m_vPos, m_vVelocity, m_Sphere.Radius, t); //updates both position and velocity, in smaller steps near planets
+    }
+    else m_vPos += m_vVelocity * t;// + m_vAcceleration * t*t;
+    m_dPos = m_vPos;
+  } //else
 
   m_Sphere.Center = (Vector3)m_vPos; //update bounding sphere
-} //move
+} //Integrate
 
 void CObject::CollisionResponse(){
   m_vPos = m_vOldPos;
+  m_dPos = m_dOldPos;
 } //CollisionResponse
 
 
@@ -147,6 +186,23 @@ const Vector2& CObject::GetPos(){
   return m_vPos;
 } //GetPos
 
+/// Reader function for position in double precision.
+/// \return Position.
+
+const CVector2d& CObject::GetPrecisePos(){
+  return m_dPos;
+} //GetPrecisePos
+
+/// Writer function for position in double precision. Also sets
+/// the single precision position and the bounding sphere.
+/// \param pos Position.
+
+void CObject::SetPrecisePos(const CVector2d& pos){
+  m_dPos = pos;
+  m_vPos = Vector2(pos);
+  m_Sphere.Center = (Vector3)m_vPos;
+} //SetPrecisePos
+
 /// Reader function for speed.
 /// \return Speed.
 
@@ -158,7 +214,7 @@ float CObject::GetSpeed(){
 /// \return The view vector.
 
 Vector2 CObject::GetViewVector(){
-  return Vector2(-sinf(m_fRoll), cosf(m_fRoll));
+  return Vector2(-det_sin(m_fRoll), det_cos(m_fRoll));
 } //GetViewVector
 
 /// Reader function for the orientation. A 2D object's
@@ -247,4 +303,25 @@ void CObject::EmitSmoke() {
 
 bool CObject::GetIsBullet() {
   return is_bullet;
-}
\ No newline at end of file
+}
+
+/// Put the object on a collision layer. The mask of the layers that it can
+/// collide with comes from a table of who responds to whom in the narrow
+/// phase, and is the same both ways round: if layer a has layer b in its
+/// mask, then layer b has layer a in its mask.
+/// \param layer The collision layer.
+
+void CObject::SetCollisionLayer(eCollisionLayer layer){
+  static const unsigned mask[NUM_COLLISION_LAYERS] = {
+    1u << TANK_LAYER | 1u << PLANET_LAYER | 1u << WORMHOLE_LAYER, //bullet
+    1u << PLANET_LAYER | 1u << WORMHOLE_LAYER, //phantom
+    1u << BULLET_LAYER | 1u << TURRET_LAYER, //tank
+    1u << BULLET_LAYER | 1u << PHANTOM_LAYER | 1u << TURRET_LAYER, //planet
+    1u << BULLET_LAYER | 1u << PHANTOM_LAYER, //wormhole
+    1u << TANK_LAYER | 1u << PLANET_LAYER, //turret
+    0 //debris
+  }; //mask
+
+  m_eCollisionLayer = layer;
+  m_nCollisionMask = mask[layer];
+} //SetCollisionLayer
\ No newline at end of file
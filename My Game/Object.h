@@ -12,6 +12,7 @@
 #include "Common.h"
 #include "Component.h"
 #include "SpriteDesc.h"
+#include "Vector2d.h"
 
 /// \brief The game object. 
 ///
@@ -38,6 +39,8 @@ protected:
     float m_fSpeed = 0; ///< Speed.
     float m_fRotSpeed = 0; ///< Rotational speed.
     Vector2 m_vOldPos; ///< Last position.
+    CVector2d m_dPos; ///< Position in double precision. m_vPos is this rounded to single precision.
+    CVector2d m_dOldPos; ///< Last position in double precision.
     Vector2 m_vVelocity; ///< Velocity.
     Vector2 m_vAcceleration;
     bool m_bDead = false; ///< Is dead or not.
@@ -50,6 +53,12 @@ protected:
 
     bool is_bullet = false;
 
+    unsigned m_nSerial = 0; ///< Order that the object was created in, which collision events are resolved in.
+    static unsigned m_nNextSerial; ///< Serial number for the next object. Reset when the level is cleared.
+
+    eCollisionLayer m_eCollisionLayer = DEBRIS_LAYER; ///< Collision layer.
+    unsigned m_nCollisionMask = 0; ///< Collision layers that this object can collide with, one bit per layer.
+
     float m_vOldEnergy = -1; ///< Initial total mechanical energy of the object. -1 means that the energy was never calculated. Used for debugging physics precision.
 
     //C++ has this annoying "feature" where the modulus of a negative number can still be negative. Adding the quotient once then taking the modulus fixes this.
@@ -64,6 +73,9 @@ protected:
     CObject(eSpriteType t, const Vector2& p); ///< Constructor.
 
     virtual void move(); ///< Move object.
+    virtual bool BeginMove() { return true; }; ///< Whatever has to be done before moving. Returns false if the object isn't to move this frame.
+    void Integrate(float t); ///< Update the position and velocity. Safe to call from a worker thread.
+    virtual void EndMove() {}; ///< Whatever has to be done after moving.
 
     virtual void kill(); ///< Kill me.
     bool IsDead(); ///< Query whether dead.
@@ -93,13 +105,21 @@ protected:
     
     const BoundingSphere& GetBoundingSphere(); ///< Get bounding sphere.
     const Vector2& GetPos(); ///< Get position.
+    const CVector2d& GetPrecisePos(); ///< Get position in double precision.
+    void SetPrecisePos(const CVector2d& pos); ///< Set position in double precision.
 
     double GetMass() { return mass; }; ///< Get the mass
+    bool GetAffectedByGravity() const { return affected_by_gravity; }; ///< Whether gravity moves it.
 
     void EmitSmoke();
 
     bool GetIsBullet();
 
+    void SetCollisionLayer(eCollisionLayer layer); ///< Set the collision layer, and the mask that goes with it.
+    eCollisionLayer GetCollisionLayer() const { return m_eCollisionLayer; }; ///< Get the collision layer.
+    bool CollidesWith(const CObject* p) const { return (m_nCollisionMask & (1u << p->m_eCollisionLayer)) != 0; }; ///< Whether an object is on a layer that this one can collide with.
+    unsigned GetSerial() const { return m_nSerial; }; ///< Get the order that the object was created in.
+
     float get_mass() { return (float)mass; };
 }; //CObject
 
@@ -2,9 +2,20 @@
 /// \brief Code for the the object manager class CObjectManager.
 
 #include "ObjectManager.h"
+#include "ConicOrbit.h"
 #include "ComponentIncludes.h"
 #include "ParticleEngineScaling.h"
 #include <memory>
+#include <climits>
+#include <cfloat>
+#include <algorithm>
+#include "Deterministic.h"
+
+/// Where advance_any counts its planet tests while objects are being
+/// integrated on this thread, one for each planet, so that no two threads
+/// write the same planet's counters. Null outside of move_gravity_objects,
+/// where the planets count them themselves.
+static thread_local std::vector<CSectorStats>* t_pSubstepStats = nullptr;
 
 
 CObjectManager::CObjectManager(){
@@ -30,14 +41,16 @@ CObjectManager::~CObjectManager(){
 
 CObject* CObjectManager::create(eSpriteType t, const Vector2& v, double mass, bool affected_by_gravity){
   CObject* p = new CObject(t, v); 
+  p->affected_by_gravity = affected_by_gravity; //before the gravity field sees it, so that it knows whether it moves
+
   // Add to the list of massive objects if it has mass. I.E. it should affect the gravitational field
   if (mass) {
     p->mass = mass;
     m_massive_objects.push_back(p);
+    m_gravity_field.rebuild(m_massive_objects, gravitational_constant, softening_parameter);
   }
 
   // Add to the list of objects affected by gravity, if appropriate.
-  p->affected_by_gravity = affected_by_gravity;
   if (affected_by_gravity) {
     m_objects_affected_by_gravity.push_back(p);
   }
@@ -46,24 +59,61 @@ CObject* CObjectManager::create(eSpriteType t, const Vector2& v, double mass, bo
 } //create
 
 CPlanetObject* CObjectManager::create_planet(const Vector2& p, double mass, int radius, bool affected_by_gravity) {
-  CPlanetObject* planet = new CPlanetObject(p, radius);
-  if (mass) {
-    planet->mass = mass;
-    m_massive_objects.push_back(planet);
-  }
-  planet->affected_by_gravity = affected_by_gravity;
-  if (affected_by_gravity) {
-    m_objects_affected_by_gravity.push_back(planet);
-  }
-
-  m_planets_list.push_back(planet);
-  return planet;
+  CPlanetDesc desc;
+  desc.m_vPos = p;
+  desc.m_fMass = mass;
+  desc.m_nRadius = radius;
+  desc.m_bAffectedByGravity = affected_by_gravity;
+
+  std::vector<CPlanetObject*> planets;
+  create_planets(std::vector<CPlanetDesc>(1, desc), planets);
+  return planets[0];
 }
 
+/// Create a batch of planets. Each gets a terrain seed from the game's
+/// generator, in order, so seeding it still reproduces the level. Then
+/// their terrain is generated on the worker pool, a planet at a time, and
+/// the gravity field is rebuilt once for the lot.
+/// \param descs What to make each planet with.
+/// \param result [out] The planets, in the same order.
+
+void CObjectManager::create_planets(const std::vector<CPlanetDesc>& descs, std::vector<CPlanetObject*>& result){
+  result.resize(descs.size());
+  for(size_t i=0; i<descs.size(); i++)
+    result[i] = new CPlanetObject(descs[i].m_vPos, descs[i].m_nRadius, (unsigned)m_pRandom->randn(0, INT_MAX), true);
+
+  m_cWorkerPool.run(result.size(), 1, [&result](size_t begin, size_t end){
+    for(size_t i=begin; i<end; i++)
+      result[i]->generate();
+  });
+
+  bool massive = false;
+  for(size_t i=0; i<descs.size(); i++){
+    CPlanetObject* planet = result[i];
+    planet->affected_by_gravity = descs[i].m_bAffectedByGravity; //planets that orbit under the others, see move_massive_objects
+
+    if(descs[i].m_fMass){
+      planet->mass = descs[i].m_fMass;
+      m_massive_objects.push_back(planet);
+      massive = true;
+    } //if
+
+    if(descs[i].m_bAffectedByGravity)
+      m_objects_affected_by_gravity.push_back(planet);
+
+    m_planets_list.push_back(planet);
+    m_cSurfaceIndex.add_planet(planet);
+  } //for
+
+  if(massive)
+    m_gravity_field.rebuild(m_massive_objects, gravitational_constant, softening_parameter);
+} //create_planets
+
 std::shared_ptr<CTankObject> CObjectManager::create_tank(float angle_relative_to_planet, CPlanetObject* home_planet) {
   std::shared_ptr<CTankObject> tank(new CTankObject(angle_relative_to_planet, home_planet));
 
   m_tanks_list.push_back(tank);
+  m_cSurfaceIndex.add_tank(tank);
   return tank;
 }
 
@@ -127,13 +177,72 @@ void CObjectManager::clear(){
   m_massive_objects.clear();
   m_objects_affected_by_gravity.clear();
   m_wormholes_list.clear();
+  m_gravity_field.clear();
+  m_vCollisions.clear();
+  m_cSurfaceIndex.clear();
+  m_dTerrainHistory.clear();
+  CObject::m_nNextSerial = 0; //so that a level replays the same
 } //clear
 
+/// Take a snapshot of the terrain of every planet, which is as cheap as
+/// copying a pointer for each planet whose terrain hasn't changed since
+/// its last snapshot.
+/// \param result [out] The snapshots, in the same order as the planets.
+
+void CObjectManager::snapshot_terrain(std::vector<CTerrainSnapshot>& result){
+  result.clear();
+  for(CPlanetObject* planet: m_planets_list)
+    result.push_back(planet->get_terrain_snapshot());
+} //snapshot_terrain
+
+/// Put the terrain of every planet back the way it was in a set of
+/// snapshots from snapshot_terrain. Planets made since then have no
+/// snapshot, and are left alone.
+/// \param snapshots The snapshots, in the same order as the planets.
+/// \return Number of chunks of altitudes that had to be copied back.
+
+int CObjectManager::restore_terrain(const std::vector<CTerrainSnapshot>& snapshots){
+  int restored = 0;
+  size_t i = 0;
+  for(CPlanetObject* planet: m_planets_list){
+    if(i >= snapshots.size())break;
+    restored += planet->restore_terrain(snapshots[i++]);
+  } //for
+  return restored;
+} //restore_terrain
+
+/// Save the terrain of every planet, such as at the start of a turn, so
+/// that it can be rewound to. Only the oldest saves past
+/// MAX_TERRAIN_HISTORY are forgotten, and since the saves share the chunks
+/// that didn't change between them, each costs about as much as the
+/// craters made since the one before.
+
+void CObjectManager::save_terrain(){
+  m_dTerrainHistory.emplace_back();
+  snapshot_terrain(m_dTerrainHistory.back());
+  if(m_dTerrainHistory.size() > MAX_TERRAIN_HISTORY)
+    m_dTerrainHistory.pop_front();
+} //save_terrain
+
+/// Put the terrain back to how it was at the last save, which is the
+/// start of this turn if the terrain is saved at the start of every turn,
+/// and forget that save, so that rewinding again goes back a turn further.
+/// The oldest save is never forgotten.
+/// \return true if there was a save to go back to.
+
+bool CObjectManager::rewind_terrain(){
+  if(m_dTerrainHistory.empty())return false;
+  restore_terrain(m_dTerrainHistory.back());
+  if(m_dTerrainHistory.size() > 1)
+    m_dTerrainHistory.pop_back();
+  return true;
+} //rewind_terrain
+
 /// Draw the objects in the object list.
 
 void CObjectManager::draw(){
   for (auto const& p : m_stdObjectList) //for each object
-    m_pRenderer->Draw(*(CSpriteDesc2D*)p);
+    m_pRenderer->Draw(*(CSpriteDesc2D*)p, p->m_dPos);
  
   for (auto const& p : m_planets_list)
     p->draw_planet();
@@ -179,6 +288,7 @@ bool CObjectManager::AtWorldEdge(Vector2& pos) {
 
 void CObjectManager::move(){
     const float dt = m_pStepTimer->GetElapsedSeconds();
+    m_gravity_field.update_positions(); //massive objects may have moved last frame
     for (auto const& p : m_stdObjectList) { //for each object
         const Vector2 oldpos = p->m_vPos; //its old position
         
@@ -249,31 +359,7 @@ void CObjectManager::move(){
 
     }
 
-    // Calculate effect of gravity for all the gravationally affected objects
-    for (auto const& p : m_objects_affected_by_gravity) {
-      if (p->GetIsBullet() && AtWorldEdge(p)) {
-        p->kill();
-        m_pAudio->play(RICOCHET_SOUND);
-      } //if
-      p->SetAcceleration(calculate_gravity(p->GetPos()));
-
-      
-
-      OutputDebugStringA((to_string(p->GetAcceleration().Length()) + "\n").c_str());
-      p->SetVelocity(p->GetVelocity() + p->GetAcceleration()*dt);
-
-      Vector2 pos = p->GetPos();
-      Vector2 acc = p->GetAcceleration();
-      Vector2 vel = p->GetVelocity();
-      int c = 0;
-
-      // Having the objects move AFTER calculating what their velocity should be on the next time step seems to improve numerical stability of simulations
-      // This makes a certain amount of sense. This effectively is a crude Semi-implicit Euler integration, as opposed to the naive Euler integration it was doing before.
-      // It's still not 100% accurate, but at least in 2 body systems, elliptical orbits stay elliptical and do not precess (rotate) as quickly as they were before!
-      // I'll take the appearance of accuracy over blatant inaccuracy.
-      p->move(); //move it
-
-    }
+    move_gravity_objects(); // Calculate effect of gravity for all the gravationally affected objects
 
     
 
@@ -285,6 +371,7 @@ void CObjectManager::move(){
     if (!m_bTurnsEnabled)
       p->Think();
     p->move(); //move it
+    m_cSurfaceIndex.update_tank(p.get()); //cheap if it didn't change longitude
   }
 
   //now do object-object collision detection and response and
@@ -294,6 +381,129 @@ void CObjectManager::move(){
   CullDeadObjects(); //remove dead objects from object list
 } //move
 
+/// Move everything that is affected by gravity, in three phases. First,
+/// one at a time, whatever can kill, create, explode or make a noise:
+/// going off the edge of the world, running out of time, and the things
+/// that bullets do in flight (see CBulletObject::BeginMove). Bullets
+/// created then are appended to the list and go through the same phase.
+/// Then the positions and velocities are integrated in chunks on the
+/// worker pool, which is the expensive part, and touches nothing but
+/// each object's own state. Anything with mass is moved after that on
+/// this thread, all together (see move_massive_objects), so that no planet
+/// moves while the others are reading its position. Last, one at a time again and in list order,
+/// the smoke trails and whatever else EndMove does. Since nothing in the
+/// middle phase depends on the order the objects are done in, the
+/// results are the same with any number of threads.
+
+void CObjectManager::move_gravity_objects() {
+  m_vMoving.clear();
+  for (auto const& p : m_objects_affected_by_gravity) {
+    if (p->GetIsBullet() && AtWorldEdge(p)) {
+      p->kill();
+      m_pAudio->play(RICOCHET_SOUND);
+    } //if
+
+    if (p->BeginMove())
+      m_vMoving.push_back(p);
+  } //for
+
+  // The position and velocity are both updated in Integrate(), by whichever integrator is selected (see integrate()).
+  // Updating the velocity here and the position there was a crude Semi-implicit Euler integration, which is still available,
+  // but the symplectic integrators of higher order keep orbits closed at the same step size.
+  m_pStepTimer->SetFixedTimeStep(true);
+  const float t = m_pStepTimer->GetElapsedSeconds();
+  m_vSubstepStats.assign(m_planets_list.size(), CSectorStats());
+  m_cWorkerPool.run(m_vMoving.size(), MIN_CHUNK, [this, t](size_t begin, size_t end) {
+    std::vector<CSectorStats> stats(m_planets_list.size()); //counted here and added once, since other threads may be counting too
+    t_pSubstepStats = &stats;
+    for (size_t i = begin; i < end; i++)
+      if (m_vMoving[i]->mass == 0)
+        m_vMoving[i]->Integrate(t);
+    t_pSubstepStats = nullptr;
+
+    std::lock_guard<std::mutex> lock(m_mSubstepStats);
+    for (size_t k = 0; k < stats.size(); k++)
+      m_vSubstepStats[k].add(stats[k]);
+  });
+
+  size_t k = 0; //back on this thread, so the planets' own counters can be written
+  for (auto const& planet : m_planets_list)
+    planet->add_sector_stats(m_vSubstepStats[k++]);
+
+  move_massive_objects(t); //planets last, since everything else reads their positions
+
+  for (auto const& p : m_vMoving) {
+    p->EndMove();
+    OutputDebugStringA((to_string(p->GetAcceleration().Length()) + "\n").c_str());
+  } //for
+} //move_gravity_objects
+
+/// Move the massive objects that are affected by gravity, which are
+/// orbiting planets, under each other's pull and that of the fixed ones.
+/// They are stepped all together with kick-drift-kick leapfrog, which is
+/// symplectic, so that orbits neither spiral in nor out however long the
+/// game goes on: half a kick from the field before anything moves, a drift
+/// over the whole frame, and the other half kick from the field once
+/// everything has moved. A body sits exactly on its own entry in the
+/// gravity field, so it doesn't pull on itself. Only the moving bodies
+/// have to be copied into the gravity field after the drift, since the
+/// fixed ones are cached separately (see CGravityField).
+/// \param t Length of the frame.
+
+void CObjectManager::move_massive_objects(float t) {
+  m_vMassive.clear();
+  for (auto const& p : m_vMoving)
+    if (p->mass != 0)
+      m_vMassive.push_back(p);
+  if (m_vMassive.empty())return;
+
+  for (auto const& p : m_vMassive) { //half kick
+    if (Vector2(p->m_dPos) != p->m_vPos) //somebody moved it behind our back
+      p->m_dPos = p->m_vPos;
+    p->m_vVelocity += 0.5f * t * m_gravity_field.field(p->m_vPos);
+  } //for
+
+  for (auto const& p : m_vMassive) { //drift
+    p->m_vOldPos = p->m_vPos;
+    p->m_dOldPos = p->m_dPos;
+    p->SetPrecisePos(p->m_dPos + CVector2d(p->m_vVelocity * t));
+  } //for
+
+  m_gravity_field.update_positions();
+
+  for (auto const& p : m_vMassive) { //half kick
+    p->m_vAcceleration = m_gravity_field.field(p->m_vPos);
+    p->m_vVelocity += 0.5f * t * p->m_vAcceleration;
+  } //for
+
+  m_nIntegrationSteps += m_vMassive.size();
+
+  for (CPlanetObject* planet : m_planets_list)
+    if (planet->m_dPos != planet->m_dOldPos && planet->affected_by_gravity)
+      planet_moved(planet);
+} //move_massive_objects
+
+/// Bring whatever hangs off a planet along after it moves. The terrain
+/// and the sector tables are all relative to the planet's center, so they
+/// don't change. The sphere around the highest hill is moved with it, the
+/// surface index is told where it is, and the tanks on it are moved by
+/// the same amount so that they stay at the same height above the ground,
+/// and don't think that they are falling the next time that they move.
+/// \param planet The planet.
+
+void CObjectManager::planet_moved(CPlanetObject* planet) {
+  const CVector2d shift = planet->m_dPos - planet->m_dOldPos;
+  planet->maximum_altitude_sphere.Center = planet->m_Sphere.Center;
+  m_cSurfaceIndex.update_planet(planet);
+
+  m_cSurfaceIndex.tanks_on_planet(planet, m_vNearTanks);
+  for (CTankObject* tank : m_vNearTanks) {
+    tank->m_dOldPos += shift;
+    tank->m_vOldPos = Vector2(tank->m_dOldPos);
+    tank->SetPrecisePos(tank->m_dPos + shift);
+  } //for
+} //planet_moved
+
 /// Create a bullet object and a flash particle effect.
 /// It is assumed that the object is round and that the bullet
 /// appears at the edge of the object in the direction
@@ -339,8 +549,16 @@ void CObjectManager::FireGun(CObject* pObj, eSpriteType bullet){
 /// \param sphere BoundingSphere representing the explosion
 /// \param damage how much to damage players.
 void CObjectManager::DamagePlayersInSphere(BoundingSphere sphere, int damage) {
+  if (m_bSurfaceIndex) { //only the tanks near enough in longitude to be worth testing, in the same order as the list
+    m_cSurfaceIndex.tanks_in_sphere(Vector2(sphere.Center.x, sphere.Center.y), sphere.Radius, m_vNearTanks);
+    for (CTankObject* tank : m_vNearTanks)
+      if (det_intersects(sphere, tank->m_Sphere))
+        tank->take_damage(damage);
+    return;
+  }
+
   for (auto tank : m_tanks_list) {
-    if (sphere.Intersects(tank->m_Sphere)) {
+    if (det_intersects(sphere, tank->m_Sphere)) {
       tank->take_damage(damage);
     }
   }
@@ -360,16 +578,21 @@ void CObjectManager::CullDeadObjects(){
 
     else ++i; //advance to next object
   } //for
+  bool massive_object_died = false;
   for (auto i = m_massive_objects.begin(); i != m_massive_objects.end();) {
     if ((*i)->IsDead()) { //"He's dead, Dave." --- Holly, Red Dwarf
       i = m_massive_objects.erase(i); //remove from object list and advance to next object
+      massive_object_died = true;
     } //if
 
     else ++i; //advance to next object
   } //for
+  if (massive_object_died) //keep the packed copy in step with the list
+    m_gravity_field.rebuild(m_massive_objects, gravitational_constant, softening_parameter);
 
   for (auto i = m_tanks_list.begin(); i != m_tanks_list.end();) {
     if ((*i)->IsDead()) { //"He's dead, Dave." --- Holly, Red Dwarf
+      m_cSurfaceIndex.remove_tank(i->get());
       i->reset(); //delete object
       i = m_tanks_list.erase(i); //remove from object list and advance to next object
     } //if
@@ -393,72 +616,203 @@ void CObjectManager::CullDeadObjects(){
   } //for
 } //CullDeadObjects
 
-/// Perform collision detection and response for all pairs
-/// of objects in the object list, making sure that each
-/// pair is processed only once.
+/// Perform collision detection for all pairs of objects in the object
+/// list, making sure that each pair is processed only once, then between
+/// the tanks, planets and wormholes and the objects in the list. The
+/// narrow phase only queues what it finds, and nothing responds until
+/// all of the detection is done, so what is found doesn't depend on what
+/// was found before it in the same frame.
 
 void CObjectManager::BroadPhase(){
+  m_cCollisionStats.m_nFrames++;
+
+  if(m_bSpatialHash)
+    BroadPhaseHashed();
+  else BroadPhaseAllPairs();
+
+  ResolveCollisions();
+} //BroadPhase
+
+/// Check whether a pair of objects are on collision layers that can
+/// collide, before anything is done with where they are. Pairs that can't
+/// are counted by layer in m_cCollisionStats, and so are the ones that can.
+/// \param p0 Pointer to the first object.
+/// \param p1 Pointer to the second object.
+/// \return true if the pair needs to go to the narrow phase.
+
+bool CObjectManager::LayersCollide(const CObject* p0, const CObject* p1){
+  const eCollisionLayer l0 = p0->GetCollisionLayer();
+  const eCollisionLayer l1 = p1->GetCollisionLayer();
+
+  if(m_bCollisionLayers && !p0->CollidesWith(p1)){
+    m_cCollisionStats.m_nSkipped[l0][l1]++;
+    return false;
+  } //if
+
+  m_cCollisionStats.m_nTested[l0][l1]++;
+  return true;
+} //LayersCollide
+
+/// Send a pair of objects to the narrow phase, unless they are on
+/// collision layers that can't collide.
+/// \param p0 The first object, which picks the NarrowPhase overload.
+/// \param p1 Pointer to the second object.
+
+template<class P> void CObjectManager::TestPair(P p0, CObject* p1){
+  if(!LayersCollide(&*p0, p1))return;
+  m_nPairTests++;
+  m_nPairHits += NarrowPhase(p0, p1);
+} //TestPair
+
+/// Send a planet and an object to the narrow phase, unless the object
+/// is a bullet and bullets are being batched, in which case it waits in
+/// m_vPlanetBullets for NarrowPhaseBatch. Either way, pairs on layers
+/// that can't collide are dropped here.
+/// \param p0 Pointer to the planet.
+/// \param p1 Pointer to the object.
+
+void CObjectManager::QueuePlanetPair(CPlanetObject* p0, CObject* p1){
+  if(!m_bPlanetBatches || !p1->GetIsBullet())
+    TestPair(p0, p1);
+
+  else if(LayersCollide(p0, p1))
+    m_vPlanetBullets.push_back((CBulletObject*)p1);
+} //QueuePlanetPair
+
+/// The broad phase the hard way, testing every pair.
+
+void CObjectManager::BroadPhaseAllPairs(){
   //Iterate over objects
   for(auto i=m_stdObjectList.begin(); i!=m_stdObjectList.end(); i++){
     for(auto j=next(i); j!=m_stdObjectList.end(); j++)
-      NarrowPhase(*i, *j);
+      TestPair(*i, *j);
   } //for
 
   //Iterate over the tanks
   for (auto i = m_tanks_list.begin(); i != m_tanks_list.end(); i++) {
     for (auto j = m_stdObjectList.begin(); j != m_stdObjectList.end(); j++)
-      NarrowPhase(*i, *j);
+      TestPair(*i, *j);
   } //for
 
   //Iterate over planets
   for (auto i = m_planets_list.begin(); i != m_planets_list.end(); i++) {
     for (auto j = m_stdObjectList.begin(); j != m_stdObjectList.end(); j++)
-      NarrowPhase(*i, *j);
+      QueuePlanetPair(*i, *j);
+    NarrowPhaseBatch(*i);
   } //for
 
   //Iterate over wormholes
   for (auto i = m_wormholes_list.begin(); i != m_wormholes_list.end(); i++) {
       for (auto j = m_stdObjectList.begin(); j != m_stdObjectList.end(); j++)
-          NarrowPhase(*i, *j);
+          TestPair(*i, *j);
   } //for
 
-} //BroadPhase
+} //BroadPhaseAllPairs
+
+/// The broad phase using a spatial hash. The objects in the object list
+/// are filed in m_cSpatialHash by position, and only the pairs that it
+/// says might touch go to the narrow phase. The cells are a fixed fraction
+/// of the world across, but never narrower than the biggest object, so
+/// that an object can only touch objects in the cells around its own.
+/// Candidates are visited in the same order that BroadPhaseAllPairs
+/// visits them, so the two give the same responses in the same order.
+/// The hash is built from where things are at the start, so an object
+/// that a wormhole moves is still filed where it came from until the
+/// next frame.
+
+void CObjectManager::BroadPhaseHashed(){
+  m_vBroadObjects.assign(m_stdObjectList.begin(), m_stdObjectList.end());
+  m_vBroadCenters.resize(m_vBroadObjects.size());
+
+  float biggest = 0.0f; //radius of the biggest object
+  float furthest = 0.0f; //furthest that a bullet has moved this frame
+  for(size_t k=0; k<m_vBroadObjects.size(); k++){
+    CObject* p = m_vBroadObjects[k];
+    const BoundingSphere& s = p->m_Sphere;
+    m_vBroadCenters[k] = Vector2(s.Center.x, s.Center.y);
+    biggest = max(biggest, s.Radius);
+    if(p->GetIsBullet())
+      furthest = max(furthest, (p->m_vPos - p->m_vOldPos).Length());
+  } //for
+
+  const float cell = max(2.0f*biggest, max(m_vWorldSize.x, m_vWorldSize.y)/HASH_CELLS_ACROSS);
+  m_cSpatialHash.build(m_vBroadCenters, max(cell, 1.0f));
+
+  //Iterate over objects
+  for(unsigned i=0; i<m_vBroadObjects.size(); i++){
+    m_cSpatialHash.neighbors(i, m_vCandidates);
+    for(unsigned j: m_vCandidates)
+      TestPair(m_vBroadObjects[i], m_vBroadObjects[j]);
+  } //for
+
+  //Iterate over the tanks
+  for(auto& p: m_tanks_list){
+    m_cSpatialHash.query(Vector2(p->m_Sphere.Center.x, p->m_Sphere.Center.y), p->m_Sphere.Radius, m_vCandidates);
+    for(unsigned j: m_vCandidates)
+      TestPair(p, m_vBroadObjects[j]);
+  } //for
+
+  //Iterate over planets, out to the tops of their highest hills, plus however far a bullet could have come from relative to the planet
+  for(CPlanetObject* p: m_planets_list){
+    const float r = max(p->m_Sphere.Radius, p->maximum_altitude_sphere.Radius) + furthest + (p->m_vPos - p->m_vOldPos).Length();
+    m_cSpatialHash.query(Vector2(p->m_Sphere.Center.x, p->m_Sphere.Center.y), r, m_vCandidates);
+    for(unsigned j: m_vCandidates)
+      QueuePlanetPair(p, m_vBroadObjects[j]);
+    NarrowPhaseBatch(p);
+  } //for
 
-/// Perform collision detection and response for a pair of objects.
-/// We are talking about bullets hitting the player and the
-/// turrets here. When a collision is detected the response
-/// is to delete the bullet (i.e. mark its "is dead" flag)
-/// play a particle effect at the point of contact, and play one 
-/// sound for the player and another for the turrets.
+  //Iterate over wormholes
+  for(CWormholeObject* p: m_wormholes_list){
+    m_cSpatialHash.query(Vector2(p->m_Sphere.Center.x, p->m_Sphere.Center.y), p->m_Sphere.Radius, m_vCandidates);
+    for(unsigned j: m_vCandidates)
+      TestPair(p, m_vBroadObjects[j]);
+  } //for
+} //BroadPhaseHashed
+
+/// Perform collision detection for a pair of objects. We are talking
+/// about the player hitting the turrets here. When a collision is
+/// detected, a response is queued for ResolveCollisions.
 /// \param p0 Pointer to the first object.
 /// \param p1 Pointer to the second object.
+/// \return true if they collided.
 
-void CObjectManager::NarrowPhase(CObject* p0, CObject* p1){
+bool CObjectManager::NarrowPhase(CObject* p0, CObject* p1){
   eSpriteType t0 = (eSpriteType)p0->m_nSpriteIndex;
   eSpriteType t1 = (eSpriteType)p1->m_nSpriteIndex;
 
-  if(p0->m_Sphere.Intersects(p1->m_Sphere)){ //bounding spheres intersect
+  if(det_intersects(p0->m_Sphere, p1->m_Sphere)){ //bounding spheres intersect
     if(t0 == PLAYER_SPRITE && t1 == TURRET_SPRITE) //player hits turret
-      p0->CollisionResponse();
+      QueueCollision(eCollisionEvent::OBJECT_RESPONSE, p0, p1);
 
     else if(t1 == PLAYER_SPRITE && t0 == TURRET_SPRITE) //turret hit by player
-      p1->CollisionResponse();
+      QueueCollision(eCollisionEvent::OBJECT_RESPONSE, p1, p0);
+
+    return true;
   } //if
+
+  return false;
 } //NarrowPhase
 
-void CObjectManager::NarrowPhase(CPlanetObject* p0, CObject* p1) {
+bool CObjectManager::NarrowPhase(CPlanetObject* p0, CObject* p1) {
   eSpriteType t0 = (eSpriteType)p0->m_nSpriteIndex;
   eSpriteType t1 = (eSpriteType)p1->m_nSpriteIndex;
 
+  if (p1->GetIsBullet()) { //sweep it along the way it came this frame, so that fast ones can't go through a hill. Only when bullets aren't batched.
+    float toi;
+    Vector2 contact;
+    const Vector2 shift = p0->m_vPos - p0->m_vOldPos; //in the planet's frame, in case it moved too
+    if (!p0->Sweep(p1->m_vOldPos + shift, p1->m_vPos, p1->m_Sphere.Radius, toi, contact))
+      return false;
+
+    QueueCollision(eCollisionEvent::BULLET_PLANET, p0, p1, toi);
+    return true;
+  } //if
+
   if (p0->Intersects(p1->m_Sphere)) { //bounding spheres intersect
-    if (p1->GetIsBullet()) {
-      CBulletObject* bullet = (CBulletObject*)p1;
-      bullet->kill(p0);
-    }//if
-    else if (t1 == TURRET_SPRITE) {
-      Vector2 unit_normal = p0->GetPos() - p1->GetPos();
-      unit_normal.Normalize();
-      p1->CollisionReflectionResponse(unit_normal);
+    if (t1 == TURRET_SPRITE) {
+      Vector2 unit_normal; //the slope where it hit, not just straight up
+      p0->get_signed_distance(p1->GetPos(), unit_normal);
+      QueueCollision(eCollisionEvent::TURRET_PLANET, p0, p1, 0, unit_normal);
     }//else if
 
     /*if (t0 == PLAYER_SPRITE && t1 == TURRET_SPRITE) //player hits turret
@@ -486,75 +840,688 @@ void CObjectManager::NarrowPhase(CPlanetObject* p0, CObject* p1) {
       m_pAudio->play(OW_SOUND);
       p1->kill();
     } //else if*/
+
+    return true;
   } //if
+
+  return false;
 } //NarrowPhase
 
-void CObjectManager::NarrowPhase(std::shared_ptr<CTankObject> p0, CObject* p1) {
+/// Sweep all of the bullets held back for a planet against it in one go,
+/// and queue the hits. Nothing is resolved until the broad phase is done,
+/// so every bullet is swept against the terrain as it was at the start
+/// of the frame, however it was batched. A planet that moved this frame
+/// is swept against in its own frame, by moving the start of each bullet's
+/// step along with it.
+/// \param p0 Pointer to the planet.
+
+void CObjectManager::NarrowPhaseBatch(CPlanetObject* p0){
+  const size_t n = m_vPlanetBullets.size();
+  if(n == 0)return;
+
+  m_vSweepFrom.resize(n);
+  m_vSweepTo.resize(n);
+  m_vSweepRadius.resize(n);
+  m_vSweepToi.resize(n);
+
+  const Vector2 shift = p0->m_vPos - p0->m_vOldPos;
+  for(size_t k=0; k<n; k++){
+    const CBulletObject* p = m_vPlanetBullets[k];
+    m_vSweepFrom[k] = p->m_vOldPos + shift;
+    m_vSweepTo[k] = p->m_vPos;
+    m_vSweepRadius[k] = p->m_Sphere.Radius;
+  } //for
+
+  p0->Sweep(m_vSweepFrom.data(), m_vSweepTo.data(), m_vSweepRadius.data(), n, m_vSweepToi.data());
+
+  m_nPairTests += n;
+  for(size_t k=0; k<n; k++)
+    if(m_vSweepToi[k] <= 1.0f){
+      QueueCollision(eCollisionEvent::BULLET_PLANET, p0, m_vPlanetBullets[k], m_vSweepToi[k]);
+      m_nPairHits++;
+    } //if
+
+  m_vPlanetBullets.clear();
+} //NarrowPhaseBatch
+
+bool CObjectManager::NarrowPhase(std::shared_ptr<CTankObject> p0, CObject* p1) {
   eSpriteType t0 = (eSpriteType)p0->m_nSpriteIndex;
   eSpriteType t1 = (eSpriteType)p1->m_nSpriteIndex;
 
-  if (p0->m_Sphere.Intersects(p1->m_Sphere)) { //bounding spheres intersect
+  if (det_intersects(p0->m_Sphere, p1->m_Sphere)) { //bounding spheres intersect
     if (p1->GetIsBullet()) {
       CBulletObject* bullet = (CBulletObject*)p1;
-      if (p0.get() != bullet->GetOwner()) { //We don't want the bullets to "misfire" i.e. explode before leaving the tank that shot them.
-        bullet->kill();
-        p0->take_damage(bullet->GetDamage());
-      }
+      if (p0.get() != bullet->GetOwner()) //We don't want the bullets to "misfire" i.e. explode before leaving the tank that shot them.
+        QueueCollision(eCollisionEvent::BULLET_TANK, p0.get(), p1);
     }
+
+    return true;
   } //if
+
+  return false;
 } //NarrowPhase
 
-void CObjectManager::NarrowPhase(CWormholeObject* p0, CObject* p1) {
+bool CObjectManager::NarrowPhase(CWormholeObject* p0, CObject* p1) {
 
-    if (p0->m_Sphere.Intersects(p1->m_Sphere)) {
-        if (p1->GetIsBullet()) {
-            p1->m_vPos = p0->GetNextWormhole()->GetPos();
-            Vector2 v = p1->m_vVelocity;
-            v.Normalize();
-            p1->m_vPos += (p0->m_Sphere.Radius + 1.0f) * v;
-        }
+    if (det_intersects(p0->m_Sphere, p1->m_Sphere)) {
+        if (p1->GetIsBullet())
+            QueueCollision(eCollisionEvent::BULLET_WORMHOLE, p0, p1);
+
+        return true;
     }
 
+    return false;
 } //NarrowPhase
 
-/// Calculates the gravitational field at the position
-/// \param position Vector 2 representing some position at the board.
-Vector2 CObjectManager::calculate_gravity(Vector2 position) {
-  Vector2 current_gravity = Vector2(0, 0);
-  Vector2 temp_direction;
-  float magnitude_squared=0;
-  int i = 0;
-  for (auto const& p : m_massive_objects) {
+/// Add a collision event to the queue for ResolveCollisions.
+/// \param type What happened.
+/// \param p0 The tank, planet, wormhole or responding object.
+/// \param p1 The bullet or turret.
+/// \param toi For a bullet hitting a planet, how far along its step it hit.
+/// \param normal For a turret hitting a planet, the surface normal where it hit.
+
+void CObjectManager::QueueCollision(eCollisionEvent type, CObject* p0, CObject* p1, float toi, const Vector2& normal){
+  CCollisionEvent e;
+  e.m_eType = type;
+  e.m_pFirst = p0;
+  e.m_pSecond = p1;
+  e.m_fToi = toi;
+  e.m_vNormal = normal;
+  m_vCollisions.push_back(e);
+  m_cCollisionStats.m_nEvents++;
+} //QueueCollision
+
+/// Respond to the collisions found this frame. They are sorted by kind,
+/// then by the order that the objects were created in, so the response
+/// doesn't depend on what order the lists or the spatial hash happened
+/// to find them in. A bullet that an earlier event killed, or that was
+/// already dead, doesn't get to hit anything else.
+
+void CObjectManager::ResolveCollisions(){
+  std::sort(m_vCollisions.begin(), m_vCollisions.end(), [](const CCollisionEvent& a, const CCollisionEvent& b){
+    if(a.m_eType != b.m_eType)return a.m_eType < b.m_eType;
+    if(a.m_pFirst != b.m_pFirst)return a.m_pFirst->GetSerial() < b.m_pFirst->GetSerial();
+    return a.m_pSecond->GetSerial() < b.m_pSecond->GetSerial();
+  }); //sort
+
+  for(size_t i=0; i<m_vCollisions.size();){
+    const CCollisionEvent& e = m_vCollisions[i];
+
+    if(e.m_eType == eCollisionEvent::BULLET_PLANET){ //all of the hits on this planet at once
+      i = ResolvePlanetHits(i);
+      continue;
+    } //if
+
+    if(e.m_pSecond->GetIsBullet() && e.m_pSecond->IsDead()){ //too late
+      m_cCollisionStats.m_nStale++;
+      i++;
+      continue;
+    } //if
+
+    switch(e.m_eType){
+      case eCollisionEvent::OBJECT_RESPONSE:
+        e.m_pFirst->CollisionResponse();
+        break;
+
+      case eCollisionEvent::BULLET_TANK: {
+        CBulletObject* bullet = (CBulletObject*)e.m_pSecond;
+        bullet->kill();
+        ((CTankObject*)e.m_pFirst)->take_damage(bullet->GetDamage());
+      } //case
+        break;
+
+      case eCollisionEvent::TURRET_PLANET:
+        e.m_pSecond->CollisionReflectionResponse(e.m_vNormal);
+        break;
+
+      case eCollisionEvent::BULLET_WORMHOLE: {
+        Vector2 v = e.m_pSecond->m_vVelocity;
+        det_normalize(v);
+        e.m_pSecond->SetPrecisePos(((CWormholeObject*)e.m_pFirst)->GetNextWormhole()->GetPrecisePos() + (e.m_pFirst->m_Sphere.Radius + 1.0f)*v);
+      } //case
+        break;
+
+      default: break;
+    } //switch
+
     i++;
-    temp_direction = p->GetPos() - position;
-    magnitude_squared = temp_direction.LengthSquared();
-    temp_direction.Normalize();
-    temp_direction *= static_cast<float>(p->mass * (double) gravitational_constant / (magnitude_squared + softening_parameter));
-    current_gravity += temp_direction;
-  }
+  } //for
+
+  m_vCollisions.clear();
+} //ResolveCollisions
+
+/// Respond to a run of bullets hitting the same planet, which the sort
+/// puts next to each other. Each bullet is backed up to where it hit.
+/// Then all of the terrain edits are made with the planet holding back
+/// its sector updates, so that overlapping craters update each sector
+/// once. Only then do the bullets explode and do whatever they do when
+/// they hit a planet, since a bouncing bullet needs the new surface.
+/// \param first Index in m_vCollisions of the first event in the run.
+/// \return Index of the first event after the run.
+
+size_t CObjectManager::ResolvePlanetHits(size_t first){
+  CPlanetObject* planet = (CPlanetObject*)m_vCollisions[first].m_pFirst;
+  size_t last = first;
+  while(last < m_vCollisions.size() && m_vCollisions[last].m_eType == eCollisionEvent::BULLET_PLANET &&
+    m_vCollisions[last].m_pFirst == planet)
+    last++;
+
+  const CVector2d shift = planet->m_dPos - planet->m_dOldPos; //the bullets were swept in the planet's frame
+  planet->begin_edits();
+  for(size_t i=first; i<last; i++){
+    CBulletObject* bullet = (CBulletObject*)m_vCollisions[i].m_pSecond;
+    if(bullet->IsDead()){ //too late
+      m_cCollisionStats.m_nStale++;
+      continue;
+    } //if
+
+    const float toi = m_vCollisions[i].m_fToi;
+    bullet->SetPrecisePos(bullet->m_dOldPos + (bullet->m_dPos - bullet->m_dOldPos)*toi + shift*(1.0 - toi)); //back up to where it hit, so that it explodes there
+    bullet->carve(planet);
+    m_cCollisionStats.m_nTerrainEdits++;
+  } //for
+  m_cCollisionStats.m_nTerrainUpdates += planet->end_edits();
+
+  for(size_t i=first; i<last; i++){
+    CBulletObject* bullet = (CBulletObject*)m_vCollisions[i].m_pSecond;
+    if(bullet->IsDead())continue; //counted above
+    bullet->OnPlanetHit(planet);
+    bullet->kill();
+  } //for
 
-  //char msgbuf[128];
-  //sprintf_s(msgbuf, "Gravity: (%f, %f, %f, %f)\tNumber of Massive objects: %d\t Number of calculated objects: %d\n", current_gravity.Length(), current_gravity.x, current_gravity.y, magnitude_squared, m_massive_objects.size(), i);
-  //OutputDebugString(msgbuf);
-  return current_gravity;
+  return last;
+} //ResolvePlanetHits
+
+/// Calculates the gravitational field at the position.
+/// The work is done by m_gravity_field, which walks packed arrays of the
+/// massive objects with SSE/AVX instead of chasing pointers down m_massive_objects.
+/// \param position Vector 2 representing some position at the board.
+Vector2 CObjectManager::calculate_gravity(Vector2 position) {
+  return m_gravity_field.field(position);
 }
 
 /// Calculates the gravitational potential at the position
 /// \param position Vector 2 representing some position at the board.
 float CObjectManager::calculate_gravitational_potential(Vector2 position) {
-  float current_gravity_potential = 0;
-  Vector2 temp_direction;
-  float distance = 0;
+  return m_gravity_field.potential(position);
+}
+
+/// Advance a particle in the gravitational field by one time step
+/// using the selected integrator. The position may be in single or
+/// double precision. Either way gravity is evaluated in single
+/// precision, since it is only the position that accumulates error.
+/// \param position [in, out] Position of the particle.
+/// \param velocity [in, out] Velocity of the particle.
+/// \param dt Time step.
+/// \return The last acceleration evaluated, which is close to the acceleration at the new position.
+
+template<class V> Vector2 CObjectManager::integrate_any(V& position, Vector2& velocity, float dt) {
+  Vector2 acceleration;
+
+  switch (m_eIntegrator) {
+    case eIntegrator::SEMI_IMPLICIT_EULER: //kick, then drift with the new velocity
+      acceleration = calculate_gravity(Vector2(position));
+      velocity += acceleration * dt;
+      position += velocity * dt;
+      break;
+
+    case eIntegrator::LEAPFROG: //drift half a step, kick, drift the other half
+      position += velocity * (0.5f * dt);
+      acceleration = calculate_gravity(Vector2(position));
+      velocity += acceleration * dt;
+      position += velocity * (0.5f * dt);
+      break;
+
+    case eIntegrator::YOSHIDA4: { //leapfrog steps of w1, w0, w1 times dt, with the drifts in between merged
+      const double cube_root = cbrt(2.0);
+      const float w1 = (float)(1.0 / (2.0 - cube_root));
+      const float w0 = (float)(-cube_root / (2.0 - cube_root));
+      const float c[4] = { 0.5f * w1, 0.5f * (w0 + w1), 0.5f * (w0 + w1), 0.5f * w1 }; //drift coefficients
+      const float d[3] = { w1, w0, w1 }; //kick coefficients
+
+      for (int i = 0; i < 3; i++) {
+        position += velocity * (c[i] * dt);
+        acceleration = calculate_gravity(Vector2(position));
+        velocity += acceleration * (d[i] * dt);
+      } //for
+      position += velocity * (c[3] * dt);
+    } //case
+      break;
+
+    case eIntegrator::RK4: {
+      const V x0 = position;
+      const Vector2 v0 = velocity;
+      const Vector2 a1 = calculate_gravity(Vector2(x0));
+      const Vector2 a2 = calculate_gravity(Vector2(x0 + v0 * (0.5f * dt)));
+      const Vector2 v2 = v0 + a1 * (0.5f * dt);
+      const Vector2 a3 = calculate_gravity(Vector2(x0 + v2 * (0.5f * dt)));
+      const Vector2 v3 = v0 + a2 * (0.5f * dt);
+      const Vector2 a4 = calculate_gravity(Vector2(x0 + v3 * dt));
+      const Vector2 v4 = v0 + a3 * dt;
+
+      position = x0 + (v0 + 2.0f * v2 + 2.0f * v3 + v4) * (dt / 6.0f);
+      velocity = v0 + (a1 + 2.0f * a2 + 2.0f * a3 + a4) * (dt / 6.0f);
+      acceleration = a4;
+    } //case
+      break;
+
+    default: break;
+  } //switch
+
+  return acceleration;
+} //integrate_any
+
+/// Advance a particle in the gravitational field by one time step
+/// using the selected integrator.
+/// \param position [in, out] Position of the particle.
+/// \param velocity [in, out] Velocity of the particle.
+/// \param dt Time step.
+/// \return The last acceleration evaluated, which is close to the acceleration at the new position.
+
+Vector2 CObjectManager::integrate(Vector2& position, Vector2& velocity, float dt) {
+  return integrate_any(position, velocity, dt);
+} //integrate
+
+/// Advance a particle in the gravitational field by one time step
+/// using the selected integrator, with the position in double precision.
+/// \param position [in, out] Position of the particle.
+/// \param velocity [in, out] Velocity of the particle.
+/// \param dt Time step.
+/// \return The last acceleration evaluated, which is close to the acceleration at the new position.
+
+Vector2 CObjectManager::integrate(CVector2d& position, Vector2& velocity, float dt) {
+  return integrate_any(position, velocity, dt);
+} //integrate
+
+/// Choose how long the next sub-step may be. Two things limit it. The
+/// first is the terrain: a sub-step may cover at most half of the gap
+/// between the object and the nearest surface, measured to the maximum
+/// altitude sphere from outside it and to the terrain under the object
+/// from inside it, so that it can't skip through a hill. The second is
+/// how fast the field changes: near a planet of mass M at distance r the
+/// ratio of acceleration to jerk is about r/3v, and the free fall time is
+/// about sqrt(r/a), and a sub-step may cover m_fStepAccuracy of the
+/// smaller of the two. Far from everything the whole frame is one step.
+/// \param position Position of the object.
+/// \param velocity Velocity of the object.
+/// \param radius Radius of the object.
+/// \param dt Length of the frame.
+/// \return The length of the next sub-step.
+
+float CObjectManager::choose_step(const Vector2& position, const Vector2& velocity, float radius, float dt) {
+  const float speed = det_length(velocity);
+  float step = dt;
+
+  for (auto const& planet : m_planets_list) {
+    const float r = det_length(position - planet->GetPos());
+    if (r <= 0) continue;
+
+    //gap to the surface
+    float gap = r - planet->maximum_altitude_sphere.Radius;
+    if (gap < 0) //in among the hills
+      gap = r - planet->altitudes[planet->get_altitude_index_under_point(position)];
+    gap = max(gap, 0.0f) + radius + 1.0f; //always make some progress
+    if (speed > 0)
+      step = min(step, 0.5f * gap / speed);
+
+    //rate of change of the field
+    const float a = (float)(planet->mass * gravitational_constant) / (r * r);
+    if (a > 0)
+      step = min(step, m_fStepAccuracy * sqrtf(r / a));
+    if (speed > 0)
+      step = min(step, m_fStepAccuracy * r / (3.0f * speed));
+  } //for
+
+  return max(step, dt / MAX_SUBSTEPS);
+} //choose_step
+
+/// Advance a particle in the gravitational field by one frame. If
+/// patched conics are on and one planet dominates the field, and the
+/// particle can't reach that planet's hills this frame, it follows its
+/// Kepler orbit around that planet in one closed form step. Otherwise,
+/// if adaptive steps are on, the frame is split into sub-steps chosen by
+/// choose_step, and sub-stepping stops early if the particle touches a
+/// planet so that it is left where it hit for collision detection.
+/// The position may be in single or double precision.
+/// \param position [in, out] Position of the particle.
+/// \param velocity [in, out] Velocity of the particle.
+/// \param radius Radius of the particle.
+/// \param dt Length of the frame.
+/// \return The last acceleration evaluated.
+
+template<class V> Vector2 CObjectManager::advance_any(V& position, Vector2& velocity, float radius, float dt) {
+  //inside one planet's sphere of influence and clear of its hills, follow the Kepler orbit
+  if (m_bPatchedConics) {
+    CPlanetObject* planet = dominant_planet(Vector2(position));
+    if (planet) {
+      const Vector2 center = planet->GetPos();
+      const Vector2 offset = Vector2(position - V(center)); //small, so single precision will do
+      const float gap = offset.Length() - planet->maximum_altitude_sphere.Radius - radius;
+      if (gap > 2.0f * velocity.Length() * dt) { //can't get to the hills this frame
+        const double mu = planet->mass * gravitational_constant;
+        Vector2 r, v;
+        if (CConicOrbit(offset, velocity, mu).propagate(dt, r, v)) {
+          position = V(center) + r;
+          velocity = v;
+          m_nIntegrationSteps++;
+          const float length = r.Length();
+          return (float)(-mu / (length * length * length)) * r;
+        } //if
+      } //if
+    } //if
+  } //if
+
+  if (!m_bAdaptiveSteps) {
+    m_nIntegrationSteps++;
+    return integrate_any(position, velocity, dt);
+  } //if
+
+  Vector2 acceleration = Vector2::Zero;
+  BoundingSphere sphere;
+  sphere.Radius = radius;
+  float remaining = dt;
+  unsigned steps = 0; //counted here and added once, since other threads may be counting too
+
+  for (int i = 0; i < MAX_SUBSTEPS && remaining > 0; i++) {
+    float step = choose_step(Vector2(position), velocity, radius, dt);
+    if (step > 0.99f * remaining || i == MAX_SUBSTEPS - 1) //don't leave a sliver of the frame behind
+      step = remaining;
+
+    acceleration = integrate_any(position, velocity, step);
+    remaining -= step;
+    steps++;
+
+    if (remaining > 0) { //stop at the first sub-step that touches a planet
+      const Vector2 p = Vector2(position);
+      sphere.Center = Vector3(p.x, p.y, 0);
+      bool hit = false;
+      size_t k = 0;
+      for (auto const& planet : m_planets_list) {
+        if (t_pSubstepStats) hit = hit || planet->Intersects(sphere, (*t_pSubstepStats)[k++]); //on a worker thread
+        else hit = hit || planet->Intersects(sphere);
+      } //for
+      if (hit) break;
+    } //if
+  } //for
+
+  m_nIntegrationSteps += steps;
+  return acceleration;
+} //advance_any
+
+/// Advance a particle by one frame. See advance_any.
+/// \param position [in, out] Position of the particle.
+/// \param velocity [in, out] Velocity of the particle.
+/// \param radius Radius of the particle.
+/// \param dt Length of the frame.
+/// \return The last acceleration evaluated.
+
+Vector2 CObjectManager::advance(Vector2& position, Vector2& velocity, float radius, float dt) {
+  return advance_any(position, velocity, radius, dt);
+} //advance
+
+/// Advance a particle by one frame with its position in double precision.
+/// See advance_any.
+/// \param position [in, out] Position of the particle.
+/// \param velocity [in, out] Velocity of the particle.
+/// \param radius Radius of the particle.
+/// \param dt Length of the frame.
+/// \return The last acceleration evaluated.
+
+Vector2 CObjectManager::advance(CVector2d& position, Vector2& velocity, float radius, float dt) {
+  return advance_any(position, velocity, radius, dt);
+} //advance
+
+/// Find the planet whose gravity swamps everything else at a position,
+/// that is, the planet whose sphere of influence the position is in.
+/// A planet dominates if the pull of everything else put together is
+/// less than m_fDominance of its own. No planet dominates while planets
+/// are moving, since a Kepler orbit around a planet that is itself being
+/// pulled about is no longer closed form.
+/// \param position The position.
+/// \return The dominant planet, or nullptr if the position is in a region where several bodies matter.
+
+CPlanetObject* CObjectManager::dominant_planet(const Vector2& position) {
+  if (get_planets_moving())
+    return nullptr;
+
+  const Vector2 total = calculate_gravity(position);
+
+  for (auto const& planet : m_planets_list) {
+    const Vector2 offset = planet->GetPos() - position;
+    const float r2 = offset.LengthSquared();
+    if (r2 <= 0 || planet->mass <= 0) continue;
+
+    const Vector2 own = (float)(planet->mass * gravitational_constant / (r2 * sqrt(r2))) * offset;
+    if ((total - own).Length() <= m_fDominance * own.Length())
+      return planet;
+  } //for
+
+  return nullptr;
+} //dominant_planet
+
+/// If a particle is in a planet's sphere of influence and above its
+/// hills, jump straight along its Kepler orbit to the point where it next
+/// comes down to the planet's maximum altitude sphere. The jump is only
+/// made if the whole arc stays inside the world and inside the sphere of
+/// influence, checked at a few points along it, and never when there are
+/// wormholes about, since the arc could pass through one.
+/// \param position [in, out] Position of the particle.
+/// \param velocity [in, out] Velocity of the particle.
+/// \return true if the particle jumped, false if it should be flown as usual.
+
+bool CObjectManager::jump_to_surface(Vector2& position, Vector2& velocity) {
+  if (!m_bPatchedConics || !m_wormholes_list.empty())
+    return false;
+
+  CPlanetObject* planet = dominant_planet(position);
+  if (!planet)
+    return false;
+
+  const Vector2 center = planet->GetPos();
+  const float hills = planet->maximum_altitude_sphere.Radius;
+  const float r0 = (position - center).Length();
+  if (r0 <= hills + 1.0f) //already in among the hills
+    return false;
+
+  const CConicOrbit orbit(position - center, velocity, planet->mass * gravitational_constant);
+  double t;
+  if (!orbit.time_to_radius(hills, t))
+    return false;
+
+  //the furthest out it gets on the way, and whether that's in the world
+  const float furthest = (position - center).Dot(velocity) > 0 ? (float)orbit.apoapsis() : r0; //on the way out it passes apoapsis first
+  if (center.x - furthest < 0 || center.y - furthest < 0 || center.x + furthest > m_vWorldSize.x || center.y + furthest > m_vWorldSize.y)
+    return false;
+
+  //make sure it stays in the sphere of influence
+  const int samples = 8;
+  Vector2 r, v;
+  for (int i = 1; i <= samples; i++) {
+    if (!orbit.propagate(t * i / samples, r, v) || dominant_planet(center + r) != planet)
+      return false;
+  } //for
+
+  position = center + r;
+  velocity = v;
+  m_nIntegrationSteps++;
+  return true;
+} //jump_to_surface
+
+/// Find out whether a projectile can be shown never to hit anything, so
+/// that there's no need to fly it. There are two ways that can happen.
+///
+/// A projectile escapes if it is outside a circle around all of the
+/// planets' hills, heading out, and faster than the escape speed from all
+/// of the mass put together at the distance it could be from it. Measured
+/// from the center c of the circle, no massive object is further than D
+/// from c, so none is closer than r - D to the projectile, and the pull
+/// back towards c is at most GM/(r - D)^2. The radial speed therefore
+/// drops no faster than in a fall towards a point mass GM at distance
+/// r - D, and if it is faster than the escape speed from that, it never
+/// reaches zero. The projectile keeps getting further from c, never comes
+/// back to the hills, and sooner or later leaves the world.
+///
+/// A projectile orbits if it is in a planet's sphere of influence on a
+/// bound Kepler orbit whose periapsis clears the planet's hills, which
+/// stays in the world and, checked at a few points round it, in the
+/// sphere of influence. Then it goes round and round until it runs out
+/// of time.
+///
+/// Neither is decided when there are wormholes, since one could be in the
+/// way, or when planets are moving, since one could come to meet it.
+/// \param position Position of the projectile.
+/// \param velocity Velocity of the projectile.
+/// \param radius Radius of the projectile.
+/// \param lifetime How much longer the projectile has to live.
+/// \param end [out] Where the projectile will be when it leaves the world or runs out of time.
+/// \param duration [out] How long it will take to get there.
+/// \return What becomes of the projectile.
+
+eTrajectory CObjectManager::classify_trajectory(const Vector2& position, const Vector2& velocity, float radius, float lifetime, Vector2& end, float& duration) {
+  if (!m_wormholes_list.empty() || m_planets_list.empty() || get_planets_moving())
+    return eTrajectory::UNDECIDED;
+
+  //circle around the planets
+  Vector2 center = Vector2::Zero;
+  for (auto const& planet : m_planets_list)
+    center += planet->GetPos();
+  center /= (float)m_planets_list.size();
+
+  float hills = 0; //radius of a circle around all of the hills
+  for (auto const& planet : m_planets_list)
+    hills = max(hills, det_length(planet->GetPos() - center) + planet->maximum_altitude_sphere.Radius);
+
+  double gm = 0; //everything that pulls
+  float reach = 0; //furthest any of it is from the center
   for (auto const& p : m_massive_objects) {
-    temp_direction = p->GetPos() - position;
-    distance = temp_direction.Length();
-    current_gravity_potential += static_cast<float>(p->mass / distance);
-  }
+    gm += p->mass * gravitational_constant;
+    reach = max(reach, det_length(p->m_vPos - center));
+  } //for
 
-  current_gravity_potential *= static_cast<float>(gravitational_constant);
-  return -current_gravity_potential;
-}
+  //escaping
+  const Vector2 offset = position - center;
+  const float r = det_length(offset);
+  const float radial_speed = r > 0 ? det_dot(offset, velocity) / r : 0;
+
+  if (r > hills + radius && r > reach && radial_speed > 0 &&
+    (double)radial_speed * radial_speed >= 2.0 * gm / (r - reach))
+  {
+    //where it leaves the world, going in a straight line since it only slows down from here
+    float exit = FLT_MAX;
+    if (velocity.x > 0) exit = min(exit, (m_vWorldSize.x - position.x) / velocity.x);
+    if (velocity.x < 0) exit = min(exit, -position.x / velocity.x);
+    if (velocity.y > 0) exit = min(exit, (m_vWorldSize.y - position.y) / velocity.y);
+    if (velocity.y < 0) exit = min(exit, -position.y / velocity.y);
+
+    duration = max(0.0f, min(exit, lifetime));
+    end = position + velocity * duration;
+    return eTrajectory::ESCAPES;
+  } //if
+
+  //in orbit
+  CPlanetObject* planet = dominant_planet(position);
+  if (planet) {
+    const Vector2 planet_center = planet->GetPos();
+    const CConicOrbit orbit(position - planet_center, velocity, planet->mass * gravitational_constant);
+    const float apoapsis = (float)orbit.apoapsis();
+
+    if (orbit.is_bound() && orbit.periapsis() > 1.05f * (planet->maximum_altitude_sphere.Radius + radius) &&
+      planet_center.x - apoapsis > 0 && planet_center.y - apoapsis > 0 &&
+      planet_center.x + apoapsis < m_vWorldSize.x && planet_center.y + apoapsis < m_vWorldSize.y)
+    {
+      const int samples = 16;
+      const double period = orbit.period();
+      Vector2 p, v;
+      bool dominated = true;
+      for (int i = 1; i <= samples && dominated; i++)
+        dominated = orbit.propagate(period * i / samples, p, v) && dominant_planet(planet_center + p) == planet;
+
+      if (dominated && orbit.propagate(max(lifetime, 0.0f), p, v)) {
+        duration = max(lifetime, 0.0f);
+        end = planet_center + p;
+        return eTrajectory::ORBITS;
+      } //if
+    } //if
+  } //if
+
+  return eTrajectory::UNDECIDED;
+} //classify_trajectory
+
+/// Add some bytes to an FNV-1a hash.
+/// \param hash [in, out] The hash.
+/// \param data The bytes.
+/// \param size Number of bytes.
+
+static void hash_bytes(unsigned long long& hash, const void* data, size_t size) {
+  const unsigned char* bytes = (const unsigned char*)data;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL; //FNV prime
+  } //for
+} //hash_bytes
+
+/// Hash everything that the physics can change: the position, velocity
+/// and life of every object, the terrain of every planet, and where each
+/// tank is, which way its gun points, its power and its health. Two runs
+/// that hash the same after every frame went the same way bit for bit,
+/// which is what the deterministic mode (see Deterministic.h) promises.
+/// \return The hash.
+
+unsigned long long CObjectManager::state_hash() {
+  unsigned long long hash = 14695981039346656037ULL; //FNV offset basis
+
+  for (auto const& p : m_stdObjectList) {
+    hash_bytes(hash, &p->m_nSpriteIndex, sizeof(p->m_nSpriteIndex));
+    hash_bytes(hash, &p->m_vPos, sizeof(p->m_vPos));
+    hash_bytes(hash, &p->m_vVelocity, sizeof(p->m_vVelocity));
+    hash_bytes(hash, &p->m_bDead, sizeof(p->m_bDead));
+  } //for
 
+  for (auto const& planet : m_planets_list) {
+    hash_bytes(hash, &planet->m_vPos, sizeof(planet->m_vPos));
+    hash_bytes(hash, planet->altitudes.data(), planet->altitudes.size() * sizeof(int));
+  } //for
+
+  for (auto const& tank : m_tanks_list) {
+    hash_bytes(hash, &tank->m_vPos, sizeof(tank->m_vPos));
+    hash_bytes(hash, &tank->angle_relative_to_planet, sizeof(tank->angle_relative_to_planet));
+    hash_bytes(hash, &tank->angle, sizeof(tank->angle));
+    hash_bytes(hash, &tank->power, sizeof(tank->power));
+    hash_bytes(hash, &tank->health_points, sizeof(tank->health_points));
+  } //for
+
+  for (auto const& p : m_wormholes_list)
+    hash_bytes(hash, &p->m_vPos, sizeof(p->m_vPos));
+
+  return hash;
+} //state_hash
+
+/// Get the name of the integrator in use, for the debug text and the benchmarks.
+/// \return The name of the integrator.
+
+string CObjectManager::get_integrator_name() {
+  switch (m_eIntegrator) {
+    case eIntegrator::SEMI_IMPLICIT_EULER: return "semi-implicit Euler";
+    case eIntegrator::LEAPFROG: return "leapfrog";
+    case eIntegrator::YOSHIDA4: return "Yoshida 4";
+    case eIntegrator::RK4: return "RK4";
+    default: return "unknown";
+  } //switch
+} //get_integrator_name
+
+/// Precompute the gravitational field on a grid over the world, so that
+/// calculate_gravity becomes a lookup. Call this once the level is loaded.
+/// The grid is built on a background thread unless asked to wait, and is
+/// thrown away automatically if a massive object moves. In the
+/// deterministic mode there is no grid, since which frames get
+/// interpolated values would depend on when the build finishes.
+/// \param wait Whether to wait for the grid to be finished.
+
+void CObjectManager::build_gravity_grid(bool wait) {
+#ifndef DETERMINISTIC_PHYSICS
+  m_gravity_field.build_grid(m_vWorldSize, wait);
+#endif
+} //build_gravity_grid
 
 float CObjectManager::calculate_total_mechanical_energy(Vector2 position, Vector2 velocity) {
   //Note: Technically, the dimensions of this quantity are NOT actually energy. It's closer to the "Gravitational Potential" i.e. Energy/mass.
@@ -580,6 +1547,9 @@ void CObjectManager::calculate_total_energy_for_all_objects() {
 /// \returns a pointer to the nearest planet
 
 CPlanetObject* CObjectManager::calculate_closest_planet(Vector2 position) {
+  if (m_bSurfaceIndex)
+    return m_cSurfaceIndex.nearest_planet(position);
+
   CPlanetObject* current_closest_planet = nullptr;
   float current_closest_length = -1.0f;
   float distance;
@@ -599,6 +1569,9 @@ CPlanetObject* CObjectManager::calculate_closest_planet(Vector2 position) {
 /// \param position Vector2 representing some position in the world
 /// \returns a shared pointer to the nearest tank
 std::shared_ptr<CTankObject> CObjectManager::get_nearest_tank(Vector2 position) {
+  if (m_bSurfaceIndex)
+    return m_cSurfaceIndex.nearest_tank(position);
+
   std::shared_ptr<CTankObject> current_closest_tank;
   float current_closest_length = -1.0f;
   float distance;
@@ -619,14 +1592,21 @@ std::shared_ptr<CTankObject> CObjectManager::get_nearest_tank(Vector2 position)
 /// \param position Vector2 representing some position in the world
 /// \returns the distance as a float
 float CObjectManager::get_nearest_tank_location(Vector2 position, CTankObject* origin_tank) {
-  
-
   float current_closest_length = -1.0f;
   float distance;
+
+  if (m_bSurfaceIndex) { //the penalty below is the same for every tank, so the nearest one wins either way
+    const std::shared_ptr<CTankObject> tank = m_cSurfaceIndex.nearest_tank(position, origin_tank, true);
+    if (tank) {
+      current_closest_length = det_length(position - tank->GetPos());
+      current_closest_length /= 1 - det_exp(-det_dot(origin_tank->GetPos() - position, origin_tank->GetPos() - position) / 250);
+    }
+  }
+
   //Loop over all the planets and calculate distance.
-  for (auto const& tank : m_tanks_list) {
+  else for (auto const& tank : m_tanks_list) {
     if (tank.get() != origin_tank && !(tank->IsDead())){ // We don't want tanks aiming at themselves or dead tanks!
-      distance = (position - tank->GetPos()).Length(); //Plain old euclidean distance
+      distance = det_length(position - tank->GetPos()); //Plain old euclidean distance
       /*Vector2 object_to_core = position - tank->get_planet_index()->GetPos();
       float object_elevation = object_to_core.Length();
       Vector2 tank_location = tank->GetPos() - tank->get_planet_index()->GetPos();
@@ -641,7 +1621,7 @@ float CObjectManager::get_nearest_tank_location(Vector2 position, CTankObject* o
       //penalize it by increasing the "distance" if it's close to a suicide shot.
       //OutputDebugStringA(("before: " + to_string(distance) + "\t").c_str());
       //OutputDebugStringA(("dis_origin: " + to_string((origin_tank->GetPos() - position).Length()) + "\t").c_str());
-      distance /= 1- expf(-(origin_tank->GetPos() - position).LengthSquared()/250); //If the shot is close to the origin tank, then this makes it look far away. If it's far away, it doesn't affect it much
+      distance /= 1- det_exp(-det_dot(origin_tank->GetPos() - position, origin_tank->GetPos() - position)/250); //If the shot is close to the origin tank, then this makes it look far away. If it's far away, it doesn't affect it much
       //OutputDebugStringA(("after: " + to_string(distance)).c_str());
       //OutputDebugStringA(to_string((int)origin_tank).c_str());
       //OutputDebugStringA("\n");
@@ -662,6 +1642,28 @@ float CObjectManager::get_nearest_tank_location(Vector2 position, CTankObject* o
   return current_closest_length;
 }
 
+/// Sweep a bullet along its last step against all of the planets. If it
+/// hits one, move it back to where it first touched. Each planet is swept
+/// against the coarsest columns of its altitude pyramid that are within
+/// the tolerance, which are the altitudes themselves for a tolerance of 0.
+/// \param bullet The bullet.
+/// \param tolerance How far off the real surface the planets may be.
+/// \return true if it hit a planet.
+
+bool CObjectManager::sweep_planets(CBulletObject* bullet, float tolerance){
+  float first = 2.0f; //earliest time of impact so far
+
+  for(CPlanetObject* planet: m_planets_list){
+    float toi;
+    if(planet->Sweep(bullet->m_vOldPos, bullet->m_vPos, bullet->m_Sphere.Radius, tolerance, toi) && toi < first)
+      first = toi;
+  } //for
+
+  if(first > 1.0f)return false;
+  bullet->SetPrecisePos(bullet->m_dOldPos + (bullet->m_dPos - bullet->m_dOldPos)*first);
+  return true;
+} //sweep_planets
+
 /// <summary>
 /// Creates a phantom bullet which moves "instantly". I.e. we repeatedly force it to move until it explodes before the end of the frame.
 /// </summary>
@@ -674,21 +1676,42 @@ float CObjectManager::create_phantom_bullet(eSpriteType t, const Vector2& positi
   phantom_bullet->SetOwner(owner);
   phantom_bullet->set_is_phantom(true);
   phantom_bullet->SetVelocity(velocity);
-  float start_time = m_pStepTimer->GetTotalSeconds();
-  while (!phantom_bullet->IsDead()) { // Force it to the next place while it's not dead.
+  m_cPhantomStats.m_nBullets++;
+
+  //The step timer doesn't move while the phantom flies, so it has to keep track of its own age.
+  const float dt = m_pStepTimer->GetElapsedSeconds();
+  const float time_to_live = phantom_bullet->get_time_to_live();
+  const int lifetime = dt > 0 && time_to_live > 0 ? (int)ceilf(time_to_live / dt) : INT_MAX;
+
+  for (int step = 0; !phantom_bullet->IsDead(); step++) { // Force it to the next place while it's not dead.
+    if (step >= lifetime) { //a live bullet would have run out of time by now
+      m_cPhantomStats.m_nTimeouts++;
+      break;
+    } //if
+
+    if (m_bEarlyTermination) { //settle it now if it's never going to hit anything
+      Vector2 end;
+      float duration;
+      const eTrajectory fate = classify_trajectory(phantom_bullet->m_vPos, phantom_bullet->m_vVelocity,
+        phantom_bullet->m_Sphere.Radius, (lifetime - step) * dt, end, duration);
+
+      if (fate != eTrajectory::UNDECIDED) {
+        phantom_bullet->m_vPos = end;
+        m_cPhantomStats.m_nStepsSaved += dt > 0 ? (unsigned long long)ceilf(duration / dt) : 0;
+        if (fate == eTrajectory::ESCAPES) m_cPhantomStats.m_nEscapes++;
+        else m_cPhantomStats.m_nOrbits++;
+        break;
+      } //if
+    } //if
+
+    m_cPhantomStats.m_nSteps++;
+    jump_to_surface(phantom_bullet->m_vPos, phantom_bullet->m_vVelocity); //skip the part of the flight that can be done in closed form
     //string test_string = "Bullet location: " + to_string(phantom_bullet->GetPos().x) + ", " + to_string(phantom_bullet->GetPos().y) + "\n";
     //OutputDebugStringA(test_string.c_str());
-    const int dt = m_pStepTimer->GetElapsedSeconds();
-    phantom_bullet->SetAcceleration(calculate_gravity(phantom_bullet->GetPos()));
-    phantom_bullet->SetVelocity(phantom_bullet->GetVelocity() + phantom_bullet->GetAcceleration()*dt);
-    phantom_bullet->move(); //move it
-    //Check for collisions with planets
-    for (auto i = m_planets_list.begin(); i != m_planets_list.end(); i++) {
-      if ((*i)->Intersects(phantom_bullet->m_Sphere)) { //bounding spheres intersect
-        phantom_bullet->m_bDead = true;
-        break;
-      }
-    }
+    phantom_bullet->move(); //move it, integrating gravity the same way as a live bullet
+    //Check for collisions with planets, all the way along this step, as closely as the AI needs
+    if (sweep_planets(phantom_bullet, m_fPhantomTolerance))
+      phantom_bullet->m_bDead = true;
     //Check if off edge
     if (AtWorldEdge(phantom_bullet)) {
       phantom_bullet->m_bDead = true;
@@ -697,11 +1720,11 @@ float CObjectManager::create_phantom_bullet(eSpriteType t, const Vector2& positi
 
     //Deal with wormholes
     for (auto p0 : m_wormholes_list) {
-      if (p0->m_Sphere.Intersects(phantom_bullet->m_Sphere)) {
+      if (det_intersects(p0->m_Sphere, phantom_bullet->m_Sphere)) {
         if (phantom_bullet->GetIsBullet()) {
           phantom_bullet->m_vPos = p0->GetNextWormhole()->GetPos();
           Vector2 v = phantom_bullet->m_vVelocity;
-          v.Normalize();
+          det_normalize(v);
           phantom_bullet->m_vPos += (p0->m_Sphere.Radius + 1.0f) * v;
         }
       }
@@ -722,22 +1745,17 @@ void CObjectManager::draw_trajectory(eSpriteType t, const Vector2& position, con
     phantom_bullet->SetOwner(owner);
     phantom_bullet->set_is_phantom(true);
     phantom_bullet->SetVelocity(velocity);
-    const float dt = m_pStepTimer->GetElapsedSeconds();
     for (int i = 0; i < 200; i++) {
 
-        phantom_bullet->SetAcceleration(calculate_gravity(phantom_bullet->GetPos()));
-        phantom_bullet->SetVelocity(phantom_bullet->GetVelocity() + phantom_bullet->GetAcceleration()*dt);
-        phantom_bullet->move(); //move it
-
-        //only need to check for collision as much as we draw the dots
-        if (i % 10 == (int)(m_pStepTimer->GetTotalSeconds() * 30) % 10) {
-            //Check for collisions with planets
-            for (auto i = m_planets_list.begin(); i != m_planets_list.end(); i++) {
-                if ((*i)->Intersects(phantom_bullet->m_Sphere)) { //bounding spheres intersect
-                    phantom_bullet->m_bDead = true;
-                    break;
-                }
-            }
+        phantom_bullet->move(); //move it, integrating gravity the same way as a live bullet
+
+        //Check for collisions with planets every step, since sweeping only covers one step at a time.
+        //That way a hill between two dots still stops it.
+        if (sweep_planets(phantom_bullet))
+            phantom_bullet->m_bDead = true;
+
+        //only need to draw every so often
+        if (phantom_bullet->IsDead() || i % 10 == (int)(m_pStepTimer->GetTotalSeconds() * 30) % 10) {
             //Check if off edge
             if (AtWorldEdge(phantom_bullet)) {
                 phantom_bullet->m_bDead = true;
@@ -751,7 +1769,7 @@ void CObjectManager::draw_trajectory(eSpriteType t, const Vector2& position, con
                 spr.m_fXScale = 0.75f;
                 spr.m_fYScale = 0.75f;
                 spr.m_vPos = phantom_bullet->GetPos();
-                m_pRenderer->Draw(spr);   
+                m_pRenderer->Draw(spr, phantom_bullet->GetPrecisePos());   
             }
             else
                 break;
@@ -4,6 +4,10 @@
 #pragma once
 
 #include <list>
+#include <vector>
+#include <atomic>
+#include <deque>
+#include <mutex>
 
 #include "Component.h"
 #include "Common.h"
@@ -14,9 +18,107 @@
 #include "TankObject.h"
 #include "BulletObject.h"
 #include "WormholeObject.h"
+#include "GravityField.h"
+#include "WorkerPool.h"
+#include "SpatialHash.h"
+#include "SurfaceIndex.h"
 
 using namespace std;
 
+/// \brief Numerical integrator.
+///
+/// How objects affected by gravity are moved from one frame to the next.
+/// The symplectic ones keep the energy of an orbit bounded instead of
+/// letting it drift off, so orbits don't spiral in or out.
+
+enum class eIntegrator{
+  SEMI_IMPLICIT_EULER, ///< First order, symplectic. One gravity evaluation per step.
+  LEAPFROG, ///< Second order, symplectic. Drift-kick-drift velocity Verlet. One gravity evaluation per step.
+  YOSHIDA4, ///< Fourth order, symplectic. Three leapfrog steps with Yoshida's coefficients. Three gravity evaluations per step.
+  RK4, ///< Fourth order Runge-Kutta. Not symplectic. Four gravity evaluations per step.
+  NUM_INTEGRATORS ///< Must be last.
+}; //eIntegrator
+
+/// \brief What becomes of a projectile.
+///
+/// Some projectiles can be shown never to hit anything: they are either
+/// flying out of the world faster than everything put together can pull
+/// them back, or stuck in an orbit that never comes down to the hills.
+
+enum class eTrajectory{
+  UNDECIDED, ///< Could still hit something. Fly it to find out.
+  ESCAPES, ///< Leaves the world without touching anything.
+  ORBITS ///< Goes round a planet without touching anything until it runs out of time.
+}; //eTrajectory
+
+/// \brief What a planet is to be made with.
+///
+/// A level's planets are made all at once from a list of these, so that
+/// their terrain can be generated on the worker pool.
+
+struct CPlanetDesc{
+  Vector2 m_vPos; ///< Position of the center.
+  double m_fMass = 0; ///< Mass. 0 means it doesn't pull anything.
+  int m_nRadius = 500; ///< Sea level radius.
+  bool m_bAffectedByGravity = false; ///< Whether it is pulled by the others.
+}; //CPlanetDesc
+
+/// \brief Counters for the phantom bullets fired by the AI.
+///
+/// A step here is one frame of a phantom bullet's flight, which is at
+/// least one integration step.
+
+struct CPhantomStats{
+  unsigned m_nBullets = 0; ///< Number of phantom bullets fired.
+  unsigned long long m_nSteps = 0; ///< Number of steps flown.
+  unsigned long long m_nStepsSaved = 0; ///< Number of steps that didn't have to be flown because the outcome was already known.
+  unsigned m_nEscapes = 0; ///< Number of phantom bullets settled because they were escaping.
+  unsigned m_nOrbits = 0; ///< Number of phantom bullets settled because they were stuck in orbit.
+  unsigned m_nTimeouts = 0; ///< Number of phantom bullets that ran out of time.
+}; //CPhantomStats
+
+/// \brief Counters for the broad phase, by collision layer.
+///
+/// Pairs are counted by the layer of the first object, which is the tank,
+/// planet or wormhole if there is one, and then the layer of the second.
+
+struct CCollisionStats{
+  unsigned m_nFrames = 0; ///< Number of times the broad phase has run.
+  unsigned long long m_nTested[NUM_COLLISION_LAYERS][NUM_COLLISION_LAYERS] = {}; ///< Number of pairs sent to the narrow phase.
+  unsigned long long m_nSkipped[NUM_COLLISION_LAYERS][NUM_COLLISION_LAYERS] = {}; ///< Number of pairs skipped because their layers can't collide.
+  unsigned long long m_nEvents = 0; ///< Number of collision events queued.
+  unsigned long long m_nStale = 0; ///< Number of those dropped because an earlier event in the queue killed the bullet.
+  unsigned long long m_nTerrainEdits = 0; ///< Number of terrain edits made by bullets hitting planets.
+  unsigned long long m_nTerrainUpdates = 0; ///< Number of spans of sectors updated for them, after merging.
+}; //CCollisionStats
+
+/// \brief Kind of collision event.
+///
+/// Events are resolved in this order, so it is also the order that the
+/// broad phase used to respond to them in when it did so on the spot.
+
+enum class eCollisionEvent{
+  OBJECT_RESPONSE, ///< A player hit a turret. The first object responds.
+  BULLET_TANK, ///< A bullet hit a tank that didn't fire it.
+  BULLET_PLANET, ///< A bullet hit a planet.
+  TURRET_PLANET, ///< A turret hit a planet and bounces off.
+  BULLET_WORMHOLE ///< A bullet went into a wormhole.
+}; //eCollisionEvent
+
+/// \brief A collision found by the narrow phase, waiting to be resolved.
+///
+/// The first object is the tank, planet or wormhole if there is one. The
+/// objects stay alive until CullDeadObjects, which runs after the queue
+/// has been resolved, so plain pointers are safe.
+
+struct CCollisionEvent{
+  eCollisionEvent m_eType; ///< What happened.
+  CObject* m_pFirst; ///< The tank, planet, wormhole or responding object.
+  CObject* m_pSecond; ///< The bullet or turret.
+  float m_fToi; ///< For a bullet hitting a planet, how far along its step it hit.
+  Vector2 m_vNormal; ///< For a turret hitting a planet, the surface normal where it hit.
+}; //CCollisionEvent
+
 /// \brief The object manager.
 ///
 /// A collection of all of the game objects.
@@ -34,12 +136,22 @@ class CObjectManager:
     list<std::shared_ptr<CTankObject>> m_tanks_list; ///< List of all tanks. This is a list of shared pointers to avoid crashes where tanks fire guns while dying.
     list<CBulletObject*> m_bullets_list; ///< List of all bullets. Used to keep track of what's flying around.
     list<CWormholeObject*> m_wormholes_list; ///< List of all wormholes
+    CGravityField m_gravity_field; ///< Packed copy of m_massive_objects used to evaluate gravity. Rebuilt whenever that list changes.
 
-    void BroadPhase(); ///< Broad phase collision detection and response.
-    void NarrowPhase(CObject* p0, CObject* p1); ///< Narrow phase collision detection and response.
-    void NarrowPhase(CPlanetObject* p0, CObject* p1); ///< Narrow phase collision detection and response where the first object is a planet.
-    void NarrowPhase(std::shared_ptr<CTankObject> p0, CObject* p1); ///< Narrow phase collision detection and response where the first object is a tank.
-    void NarrowPhase(CWormholeObject* p0, CObject* p1); ///< Narrow phase collision detection and response where first object is a wormhole
+    void BroadPhaseAllPairs(); ///< Broad phase that tests every pair.
+    void BroadPhaseHashed(); ///< Broad phase that tests only the pairs that the spatial hash says are close.
+    bool LayersCollide(const CObject* p0, const CObject* p1); ///< Whether a pair is on layers that can collide, counting the ones that aren't.
+    template<class P> void TestPair(P p0, CObject* p1); ///< Send a pair to the narrow phase if their layers can collide.
+    bool NarrowPhase(CObject* p0, CObject* p1); ///< Narrow phase collision detection and response.
+    bool NarrowPhase(CPlanetObject* p0, CObject* p1); ///< Narrow phase collision detection and response where the first object is a planet.
+    void QueuePlanetPair(CPlanetObject* p0, CObject* p1); ///< Hold a bullet back for the planet's batch, or test anything else now.
+    void QueueCollision(eCollisionEvent type, CObject* p0, CObject* p1, float toi = 0, const Vector2& normal = Vector2::Zero); ///< Add a collision event to the queue.
+    void ResolveCollisions(); ///< Sort the collision queue and respond to the events in it.
+    size_t ResolvePlanetHits(size_t first); ///< Respond to a run of bullets hitting the same planet.
+    void NarrowPhaseBatch(CPlanetObject* p0); ///< Narrow phase collision detection and response between a planet and the bullets held back for it.
+    bool NarrowPhase(std::shared_ptr<CTankObject> p0, CObject* p1); ///< Narrow phase collision detection and response where the first object is a tank.
+    bool NarrowPhase(CWormholeObject* p0, CObject* p1); ///< Narrow phase collision detection and response where first object is a wormhole
+    bool sweep_planets(CBulletObject* bullet, float tolerance = 0); ///< Check whether a bullet hit a planet on its last step, and back it up to where it did.
     bool AtWorldEdge(CObject* p); ///< Test whether at the edge of the world.
     bool AtWorldEdge(Vector2& pos);
     void CullDeadObjects(); ///< Cull dead objects.
@@ -49,12 +161,75 @@ class CObjectManager:
     double gravitational_constant = 5000000;
     double softening_parameter = 0;
 
+    eIntegrator m_eIntegrator = eIntegrator::LEAPFROG; ///< Integrator used for everything affected by gravity.
+    bool m_bAdaptiveSteps = true; ///< Whether to take smaller steps close to planets.
+    float m_fStepAccuracy = 0.05f; ///< Fraction of the time it takes the field to change appreciably that a sub-step may cover.
+    static const int MAX_SUBSTEPS = 64; ///< Most sub-steps an object may take in one frame.
+    float m_fLargeWorldSize = 16384.0f; ///< Worlds wider or higher than this keep positions in double precision. Past here a float is only good to 1/512 of a unit.
+    std::atomic<unsigned long long> m_nIntegrationSteps{0}; ///< Number of integration steps taken so far, for the benchmarks. Atomic, since objects are integrated on worker threads.
+
+    CWorkerPool m_cWorkerPool; ///< Threads that objects affected by gravity are integrated on.
+    std::vector<CObject*> m_vMoving; ///< Objects affected by gravity that are moving this frame. Kept here so that it isn't reallocated every frame.
+    static const size_t MIN_CHUNK = 16; ///< Fewest objects worth integrating on a thread of their own.
+    std::vector<CObject*> m_vMassive; ///< Massive objects in m_vMoving, which move under each other's pull.
+    std::vector<CSectorStats> m_vSubstepStats; ///< How the planet tests between sub-steps got settled this frame, one for each planet, added up from the chunks.
+    std::mutex m_mSubstepStats; ///< Guards m_vSubstepStats while the chunks add to it.
+
+    static const size_t MAX_TERRAIN_HISTORY = 32; ///< Most saves of the terrain kept for rewinding.
+    std::deque<std::vector<CTerrainSnapshot>> m_dTerrainHistory; ///< Saves of the terrain of every planet, oldest first. They share the chunks that didn't change between them.
+
+    void move_massive_objects(float t); ///< Move the massive objects that are affected by gravity together, with a symplectic step.
+    void planet_moved(CPlanetObject* planet); ///< Bring whatever hangs off a planet along after it moves.
+
+    bool m_bSpatialHash = true; ///< Whether the broad phase uses the spatial hash instead of testing every pair.
+    CSpatialHash m_cSpatialHash; ///< Objects in m_stdObjectList, filed by position. Rebuilt every frame.
+    std::vector<CObject*> m_vBroadObjects; ///< Copy of m_stdObjectList that the spatial hash numbers its items from.
+    std::vector<Vector2> m_vBroadCenters; ///< Centers of the objects in m_vBroadObjects.
+    std::vector<unsigned> m_vCandidates; ///< Results of a spatial hash query.
+    static const int HASH_CELLS_ACROSS = 256; ///< Cells across the world, unless the objects are too big for cells that small.
+    unsigned long long m_nPairTests = 0; ///< Number of narrow phase tests so far, for the benchmarks.
+    unsigned long long m_nPairHits = 0; ///< Number of those that found a collision.
+
+    bool m_bPlanetBatches = true; ///< Whether bullets are swept against each planet in one batch instead of one pair at a time.
+    std::vector<CBulletObject*> m_vPlanetBullets; ///< Bullets held back for the planet being tested.
+    std::vector<Vector2> m_vSweepFrom; ///< Where each of m_vPlanetBullets was at the start of the frame.
+    std::vector<Vector2> m_vSweepTo; ///< Where each of m_vPlanetBullets is now.
+    std::vector<float> m_vSweepRadius; ///< Radius of each of m_vPlanetBullets.
+    std::vector<float> m_vSweepToi; ///< Time of impact of each of m_vPlanetBullets, or more than 1 if it missed.
+
+    std::vector<CCollisionEvent> m_vCollisions; ///< Collisions found this frame, waiting to be resolved.
+
+    bool m_bSurfaceIndex = true; ///< Whether tank and planet queries go through m_cSurfaceIndex instead of walking the lists.
+    CSurfaceIndex m_cSurfaceIndex; ///< The planets, and the tanks on each planet by longitude.
+    std::vector<CTankObject*> m_vNearTanks; ///< Results of a tank query.
+
+    bool m_bCollisionLayers = true; ///< Whether the broad phase skips pairs on layers that can't collide.
+    CCollisionStats m_cCollisionStats; ///< Counters for the pairs tested and skipped, by layer.
+
+    float choose_step(const Vector2& position, const Vector2& velocity, float radius, float dt); ///< Choose the size of the next sub-step.
+    template<class V> Vector2 integrate_any(V& position, Vector2& velocity, float dt); ///< Advance a particle by one time step, with the position in either precision.
+    template<class V> Vector2 advance_any(V& position, Vector2& velocity, float radius, float dt); ///< Advance a particle by one frame, with the position in either precision.
+
+#ifdef DETERMINISTIC_PHYSICS
+    bool m_bPatchedConics = false; ///< Whether to fly along Kepler orbits where one planet dominates. Off in the deterministic mode, since the Kepler solver uses the C runtime's transcendental functions.
+#else
+    bool m_bPatchedConics = true; ///< Whether to fly along Kepler orbits where one planet dominates.
+#endif
+    float m_fDominance = 0.01f; ///< Largest pull of everything else, as a fraction of the nearest planet's pull, for that planet to dominate.
+
+    CPlanetObject* dominant_planet(const Vector2& position); ///< The planet whose gravity swamps everything else at a position, if any.
+
+    bool m_bEarlyTermination = true; ///< Whether to settle phantom bullets as soon as it is known that they will never hit anything.
+    float m_fPhantomTolerance = 4.0f; ///< How far off the real surface the planets that phantom bullets hit may be. 0 means exactly.
+    CPhantomStats m_cPhantomStats; ///< Counters for the phantom bullets fired since the last reset.
+
   public:
     CObjectManager(); ///< Constructor.
     ~CObjectManager(); ///< Destructor.
 
     CObject* create(eSpriteType t, const Vector2& v, double mass = 0, bool affected_by_gravity = FALSE); ///< Create new object.
     CPlanetObject* create_planet(const Vector2& p, double mass = 0, int radius = 500, bool affected_by_gravity = FALSE); ///< Create new planet.    
+    void create_planets(const std::vector<CPlanetDesc>& descs, std::vector<CPlanetObject*>& result); ///< Create new planets, generating their terrain in parallel.
     std::shared_ptr<CTankObject> create_tank(float angle_relative_to_planet, CPlanetObject* home_planet); ///< Create new Tank
     std::shared_ptr<CTankObject> create_tank(float angle_relative_to_planet, CPlanetObject* home_planet, XMFLOAT4 color); ///< Create new Tank with a given color.
     CBulletObject* create_bullet(eSpriteType t, const Vector2& v); ///< Create new bullet
@@ -64,6 +239,29 @@ class CObjectManager:
 
     void clear(); ///< Reset to initial conditions.
     void move(); ///< Move all objects.
+    void move_gravity_objects(); ///< Move all objects affected by gravity, integrating them on the worker pool.
+    bool get_planets_moving() { return m_gravity_field.moving() > 0; }; ///< Whether any massive objects are affected by gravity.
+    void BroadPhase(); ///< Broad phase collision detection and response.
+    void set_spatial_hash(bool hash) { m_bSpatialHash = hash; }; ///< Turn the spatial hash broad phase on or off.
+    bool get_spatial_hash() { return m_bSpatialHash; }; ///< Whether the broad phase uses the spatial hash.
+    unsigned long long get_pair_tests() { return m_nPairTests; }; ///< Number of narrow phase tests so far.
+    unsigned long long get_pair_hits() { return m_nPairHits; }; ///< Number of narrow phase tests so far that found a collision.
+    void set_planet_batches(bool batches) { m_bPlanetBatches = batches; }; ///< Turn sweeping the bullets against each planet in one batch on or off.
+    bool get_planet_batches() { return m_bPlanetBatches; }; ///< Whether bullets are swept against each planet in one batch.
+    void set_collision_layers(bool layers) { m_bCollisionLayers = layers; }; ///< Turn skipping pairs on layers that can't collide on or off.
+    bool get_collision_layers() { return m_bCollisionLayers; }; ///< Whether pairs on layers that can't collide are skipped.
+    void reset_collision_stats() { m_cCollisionStats = CCollisionStats(); }; ///< Zero the broad phase counters.
+    const CCollisionStats& get_collision_stats() { return m_cCollisionStats; }; ///< Get the broad phase counters.
+    void set_surface_index(bool index) { m_bSurfaceIndex = index; }; ///< Turn the tank and planet index on or off.
+    bool get_surface_index() { return m_bSurfaceIndex; }; ///< Whether tank and planet queries go through the index.
+    void tank_moved(CTankObject* tank) { m_cSurfaceIndex.update_tank(tank); }; ///< Refile a tank that has changed longitude or planet.
+    void snapshot_terrain(std::vector<CTerrainSnapshot>& result); ///< Snapshot the terrain of every planet.
+    int restore_terrain(const std::vector<CTerrainSnapshot>& snapshots); ///< Put the terrain of every planet back to a snapshot.
+    void save_terrain(); ///< Save the terrain of every planet for rewind_terrain.
+    bool rewind_terrain(); ///< Put the terrain back to the last save, and forget it unless it is the only one.
+    size_t get_terrain_saves() { return m_dTerrainHistory.size(); }; ///< Number of saves of the terrain kept.
+    void set_threads(unsigned threads) { m_cWorkerPool.set_threads(threads); }; ///< Set the number of threads to integrate on. 0 means one per core.
+    unsigned get_threads() { return m_cWorkerPool.get_threads(); }; ///< Number of threads to integrate on.
     void draw(); ///< Draw all objects.
 
     void FireGun(CObject* p, eSpriteType bullet); ///< Fire object's gun.
@@ -77,11 +275,37 @@ class CObjectManager:
     void calculate_total_energy_for_all_objects();
     CPlanetObject* calculate_closest_planet(Vector2 position); ///< Calculates the closest planet at a position.
     float get_gravitational_constant() { return (float)gravitational_constant; };
+    Vector2 integrate(Vector2& position, Vector2& velocity, float dt); ///< Advance a particle in the gravitational field by one time step.
+    Vector2 integrate(CVector2d& position, Vector2& velocity, float dt); ///< Advance a particle by one time step, with the position in double precision.
+    Vector2 advance(Vector2& position, Vector2& velocity, float radius, float dt); ///< Advance a particle by one frame, taking smaller steps close to planets.
+    Vector2 advance(CVector2d& position, Vector2& velocity, float radius, float dt); ///< Advance a particle by one frame, with the position in double precision.
+    void set_large_world_size(float size) { m_fLargeWorldSize = size; }; ///< Set how big a world has to be for positions to be kept in double precision.
+    float get_large_world_size() { return m_fLargeWorldSize; }; ///< How big a world has to be for positions to be kept in double precision.
+    bool get_large_world() { return max(m_vWorldSize.x, m_vWorldSize.y) > m_fLargeWorldSize; }; ///< Whether positions are kept in double precision.
+    void set_adaptive_steps(bool adaptive) { m_bAdaptiveSteps = adaptive; }; ///< Turn sub-stepping on or off.
+    bool get_adaptive_steps() { return m_bAdaptiveSteps; }; ///< Whether sub-stepping is on.
+    unsigned long long get_integration_steps() { return m_nIntegrationSteps; }; ///< Number of integration steps taken so far.
+    bool jump_to_surface(Vector2& position, Vector2& velocity); ///< Jump along a Kepler orbit to where it next comes down to a planet's hills.
+    void set_patched_conics(bool conics) { m_bPatchedConics = conics; }; ///< Turn Kepler orbits on or off.
+    bool get_patched_conics() { return m_bPatchedConics; }; ///< Whether Kepler orbits are on.
+    eTrajectory classify_trajectory(const Vector2& position, const Vector2& velocity, float radius, float lifetime, Vector2& end, float& duration); ///< Find out whether a projectile can be shown never to hit anything.
+    void set_integrator(eIntegrator integrator) { m_eIntegrator = integrator; }; ///< Set the integrator.
+    eIntegrator get_integrator() { return m_eIntegrator; }; ///< Get the integrator.
+    string get_integrator_name(); ///< Get the name of the integrator.
+    void build_gravity_grid(bool wait = false); ///< Precompute the gravitational field over the world.
+    CGravityField& get_gravity_field() { return m_gravity_field; }; ///< Get the gravity field.
+    unsigned long long state_hash(); ///< Hash of everything the physics can change.
 
     //AI functions
     std::shared_ptr<CTankObject> get_nearest_tank(Vector2 position); ///< Returns the nearest tank to a location.
     float get_nearest_tank_location(Vector2 position, CTankObject* origin_tank=nullptr); ///< Returns the nearest tank to a location.
     float create_phantom_bullet(eSpriteType t, const Vector2& position, const Vector2& velocity, CTankObject* owner); ///< Create a phantom bullet, which moves "instantly". Returns the distance to the nearest tank.
+    void set_early_termination(bool early) { m_bEarlyTermination = early; }; ///< Turn early termination of phantom bullets on or off.
+    bool get_early_termination() { return m_bEarlyTermination; }; ///< Whether early termination of phantom bullets is on.
+    void set_phantom_tolerance(float tolerance) { m_fPhantomTolerance = tolerance; }; ///< Set how far off the surface phantom bullets may hit.
+    float get_phantom_tolerance() { return m_fPhantomTolerance; }; ///< How far off the surface phantom bullets may hit.
+    void reset_phantom_stats() { m_cPhantomStats = CPhantomStats(); }; ///< Zero the phantom bullet counters.
+    const CPhantomStats& get_phantom_stats() { return m_cPhantomStats; }; ///< Get the phantom bullet counters.
     void draw_trajectory(eSpriteType t, const Vector2& position, const Vector2& velocity, CTankObject* owner); ///< Draws the trajectory based on power
 
     list<std::shared_ptr<CTankObject>> get_tanks_list() { return m_tanks_list; };
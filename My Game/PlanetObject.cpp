@@ -7,41 +7,90 @@
 #include "Particle.h"
 #include "ParticleEngineScaling.h"
 #include "StepTimer.h"
+#include "Deterministic.h"
+
+#include <cfloat>
+#include <climits>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define TERRAIN_USE_SSE ///< 4 altitudes per instruction.
+	#include <immintrin.h>
+#endif
 
 #define PI XM_PI
 
 
+#define PLANET_RELIEF (.12f * .75f) ///< Height from the deepest valley to the highest peak of a new planet, as a fraction of its radius. See generate_noise_planetary_method.
+
 /// <summary>
 /// 
 /// </summary>
 /// <param name="p">Vector2 representing the position of the planet center.</param>
 /// <param name="radius">int representing the "sea-level radius" of the planet in pixels</param>
-/// <param name="step_size">float used in the random generation of the planet.</param>
-CPlanetObject::CPlanetObject(const Vector2& p, int radius, float step_size) : CObject(PLANET_SPRITE, p), altitudes(number_of_altitudes) {
+/// <param name="seed">Seed for the terrain. The same seed and radius always give the same terrain.</param>
+/// <param name="deferred">Leave the terrain to a later call to generate, which may be on another thread.</param>
+CPlanetObject::CPlanetObject(const Vector2& p, int radius, unsigned seed, bool deferred) : CObject(PLANET_SPRITE, p),
+	number_of_altitudes(get_altitudes_for_radius(radius)), altitudes(number_of_altitudes) {
 	sealevel_radius = radius;
+	terrain_seed = seed;
+	SetCollisionLayer(PLANET_LAYER);
 
-	//TODO: Make this procedural generation much better....
-	//generate_noise_fractal_naive(9, step_size);
-	CPlanetObject::generate_noise_planetary_method(2000, 2, 0);
-
-	//set the minimum/maximum altitudes for faster collision detection.
-	for (int altitude: altitudes){
-		if (altitude > maximum_altitude) maximum_altitude = altitude; //Set the maximum altitude, if needed.
-		if (altitude < minimum_altitude) minimum_altitude = altitude; //Set the minimum altitude, if needed.
-	}
 	core_radius = static_cast<int>(sealevel_radius * .3);
 
 	//Set the "core" collision. This shouldn't account for terrain differentials
 	m_Sphere.Radius = (float) core_radius;
 	m_Sphere.Center = Vector3((float) m_vPos.x, (float) m_vPos.y, 0);
 	//Set the maximum altitude boundary sphere. This will allow us to save some cycles on collision. We only need to check surface collisions if they intersect the maximum alitude.
-	maximum_altitude_sphere.Radius = (float) maximum_altitude;
+	//Its radius, and the minimum/maximum altitudes, are set from the terrain by refresh_sectors.
 	maximum_altitude_sphere.Center = Vector3((float) m_vPos.x, (float) m_vPos.y, 0);
+
+	if (!deferred)
+		generate();
 }
 
+/// <summary>
+/// Generates the terrain from the seed, and builds the tables, sectors and pyramid from it. It only reads and writes
+/// this planet, and doesn't use the game's random number generator, so the planets of a level can be generated at
+/// the same time on the worker pool.
+/// </summary>
+void CPlanetObject::generate() {
+	//generate_noise_fractal_naive(9, step_size);
+	generate_noise_planetary_method(2000, 2, 0);
+
+	build_polar_tables();
+	dirty_spans.reset(number_of_altitudes); //all new
+	refresh_sectors();
+}//generate
+
+/// <summary>
+/// The highest that generate_noise_planetary_method can put the terrain of a planet of a given radius, so that a level
+/// can be laid out before its planets are generated.
+/// </summary>
+/// <param name="radius">Sea level radius of the planet.</param>
+/// <returns>Distance from the center.</returns>
+int CPlanetObject::get_altitude_limit(int radius) {
+	return radius + (int)ceilf(radius * PLANET_RELIEF);
+}//get_altitude_limit
+
+/// <summary>
+/// Chooses how many altitudes a planet of a given radius gets, from its circumference, so that the columns are about
+/// as wide on every planet. That's about 4.4 units at sea level, which is what a planet of radius 500 got back when
+/// every planet had 720 of them, whatever its size. It's rounded up to a multiple of 64, so that the levels of the
+/// pyramid halve evenly, and there are never fewer than 128, so that every bin of the sector hierarchy has a sector in it.
+/// </summary>
+/// <param name="radius">Sea level radius of the planet.</param>
+/// <returns>Number of altitudes.</returns>
+int CPlanetObject::get_altitudes_for_radius(int radius) {
+	const float column_width = 2 * (float)PI * 500 / 720;
+	const int columns = (int)ceilf(2 * (float)PI * max(radius, 1) / column_width);
+	return max(128, (columns + 63) / 64 * 64);
+}//get_altitudes_for_radius
+
 void CPlanetObject::draw_planet() {
 	//int number_of_altitudes = *(&altitudes + 1) - altitudes; // Calculate the number of altitudes in the altitudes array.
 	Vector2 center = GetPos();
+	const CVector2d precise_center = GetPrecisePos(); //sprites are drawn at offsets from this, so that they don't jitter in a large world
 	Vector2 endpoint;
 	Vector2 midpoint;
 	Vector2 previousendpoint;
@@ -59,7 +108,7 @@ void CPlanetObject::draw_planet() {
 	sd.m_vPos = center;
 	for (int i = 0; i < num_waves; i++) {
 		sd.m_fRoll = (float)XM_2PI * sinf((float)i + .07f*m_pStepTimer->GetTotalSeconds());
-		m_pRenderer->Draw(sd);
+		m_pRenderer->Draw(sd, precise_center);
 	}
 
 	//Draw Atmosphere
@@ -69,7 +118,7 @@ void CPlanetObject::draw_planet() {
 	sd.m_fRoll = 0.f;
 	sd.m_f4Tint = XMFLOAT4(Colors::SkyBlue);
 	sd.m_nSpriteIndex = ATMOSPHERE_SPRITE;
-	m_pRenderer->Draw(sd);
+	m_pRenderer->Draw(sd, precise_center);
 
 	// Draw a line of each distance from the center.
 	// It will have an angle that is 2pi/index, where index is which distance it is.
@@ -78,17 +127,23 @@ void CPlanetObject::draw_planet() {
 	planet_sprite.m_nSpriteIndex = PLANETLAYER_SPRITE;
 	planet_sprite.m_fAlpha = 1.f;
 
-	for (int i = 0; i < number_of_altitudes; i++) {
+	// Flat stretches are drawn as one wide line from the coarsest level of the pyramid that is within a pixel of the surface.
+	get_render_columns(1.0f / m_pRenderer->get_scale_factor(), render_columns);
+	for (size_t i = 0; i < render_columns.size(); i++) {
 		if (i != 0) {
 			previousendpoint = endpoint;
 		}
-		angle = 2 * (float) PI * (float) i / number_of_altitudes;
-		endpoint = center + (float) altitudes[i] * Vector2((float) cos(angle), (float) sin(angle)); // Start at the center, and move in the correct angle the correct distance
-		midpoint = center + (float)altitudes[i] / 2 * Vector2((float)cos(angle), (float)sin(angle));// Start at the center, and move in the correct angle the correct distance
+		const int level = render_columns[i].first;
+		const int span = 1 << level; //altitudes in the column
+		const float height = (float)get_column_high(level, render_columns[i].second);
+		angle = 2 * (float) PI * ((float) render_columns[i].second * span + (span - 1) / 2.0f) / number_of_altitudes; //the middle of the column
+		endpoint = center + height * Vector2((float) cos(angle), (float) sin(angle)); // Start at the center, and move in the correct angle the correct distance
+		midpoint = center + height / 2 * Vector2((float)cos(angle), (float)sin(angle));// Start at the center, and move in the correct angle the correct distance
 		planet_sprite.m_vPos = midpoint;
 		planet_sprite.m_fRoll = -PI/2 + angle;
-		planet_sprite.m_fYScale = altitudes[i]/ (m_pRenderer->GetHeight(PLANETLAYER_SPRITE));
-		m_pRenderer->Draw(planet_sprite);
+		planet_sprite.m_fXScale = max(10.0f, height * angle_step * span) / (m_pRenderer->GetWidth(PLANETLAYER_SPRITE)); //wide enough to meet the next one at the top
+		planet_sprite.m_fYScale = height / (m_pRenderer->GetHeight(PLANETLAYER_SPRITE));
+		m_pRenderer->Draw(planet_sprite, precise_center + height / 2 * Vector2((float)cos(angle), (float)sin(angle)));
 		//Linear interpolation.
 		//An attempt to make the planet curves much smoother. But it did not go well. GPU was not amused.
 		//TODO: Make the planet rendering smoother.
@@ -128,7 +183,7 @@ int CPlanetObject::get_altitude_index_under_point(Vector2 p) {
 	float degrees_per_altitude_change = 360.0f / number_of_altitudes;
 
 	Vector2 direction = p - m_vPos; // Vector pointing from the center to the outside point.
-	float angle = (float) atan2(direction.y, direction.x);
+	float angle = det_atan2(direction.y, direction.x);
 	angle *= (float) (180 / PI); //Convert to degrees
 
 	int altitude_index = (int)((int)angle / degrees_per_altitude_change);
@@ -140,7 +195,7 @@ Vector2 CPlanetObject::get_surface_vector_at_index(int altitude_index) {
 	float angle = (float) (2 * PI * (float) altitude_index / number_of_altitudes);
 	altitude_index = modulo(altitude_index, number_of_altitudes);
 	int altitude = altitudes[altitude_index];
-	return m_vPos + (float) altitude * Vector2((float) cos(angle), (float) sin(angle));
+	return m_vPos + (float) altitude * Vector2(det_cos(angle), det_sin(angle));
 }
 
 /// <summary>
@@ -171,79 +226,912 @@ void CPlanetObject::generate_noise_fractal_naive(int num_iterations, float step_
 	}
 }//generate_noise
 
+/// <summary>
+/// SplitMix64, a small generator for the terrain. Each planet has its own state, so planets can be generated on
+/// different threads, and it's all integer arithmetic, so a seed gives the same terrain on every build.
+/// </summary>
+/// <param name="state">[in, out] State of the generator, which starts off as the seed.</param>
+/// <returns>The next number.</returns>
+static unsigned long long next_terrain_random(unsigned long long& state) {
+	unsigned long long z = (state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}//next_terrain_random
+
 ///< Generates a procedurally generated planet surface using a simple circle version of the planetary method
 /// Based on the article "Modelling Fake Planets" at this URL: http://paulbourke.net/fractals/noise/
-//TODO: Write a more sophisticated procedurally generated noise algorithm, potentially based on perlin noise?
+/// Each iteration raises or lowers a run of altitudes. Rather than stepping along the run, it adds the step where the
+/// run starts and takes it off again where it ends, and one pass adding those up at the end gives every altitude. That's
+/// the same surface as stepping along every run, for the cost of the iterations plus the altitudes instead of the two
+/// multiplied together. The random numbers come from terrain_seed.
 void CPlanetObject::generate_noise_planetary_method(int num_iterations, int height_step, int indices_to_move) {
-	CRandom random = CRandom();
-	int random_index, up_down;
 	//The tallest mountain in the solar system (relative to planet size) is Caloris Montes on Mercury, which is .12% of the radius.
 	//.12% however, is /way/ too small for dramatic effect in our game. So we'll multiply it by 100. Sometimes, these hills are a tad /too/ dramatic. But we can work with that.
-	const float tallest_mountain_altitude = (float) sealevel_radius * .12; 
-	if (!indices_to_move) //If we don't specify how much to move this round, we'll adjust half the planet.
+	//This used to be scaled by the highest and lowest that the terrain got to while it was being made, rather than where it
+	//ended up, and where it ended up spanned about 3/4 of that on average. PLANET_RELIEF has the 3/4 in, so the hills are as tall as they were.
+	const float tallest_mountain_altitude = (float) sealevel_radius * PLANET_RELIEF;
+	if (!indices_to_move || indices_to_move > number_of_altitudes) //If we don't specify how much to move this round, we'll adjust half the planet.
 		indices_to_move = number_of_altitudes / 2;
 
-	//Initialize all heights as 0
-	for (int i = 0; i < number_of_altitudes; i++) {
-		altitudes[i] = 0;
-	}
-	maximum_altitude = minimum_altitude = 0;
-
+	//How much the height changes at each altitude, from the one before
+	std::vector<int> steps(number_of_altitudes, 0);
+	unsigned long long state = terrain_seed;
 
 	for (int i = 0; i < num_iterations; i++) {
-		random_index = random.randn(0, number_of_altitudes);
-		up_down = random.randn(0, 1); // The probability of going up is equal to the $f(upper bound)/(upper bound + 1) $f
-		for (int j = 0; j < indices_to_move; j++) {
-			int index = modulo(random_index + j, number_of_altitudes);
-			if ((bool) up_down) {
-				altitudes[index] += height_step;
-				if (altitudes[index] > maximum_altitude) maximum_altitude = altitudes[index]; //Set the maximum altitude, if needed.
-			} else {
-				altitudes[index] -= height_step;
-				if (altitudes[index] < minimum_altitude) minimum_altitude = altitudes[index]; //Set the maximum altitude, if needed.
-			}
+		const unsigned long long r = next_terrain_random(state);
+		const int start = (int)((r >> 1) % (unsigned long long)number_of_altitudes);
+		const int step = (r & 1) ? height_step : -height_step; //up or down, equally likely
+		const int end = start + indices_to_move; //one past the run
+
+		steps[start] += step;
+		if (end < number_of_altitudes)
+			steps[end] -= step;
+		else { //wraps around
+			steps[0] += step;
+			steps[end - number_of_altitudes] -= step;
 		}
 	}
+
+	//Add up the steps. Everything starts at 0, so that's in the range too, which keeps the terrain within get_altitude_limit.
+	maximum_altitude = minimum_altitude = 0;
+	int height = 0;
+	for (int i = 0; i < number_of_altitudes; i++) {
+		height += steps[i];
+		altitudes[i] = height;
+		if (height > maximum_altitude) maximum_altitude = height;
+		if (height < minimum_altitude) minimum_altitude = height;
+	}
+
 	//Scale the heights so that mountains are in the right range. Then add sealevel_radius.
+	const float scale = maximum_altitude > minimum_altitude ? tallest_mountain_altitude / ((float)maximum_altitude - minimum_altitude) : 0;
 	for (int i = 0; i < number_of_altitudes; i++) {
-		altitudes[i] = static_cast<int>((float)altitudes[i] * tallest_mountain_altitude/((float)maximum_altitude-minimum_altitude)); //Scale the current altitude so that the tallest peak is at most tallest_mountain_altitude % of the radius
+		altitudes[i] = static_cast<int>((float)altitudes[i] * scale);
 		altitudes[i] += sealevel_radius;
 	}
-	maximum_altitude = minimum_altitude = 0;
 }//generate_noise
 
+/// <summary>
+/// Builds the tables that Intersects uses that only depend on the number of altitudes: the direction of each
+/// altitude, and a table for finding the sector that a direction is in without atan2. Directions are looked up by
+/// their pseudo-angle, which goes from 0 to 4 around the circle like the angle does, but only takes a divide to find.
+/// There are 4 slices of pseudo-angle per sector, which makes every slice narrower than every sector.
+/// </summary>
+void CPlanetObject::build_polar_tables() {
+	angle_step = 2 * (float)PI / number_of_altitudes;
+
+	directions.resize(number_of_altitudes);
+	for (int i = 0; i < number_of_altitudes; i++) //the same directions that get_surface_vector_at_index uses
+		directions[i] = Vector2(det_cos(angle_step * i), det_sin(angle_step * i));
+
+	sector_table.resize(4 * number_of_altitudes);
+	for (size_t b = 0; b < sector_table.size(); b++) {
+		const float pseudo = 4.0f * b / sector_table.size(); //pseudo-angle at the start of the slice
+		const int quadrant = (int)pseudo;
+		const float f = pseudo - quadrant;
+		const Vector2 v = quadrant == 0 ? Vector2(1 - f, f) : quadrant == 1 ? Vector2(-f, 1 - f) : quadrant == 2 ? Vector2(f - 1, -f) : Vector2(f, f - 1);
+		const int sector = (int)floorf(det_atan2(v.y, v.x) / angle_step);
+		sector_table[b] = modulo(sector - 1, number_of_altitudes); //one early, in case atan2 rounds the other way from get_sector_under
+	}
+
+	//The pyramid levels, halving the columns until there would be too few.
+	pyramid_low.clear();
+	pyramid_high.clear();
+	for (int columns = number_of_altitudes; columns % 2 == 0 && columns / 2 >= MIN_PYRAMID_COLUMNS; columns /= 2) {
+		pyramid_low.push_back(std::vector<int>(columns / 2));
+		pyramid_high.push_back(std::vector<int>(columns / 2));
+	}
+}//build_polar_tables
+
+/// <summary>
+/// Recomputes what is cached about a span of sectors after the terrain changes. The surface in a sector is the edge
+/// between two neighboring altitudes. It can't go further out than the higher of the two, and it can't come in closer
+/// than the lower one times the cosine of half the angle between them. Its outward normal is the edge turned a
+/// quarter turn clockwise, since the altitudes go round anticlockwise.
+/// </summary>
+/// <param name="first">First sector to update. Can be negative; it wraps around.</param>
+/// <param name="last">Last sector to update, which may be past the end; it wraps around too.</param>
+void CPlanetObject::update_sectors(int first, int last) {
+	sector_inner.resize(number_of_altitudes);
+	sector_outer.resize(number_of_altitudes);
+	normals.resize(number_of_altitudes);
+	const float shrink = det_cos(angle_step / 2);
+
+	for (int i = first; i <= last && i < first + number_of_altitudes; i++) {
+		const int s = modulo(i, number_of_altitudes);
+		const int s1 = modulo(s + 1, number_of_altitudes);
+		const int a0 = altitudes[s];
+		const int a1 = altitudes[s1];
+		sector_inner[s] = (float)min(a0, a1) * shrink;
+		sector_outer[s] = (float)max(a0, a1);
+
+		const Vector2 e = (float)a1 * directions[s1] - (float)a0 * directions[s];
+		normals[s] = Vector2(e.y, -e.x);
+		det_normalize(normals[s]);
+	}
+
+	update_levels(first, last);
+	update_pyramid(first, last + 1); //sector last ends at altitude last + 1
+}//update_sectors
+
+/// <summary>
+/// Called by the terrain edits with the span of altitudes that they changed, which is logged in dirty_spans for
+/// everything built from the altitudes to catch up from. Outside of begin_edits and end_edits the sectors catch up
+/// straight away, and inside they are held back so that end_edits can update each sector once.
+/// </summary>
+/// <param name="first">First altitude that changed. Can be negative; it wraps around.</param>
+/// <param name="last">Last altitude that changed, which may be past the end; it wraps around too.</param>
+void CPlanetObject::terrain_changed(int first, int last) {
+	dirty_spans.add(first, last);
+	if (edit_depth == 0) refresh_sectors();
+}//terrain_changed
+
+/// <summary>
+/// Brings the sectors, the min/max hierarchy and the pyramid up to date with the terrain, by updating them over each
+/// span of altitudes changed since they were last brought up to date. The spans come back merged, so sectors under
+/// more than one crater are only updated once. The sector before each span is updated too, since it ends at the
+/// first altitude in it. Then the minimum and maximum altitudes are tightened back up from the top of the pyramid.
+/// </summary>
+/// <returns>The number of spans that were updated.</returns>
+int CPlanetObject::refresh_sectors() {
+	if (!dirty_spans.collect(sector_version, sector_spans)) return 0;
+
+	for (const std::pair<int, int>& span : sector_spans) {
+		if (span.second - span.first + 1 >= number_of_altitudes) update_sectors(0, number_of_altitudes - 1); //the lot
+		else update_sectors(span.first - 1, span.second);
+	}
+	update_altitude_bounds();
+
+	return (int)sector_spans.size();
+}//refresh_sectors
+
+/// <summary>
+/// Sets the minimum and maximum altitudes, and the radius of the sphere around the highest hill, to exactly what they
+/// are. The top level of the pyramid already has the lowest and highest altitude in each of its few columns, so this
+/// doesn't have to look at the altitudes themselves.
+/// </summary>
+void CPlanetObject::update_altitude_bounds() {
+	const int top = get_pyramid_levels() - 1;
+	maximum_altitude = INT_MIN;
+	minimum_altitude = INT_MAX;
+	for (int c = 0; c < (number_of_altitudes >> top); c++) {
+		maximum_altitude = max(maximum_altitude, get_column_high(top, c));
+		minimum_altitude = min(minimum_altitude, get_column_low(top, c));
+	}
+	maximum_altitude_sphere.Radius = (float)maximum_altitude;
+}//update_altitude_bounds
+
+/// <summary>
+/// Starts holding back the sector updates for terrain edits, for when a lot of edits are about to be made at once,
+/// such as all of the bullets that hit the planet in a frame. Nothing that reads the sectors, such as Intersects,
+/// Sweep or get_signed_distance, may be called on the planet until the matching end_edits. Calls can be nested.
+/// </summary>
+void CPlanetObject::begin_edits() {
+	edit_depth++;
+}//begin_edits
+
+/// <summary>
+/// Updates the sectors for the edits held back since begin_edits, once the outermost call is matched.
+/// </summary>
+/// <returns>The number of spans that were updated after merging.</returns>
+int CPlanetObject::end_edits() {
+	if (edit_depth == 0 || --edit_depth > 0) return 0;
+	return refresh_sectors();
+}//end_edits
+
+/// <summary>
+/// Brings the snapshot of the terrain up to date and returns it. Only the chunks that the dirty spans say were touched
+/// since the last snapshot are copied, and the rest are shared with it, so if nothing changed this is just a pointer
+/// copy for whoever keeps it. Keep a copy, rather than the reference, since the next call replaces it. The copy can be
+/// read on another thread while this planet carries on being edited.
+/// </summary>
+/// <returns>The snapshot.</returns>
+const CTerrainSnapshot& CPlanetObject::get_terrain_snapshot() {
+	if (dirty_spans.collect(snapshot_version, snapshot_spans))
+		terrain_snapshot.update(altitudes, snapshot_spans);
+	return terrain_snapshot;
+}//get_terrain_snapshot
+
+/// <summary>
+/// Puts the terrain back the way it was when a snapshot was taken, for undoing and rewinding. Chunks that the snapshot
+/// shares with the terrain as it is now are the same already, so only the ones that differ are copied back, and only
+/// the sectors over those are updated, as if they had been edited. Afterwards the terrain shares every chunk with the
+/// snapshot again. A snapshot of a planet with a different number of altitudes is ignored.
+/// </summary>
+/// <param name="snapshot">The snapshot.</param>
+/// <returns>The number of chunks copied back.</returns>
+int CPlanetObject::restore_terrain(const CTerrainSnapshot& snapshot) {
+	if (snapshot.size() != number_of_altitudes) return 0;
+	get_terrain_snapshot(); //so that the chunks that differ can be told apart from the ones that don't
+
+	int restored = 0;
+	begin_edits();
+	for (int c = 0; c < snapshot.get_chunk_count(); c++)
+		if (!snapshot.same_chunk(terrain_snapshot, c)) {
+			snapshot.copy_chunk(c, altitudes);
+			terrain_changed(c * CTerrainSnapshot::CHUNK_SIZE, (c + 1) * CTerrainSnapshot::CHUNK_SIZE - 1);
+			restored++;
+		}
+	end_edits();
+
+	terrain_snapshot = snapshot; //which the terrain now matches
+	snapshot_version = dirty_spans.get_version();
+	return restored;
+}//restore_terrain
+
+/// <summary>
+/// Recomputes the bins of the min/max hierarchy that are above a span of sectors, from the bottom up. The 128 bins
+/// come from the sectors in them, and each bin above that from the 4 bins under it, so an edit touches a handful of
+/// sectors and 4 bins per level on top of the ones it changed.
+/// </summary>
+/// <param name="first">First sector that changed. Can be negative; it wraps around.</param>
+/// <param name="last">Last sector that changed, which may be past the end; it wraps around too.</param>
+void CPlanetObject::update_levels(int first, int last) {
+	if (last - first >= number_of_altitudes) { //the lot
+		first = 0;
+		last = number_of_altitudes - 1;
+	}
+
+	for (int level = SECTOR_LEVELS - 1; level >= 0; level--) {
+		const int bins = get_level_bins(level);
+		level_inner[level].resize(bins);
+		level_outer[level].resize(bins);
+
+		const int first_bin = get_bin(modulo(first, number_of_altitudes), level);
+		int count = get_bin(modulo(last, number_of_altitudes), level) - first_bin; //bins in the span, less one
+		if (count < 0 || (count == 0 && last - first >= number_of_altitudes / 2)) count += bins; //wrapped
+
+		for (int n = 0; n <= count && n < bins; n++) {
+			const int b = (first_bin + n) % bins;
+			float inner = FLT_MAX, outer = 0;
+
+			if (level == SECTOR_LEVELS - 1) { //from the sectors
+				for (int j = get_bin_start(b, level); j < get_bin_start(b + 1, level); j++) {
+					inner = min(inner, sector_inner[j]);
+					outer = max(outer, sector_outer[j]);
+				}
+			}
+			else { //from the 4 bins below
+				for (int c = 4 * b; c < 4 * b + 4; c++) {
+					inner = min(inner, level_inner[level + 1][c]);
+					outer = max(outer, level_outer[level + 1][c]);
+				}
+			}
+
+			level_inner[level][b] = inner;
+			level_outer[level][b] = outer;
+		}
+	}
+}//update_levels
+
+/// <summary>
+/// Recomputes the columns of the pyramid that are above a span of altitudes, from the bottom up, the same way that
+/// update_levels does the bins.
+/// </summary>
+/// <param name="first">First altitude that changed. Can be negative; it wraps around.</param>
+/// <param name="last">Last altitude that changed, which may be past the end; it wraps around too.</param>
+void CPlanetObject::update_pyramid(int first, int last) {
+	if (last - first >= number_of_altitudes) { //the lot
+		first = 0;
+		last = number_of_altitudes - 1;
+	}
+
+	for (int level = 1; level < get_pyramid_levels(); level++) {
+		std::vector<int>& low = pyramid_low[level - 1];
+		std::vector<int>& high = pyramid_high[level - 1];
+		const int columns = (int)high.size();
+
+		const int first_column = modulo(first, number_of_altitudes) >> level;
+		int count = (modulo(last, number_of_altitudes) >> level) - first_column; //columns in the span, less one
+		if (count < 0 || (count == 0 && last - first >= number_of_altitudes / 2)) count += columns; //wrapped
+
+		for (int n = 0; n <= count && n < columns; n++) {
+			const int c = (first_column + n) % columns;
+			low[c] = min(get_column_low(level - 1, 2 * c), get_column_low(level - 1, 2 * c + 1));
+			high[c] = max(get_column_high(level - 1, 2 * c), get_column_high(level - 1, 2 * c + 1));
+		}
+	}
+}//update_pyramid
+
+/// <summary>
+/// Finds how far the highest altitude in a column of the pyramid can be from the surface under it. That's the
+/// spread of the altitudes in the column, plus how far a straight line across the column at that height sags
+/// below the circle, which covers drawing the column as one flat line or sweeping against it as one edge.
+/// </summary>
+/// <param name="level">Level of the pyramid.</param>
+/// <param name="column">Column at that level.</param>
+/// <returns>The error, in the same units as the altitudes.</returns>
+float CPlanetObject::get_column_error(int level, int column) {
+	const int high = get_column_high(level, column);
+	return (float)(high - get_column_low(level, column)) + high * (1 - det_cos(angle_step * (1 << level) / 2));
+}//get_column_error
+
+/// <summary>
+/// Finds the coarsest column of the pyramid over an altitude that is within a tolerance of the surface. A column's
+/// error is never less than the errors of the two columns under it, so the first one down from the top will do.
+/// </summary>
+/// <param name="altitude">Index of the altitude.</param>
+/// <param name="tolerance">How far off the surface the column may be.</param>
+/// <returns>The level of the column, which is 0, the altitude itself, if nothing coarser will do.</returns>
+int CPlanetObject::get_column_level(int altitude, float tolerance) {
+	for (int level = get_pyramid_levels() - 1; level > 0; level--)
+		if (get_column_error(level, altitude >> level) <= tolerance) return level;
+	return 0;
+}//get_column_level
+
+/// <summary>
+/// Finds the columns to draw the planet with. Starting from the top of the pyramid, each column that is within the
+/// tolerance of the surface is drawn as it is, and each one that isn't is split into the two under it, so that the
+/// flat stretches are drawn with a few wide columns and the rough ones with all of the altitudes.
+/// </summary>
+/// <param name="tolerance">How far the columns may be off the surface, say a pixel.</param>
+/// <param name="result">[out] The level and the column at that level of each column to draw, in order round the planet.</param>
+void CPlanetObject::get_render_columns(float tolerance, std::vector<std::pair<int, int>>& result) {
+	result.clear();
+	const int top = get_pyramid_levels() - 1;
+	for (int c = 0; c < (number_of_altitudes >> top); c++)
+		add_render_columns(top, c, tolerance, result);
+}//get_render_columns
+
+/// <summary>
+/// Adds a column to the list for get_render_columns if it is within the tolerance, or else the columns under it.
+/// </summary>
+/// <param name="level">Level of the pyramid.</param>
+/// <param name="column">Column at that level.</param>
+/// <param name="tolerance">How far the columns may be off the surface.</param>
+/// <param name="result">[in, out] The columns to draw.</param>
+void CPlanetObject::add_render_columns(int level, int column, float tolerance, std::vector<std::pair<int, int>>& result) {
+	if (level == 0 || get_column_error(level, column) <= tolerance) result.push_back(std::make_pair(level, column));
+	else {
+		add_render_columns(level - 1, 2 * column, tolerance, result);
+		add_render_columns(level - 1, 2 * column + 1, tolerance, result);
+	}
+}//add_render_columns
+
+/// <summary>
+/// Adds up the memory used by the altitudes and everything built from them, for the benchmarks.
+/// </summary>
+/// <returns>Bytes used.</returns>
+size_t CPlanetObject::get_memory_bytes() {
+	size_t bytes = altitudes.capacity() * sizeof(int) + directions.capacity() * sizeof(Vector2) +
+		(sector_inner.capacity() + sector_outer.capacity()) * sizeof(float) + normals.capacity() * sizeof(Vector2) +
+		sector_table.capacity() * sizeof(int);
+	for (int level = 0; level < SECTOR_LEVELS; level++)
+		bytes += (level_inner[level].capacity() + level_outer[level].capacity()) * sizeof(float);
+	for (size_t level = 0; level < pyramid_high.size(); level++)
+		bytes += (pyramid_low[level].capacity() + pyramid_high[level].capacity()) * sizeof(int);
+	return bytes;
+}//get_memory_bytes
+
+/// <summary>
+/// Gets the outward normal at a point on the surface edge of a sector. At the ends of the edge, where it meets the
+/// next one at an angle, the normal is halfway between the normals of the two edges.
+/// </summary>
+/// <param name="sector">The sector.</param>
+/// <param name="t">How far along the edge, from 0 at its first altitude to 1 at the next.</param>
+/// <returns>Unit outward normal.</returns>
+Vector2 CPlanetObject::get_edge_normal(int sector, float t) {
+	if (t > 0 && t < 1) return normals[sector];
+	const int other = modulo(t <= 0 ? sector - 1 : sector + 1, number_of_altitudes);
+	Vector2 n = normals[sector] + normals[other];
+	det_normalize(n);
+	return n;
+}//get_edge_normal
+
+/// <summary>
+/// Finds how far a point is from the surface, and the surface normal there. The distance is negative under the
+/// surface. Only the edges within two sectors of the point are looked at, which makes it O(1). That is exact near
+/// the surface, which is where it matters; further away it can overestimate the distance, but never gets the sign wrong.
+/// </summary>
+/// <param name="point">The point.</param>
+/// <param name="normal">[out] Unit outward normal at the nearest point on the surface.</param>
+/// <returns>Signed distance to the surface.</returns>
+float CPlanetObject::get_signed_distance(const Vector2& point, Vector2& normal) {
+	const Vector2 offset = point - m_vPos;
+	if (offset.x == 0 && offset.y == 0) { //dead center, where every direction is as good as another
+		normal = normals[0];
+		return -sector_inner[0];
+	}
+
+	const int i = get_sector_under(offset);
+	float best = FLT_MAX;
+	int best_sector = i;
+	float best_t = 0.5f;
+
+	for (int j = i - 2; j <= i + 2; j++) {
+		const int s = modulo(j, number_of_altitudes);
+		const int s1 = s + 1 == number_of_altitudes ? 0 : s + 1;
+		const Vector2 a = (float)altitudes[s] * directions[s];
+		const Vector2 edge = (float)altitudes[s1] * directions[s1] - a;
+		const Vector2 q = offset - a;
+		const float len2 = edge.Dot(edge);
+		const float t = len2 > 0 ? min(1.0f, max(0.0f, q.Dot(edge) / len2)) : 0.0f;
+		const Vector2 gap = q - t * edge;
+		const float gap2 = gap.Dot(gap);
+		if (gap2 < best) {
+			best = gap2;
+			best_sector = s;
+			best_t = t;
+		}
+	}
+
+	normal = get_edge_normal(best_sector, best_t);
+
+	//It's under the surface if it's on the inside of the edge in its own sector.
+	const int i1 = i + 1 == number_of_altitudes ? 0 : i + 1;
+	const Vector2 v0 = (float)altitudes[i] * directions[i];
+	const Vector2 e = (float)altitudes[i1] * directions[i1] - v0;
+	const Vector2 w = offset - v0;
+	const float distance = sqrtf(best);
+	return e.x * w.y - e.y * w.x >= 0 ? -distance : distance;
+}//get_signed_distance
+
+/// <summary>
+/// Finds the sector that a vector from the center points into, which is the same as the altitude index just
+/// clockwise of it. It looks up the pseudo-angle in sector_table, which is never more than a couple of sectors
+/// behind, and then steps forward while the vector is anticlockwise of the start of the next sector.
+/// </summary>
+/// <param name="offset">Vector from the center of the planet. Must not be zero.</param>
+/// <returns>Sector index.</returns>
+int CPlanetObject::get_sector_under(const Vector2& offset) {
+	const float x = offset.x, y = offset.y;
+	float pseudo;
+	if (y >= 0) pseudo = x >= 0 ? y / (x + y) : 1 - x / (y - x);
+	else pseudo = x < 0 ? 2 - y / (-x - y) : 3 + x / (x - y);
+
+	int b = (int)(pseudo * number_of_altitudes); //4 slices per sector, 4 units of pseudo-angle
+	if (b >= (int)sector_table.size()) b = (int)sector_table.size() - 1;
+	int i = sector_table[b];
 
+	for (int n = 0; n < 4; n++) {
+		const int next = i + 1 == number_of_altitudes ? 0 : i + 1;
+		const Vector2& d = directions[next];
+		if (d.x * y - d.y * x < 0) break; //clockwise of the next one, so it's in this one
+		i = next;
+	}
+	return i;
+}//get_sector_under
 
+/// <summary>
+/// Checks if a sphere intersects the planet. The planet is the fan of triangles between the center and each pair of
+/// neighboring surface points, so the sphere intersects it if its center is inside, or if it comes within its radius of
+/// one of the surface edges. It is done in polar coordinates relative to the center: no atan2, no sines or cosines,
+/// and no triangles, just squared distances against the sector bounds and the odd distance to an edge.
+/// This gets called for every bullet near every planet every frame, and every step of every phantom bullet.
+/// How it got settled is counted in the planet's sector stats, so it must only be called on the main thread.
+/// </summary>
+/// <param name="object_boundary">The sphere.</param>
+/// <returns>TRUE if it intersects.</returns>
 bool CPlanetObject::Intersects(BoundingSphere &object_boundary) {
-	if (m_Sphere.Intersects(object_boundary)){
+	return Intersects(object_boundary, sector_stats);
+}//Intersects
+
+/// <summary>
+/// Checks if a sphere intersects the planet, the same as Intersects, but counts how it got settled in the caller's
+/// stats rather than the planet's. Nothing of the planet's is written, so it can be called from worker threads.
+/// </summary>
+/// <param name="object_boundary">The sphere.</param>
+/// <param name="stats">[in, out] Counters for how the test got settled.</param>
+/// <returns>TRUE if it intersects.</returns>
+bool CPlanetObject::Intersects(const BoundingSphere &object_boundary, CSectorStats& stats) {
+	const Vector2 offset = Vector2(object_boundary.Center.x - m_vPos.x, object_boundary.Center.y - m_vPos.y);
+	const float distance_squared = offset.Dot(offset);
+	const float r = object_boundary.Radius;
+
+	const float core = m_Sphere.Radius + r;
+	if (distance_squared <= core * core) { //touches the core
+		stats.m_nAccepted[0]++;
 		return TRUE;
 	}
-	else if (maximum_altitude_sphere.Intersects(object_boundary)){
-		Vector2 center = Vector2(object_boundary.Center.x, object_boundary.Center.y);
-		int altitude_index = get_altitude_index_under_point(center);
+	const float outer = maximum_altitude_sphere.Radius + r;
+	if (distance_squared > outer * outer) { //above the highest hill
+		stats.m_nRejected[0]++;
+		return FALSE;
+	}
+	return intersects_polar(offset, distance_squared, r, stats);
+}//Intersects
 
+/// <summary>
+/// The part of Intersects after it has been found that the sphere is between the core and the top of the highest hill.
+/// Sectors that the sphere might overlap are the ones within its angular radius, which is asin(r/d). That's no more
+/// than 1.05 r/d while r/d is less than a half. A sphere bigger than that is checked against every sector, which is
+/// slow, but nothing that big gets this far without touching the core.
+/// </summary>
+/// <param name="offset">Vector from the center of the planet to the center of the sphere.</param>
+/// <param name="distance_squared">Squared length of offset.</param>
+/// <param name="radius">Radius of the sphere.</param>
+/// <param name="stats">[in, out] Counters for how the test got settled.</param>
+/// <returns>TRUE if it intersects.</returns>
+bool CPlanetObject::intersects_polar(const Vector2& offset, float distance_squared, float radius, CSectorStats& stats) {
+	const int i = get_sector_under(offset);
+	const float d = sqrtf(distance_squared);
+	const int k = 2 * radius > d ? number_of_altitudes / 2 : (int)ceilf(1.05f * radius / (d * angle_step));
 
-		Vector2 v0, v1;
+	//Work down the hierarchy. The point of the sphere straight below its center is in the same bin as the center, so if
+	//that's under the lowest surface in the bin, the sphere intersects. If the sphere only overlaps one or two bins
+	//and is above the highest surface in them, it doesn't.
+	for (int level = 0; level < SECTOR_LEVELS; level++) {
+		const int bins = get_level_bins(level);
+		const int b = get_bin(i, level);
+		const float below = level_inner[level][b] + radius;
+		if (distance_squared <= below * below) {
+			stats.m_nAccepted[level + 1]++;
+			return TRUE;
+		}
 
-		//Now, we need to check if it intersects the triangles below the point.
-		//A triangle has vertices of the planet center and the surface positions at two adjacent altitudes indices
-		//We check two triangles back and two triangles forward.
-		for (int i = -2; i < 2; ++i) {
-			int current_index = modulo((altitude_index + i), number_of_altitudes); // We want to make sure we get indices that are within the proper range.
-			v0 = get_surface_vector_at_index(current_index);
-			v1 = get_surface_vector_at_index(current_index + 1);
-			if (m_vPos != v0 && m_vPos != v1 && v0 != v1) { //Things crash if the triangle is degenerate (i.e. two points are the same).
-				if (object_boundary.Intersects(m_vPos, v0, v1)) {
-					return TRUE;
-				}
+		if (2 * k + 1 < number_of_altitudes / bins) { //can't span more than two bins
+			const int b0 = get_bin(modulo(i - k, number_of_altitudes), level);
+			const int b1 = get_bin(modulo(i + k, number_of_altitudes), level);
+			const float above = max(level_outer[level][b0], level_outer[level][b1]) + radius;
+			if (distance_squared > above * above) {
+				stats.m_nRejected[level + 1]++;
+				return FALSE;
 			}
 		}
 	}
-	
-	//Didn't intersect any thing, so we can return FALSE.
+
+	if (distance_squared <= sector_inner[i] * sector_inner[i]) { //center is under the surface
+		stats.m_nAccepted[4]++;
+		return TRUE;
+	}
+
+	//Is the center under the surface in its own sector?
+	const int i1 = i + 1 == number_of_altitudes ? 0 : i + 1;
+	const Vector2 v0 = (float)altitudes[i] * directions[i];
+	const Vector2 v1 = (float)altitudes[i1] * directions[i1];
+	const Vector2 e = v1 - v0;
+	const Vector2 w = offset - v0;
+	if (e.x * w.y - e.y * w.x >= 0) {
+		stats.m_nAccepted[4]++;
+		return TRUE;
+	}
+
+	//Does it come within its radius of the surface in any of the sectors it overlaps?
+	for (int j = i - k; j <= i + k; j++) {
+		const int s = modulo(j, number_of_altitudes);
+		if (d - radius > sector_outer[s]) continue; //all of it is above the surface here
+
+		const int s1 = s + 1 == number_of_altitudes ? 0 : s + 1;
+		const Vector2 a = (float)altitudes[s] * directions[s];
+		const Vector2 edge = (float)altitudes[s1] * directions[s1] - a;
+		const Vector2 q = offset - a;
+		const float len2 = edge.Dot(edge);
+		const float t = len2 > 0 ? min(1.0f, max(0.0f, q.Dot(edge) / len2)) : 0.0f;
+		const Vector2 gap = q - t * edge;
+		if (gap.Dot(gap) <= radius * radius) {
+			stats.m_nAccepted[4]++;
+			return TRUE;
+		}
+	}
+
+	stats.m_nRejected[4]++;
 	return FALSE;
+}//intersects_polar
+
+/// <summary>
+/// Checks a lot of spheres against the planet at once, giving the same answers as calling Intersects on each.
+/// The quick tests are done on all of them first, in a tight loop that the compiler can vectorize, and only the
+/// ones left undecided, which are the ones near the surface, go on to the sector tests.
+/// </summary>
+/// <param name="spheres">The spheres.</param>
+/// <param name="count">How many spheres there are.</param>
+/// <param name="results">[out] Whether each sphere intersects the planet.</param>
+void CPlanetObject::Intersects(const BoundingSphere* spheres, size_t count, bool* results) {
+	const float cx = m_vPos.x, cy = m_vPos.y;
+	const float core = m_Sphere.Radius;
+	const float outer = maximum_altitude_sphere.Radius;
+	undecided.clear();
+
+	for (size_t k = 0; k < count; k++) {
+		const float dx = spheres[k].Center.x - cx;
+		const float dy = spheres[k].Center.y - cy;
+		const float r = spheres[k].Radius;
+		const float distance_squared = dx * dx + dy * dy;
+		const bool in_core = distance_squared <= (core + r) * (core + r);
+		const bool above = distance_squared > (outer + r) * (outer + r);
+		results[k] = in_core;
+		if (in_core) sector_stats.m_nAccepted[0]++;
+		else if (above) sector_stats.m_nRejected[0]++;
+		else undecided.push_back((unsigned)k);
+	}
+
+	for (unsigned k : undecided) {
+		const Vector2 offset = Vector2(spheres[k].Center.x - cx, spheres[k].Center.y - cy);
+		results[k] = intersects_polar(offset, offset.Dot(offset), spheres[k].Radius, sector_stats);
+	}
 }//Intersects
 
+/// <summary>
+/// Finds the earliest time that a moving circle comes within touching distance of a line segment,
+/// which is when it hits one of the segment's sides or one of its ends.
+/// </summary>
+/// <param name="p">Where the center of the circle starts.</param>
+/// <param name="d">How far the center of the circle moves.</param>
+/// <param name="a">One end of the segment.</param>
+/// <param name="b">The other end of the segment.</param>
+/// <param name="r">Radius of the circle.</param>
+/// <param name="t">[out] Fraction of the way along d that it first touches, if it does.</param>
+/// <returns>TRUE if it touches somewhere between the start and the end of d.</returns>
+static bool sweep_circle_segment(const Vector2& p, const Vector2& d, const Vector2& a, const Vector2& b, float r, float& t) {
+	bool hit = FALSE;
+	t = 1.0f;
+
+	//The sides. The center has to get within r of the line, between the ends.
+	const Vector2 e = b - a;
+	const float len2 = e.Dot(e);
+	if (len2 > 0) {
+		Vector2 n = Vector2(-e.y, e.x);
+		det_normalize(n);
+		const float dist = (p - a).Dot(n);
+		const float dn = d.Dot(n);
+		if (dn != 0) {
+			for (float side : {r, -r}) {
+				const float ts = (side - dist) / dn;
+				const float along = (p + ts * d - a).Dot(e);
+				if (ts >= 0 && ts <= t && along >= 0 && along <= len2) {
+					t = ts;
+					hit = TRUE;
+				}
+			}
+		}
+	}
+
+	//The ends. The center has to get within r of one of them.
+	const float dd = d.Dot(d);
+	if (dd > 0) {
+		for (const Vector2* end : {&a, &b}) {
+			const Vector2 m = p - *end;
+			const float half_b = m.Dot(d);
+			const float disc = half_b * half_b - dd * (m.Dot(m) - r * r);
+			if (disc >= 0) {
+				const float te = (-half_b - sqrtf(disc)) / dd;
+				if (te >= 0 && te <= t) {
+					t = te;
+					hit = TRUE;
+				}
+			}
+		}
+	}
+
+	return hit;
+}//sweep_circle_segment
+
+/// <summary>
+/// Checks if a sphere moving in a straight line hits the planet, and if so, when and where it first touches.
+/// Intersects only looks at where something ends up, so anything that moves further than a hill is wide in one frame
+/// can go straight through it. This sweeps the sphere along the whole line instead, against the edges of the surface
+/// between the altitudes it passes over, so it can't miss a hill however fast it goes.
+/// </summary>
+/// <param name="from">Where the center of the sphere starts.</param>
+/// <param name="to">Where the center of the sphere ends up.</param>
+/// <param name="radius">Radius of the sphere.</param>
+/// <param name="toi">[out] Time of impact, as a fraction of the way from start to end.</param>
+/// <param name="contact">[out] The point on the surface that the sphere touches first.</param>
+/// <param name="normal">[out] If not null, the outward surface normal at the contact point.</param>
+/// <returns>TRUE if the sphere touches the planet anywhere along the line.</returns>
+bool CPlanetObject::Sweep(const Vector2& from, const Vector2& to, float radius, float& toi, Vector2& contact, Vector2* normal) {
+	BoundingSphere start;
+	start.Center = Vector3(from.x, from.y, 0);
+	start.Radius = radius;
+	if (Intersects(start)) { //already touching
+		toi = 0;
+		contact = from;
+		if (normal) get_signed_distance(from, *normal);
+		return TRUE;
+	}
+
+	//Clip the line to the sphere that the highest hill fits in, plus the radius. Nothing outside that can touch.
+	const Vector2 d = to - from;
+	const Vector2 rel = from - m_vPos;
+	const float reach = maximum_altitude_sphere.Radius + radius;
+	const float a = d.Dot(d);
+	if (a == 0) return FALSE; //not moving, and not touching at the start
+	const float half_b = rel.Dot(d);
+	const float disc = half_b * half_b - a * (rel.Dot(rel) - reach * reach);
+	if (disc < 0) return FALSE; //misses the lot
+	const float t0 = max(0.0f, (-half_b - sqrtf(disc)) / a);
+	const float t1 = min(1.0f, (-half_b + sqrtf(disc)) / a);
+	if (t0 > t1) return FALSE; //gets there next frame, or got past it last frame
+
+	//The altitudes that the clipped line passes over, going the short way round, with enough extra on each end
+	//to cover the radius. If it goes the long way round, it goes through the middle and hits on the way in anyway.
+	const Vector2 p0 = rel + t0 * d;
+	const Vector2 p1 = rel + t1 * d;
+	const float step = 2 * (float)PI / number_of_altitudes;
+	const float angle0 = det_atan2(p0.y, p0.x);
+	float span = det_atan2(p1.y, p1.x) - angle0;
+	if (span > (float)PI) span -= 2 * (float)PI;
+	else if (span < -(float)PI) span += 2 * (float)PI;
+	const int extra = 1 + (int)ceilf(radius / (step * max(core_radius, 1)));
+	const int first = (int)floorf(min(angle0, angle0 + span) / step) - extra;
+	const int last = (int)floorf(max(angle0, angle0 + span) / step) + extra;
+
+	//The closest that the clipped line comes to the center. Edges in a 128 bin whose highest surface is below that,
+	//less the radius, can't be touched, so the whole bin can be skipped.
+	const float closest_t = min(t1, max(t0, -half_b / a));
+	const Vector2 closest = rel + closest_t * d;
+	const float lowest = sqrtf(closest.Dot(closest)) - radius;
+	const int finest = SECTOR_LEVELS - 1;
+
+	//Sweep against each edge of the surface in that range, and keep the first hit.
+	float best = 2.0f;
+	Vector2 best_v0, best_v1;
+	int best_sector = 0;
+	for (int i = first; i <= last; i++) {
+		const int s = modulo(i, number_of_altitudes);
+		const int b = get_bin(s, finest);
+		if (i == first || s == get_bin_start(b, finest)) { //first sector in a bin
+			sector_stats.m_nSweepBins++;
+			if (lowest > level_outer[finest][b]) {
+				sector_stats.m_nSweepBinsSkipped++;
+				i += get_bin_start(b + 1, finest) - s - 1; //to the last sector in the bin
+				continue;
+			}
+		}
+
+		const Vector2 v0 = get_surface_vector_at_index(i);
+		const Vector2 v1 = get_surface_vector_at_index(i + 1);
+		float t;
+		if (sweep_circle_segment(from, d, v0, v1, radius, t) && t < best) {
+			best = t;
+			best_v0 = v0;
+			best_v1 = v1;
+			best_sector = modulo(i, number_of_altitudes);
+		}
+	}
+	if (best > 1.0f) return FALSE;
+
+	//The contact point is the closest point on the edge to the center of the sphere at the time of impact.
+	toi = best;
+	const Vector2 center = from + toi * d;
+	const Vector2 e = best_v1 - best_v0;
+	const float len2 = e.Dot(e);
+	const float along = len2 > 0 ? min(1.0f, max(0.0f, (center - best_v0).Dot(e) / len2)) : 0.0f;
+	contact = best_v0 + along * e;
+	if (normal) *normal = get_edge_normal(best_sector, along);
+	return TRUE;
+}//Sweep
+
+/// <summary>
+/// Sweeps a lot of spheres against the planet at once, such as all of the bullets near it this frame. The lines that
+/// can't get within their radius of the highest hill are thrown out first, in a loop over the batch with no branches
+/// in it, which the compiler can vectorize. The rest are sorted by the sector that they start over, so that the ones
+/// that are close together are swept one after the other and share whatever of the altitudes and sector tables is in
+/// the cache. The result for each line is the same as the single Sweep gives it.
+/// </summary>
+/// <param name="from">Where each sphere starts.</param>
+/// <param name="to">Where each sphere ends up.</param>
+/// <param name="radius">Radius of each sphere.</param>
+/// <param name="count">Number of spheres.</param>
+/// <param name="toi">[out] For each sphere, the fraction of the way along its line where it first touches, or 2 if it doesn't.</param>
+void CPlanetObject::Sweep(const Vector2* from, const Vector2* to, const float* radius, size_t count, float* toi) {
+	const float cx = m_vPos.x, cy = m_vPos.y;
+	const float top = maximum_altitude_sphere.Radius;
+	batch_gap.resize(count);
+	float* gap = batch_gap.data();
+
+	//The closest each line comes to the center, less the highest hill and the radius, squared.
+	for (size_t k = 0; k < count; k++) {
+		const float x = from[k].x - cx, y = from[k].y - cy;
+		const float dx = to[k].x - from[k].x, dy = to[k].y - from[k].y;
+		const float a = dx * dx + dy * dy;
+		float t = -(x * dx + y * dy) / (a + FLT_MIN);
+		t = t < 0 ? 0 : t > 1 ? 1 : t;
+		const float px = x + t * dx, py = y + t * dy;
+		const float reach = top + radius[k];
+		gap[k] = px * px + py * py - reach * reach;
+	}
+
+	batch_order.clear();
+	for (size_t k = 0; k < count; k++) {
+		toi[k] = 2.0f;
+		if (gap[k] <= 0) {
+			const Vector2 offset = from[k] - m_vPos;
+			const unsigned long long sector = offset.x == 0 && offset.y == 0 ? 0 : get_sector_under(offset);
+			batch_order.push_back(sector << 32 | k);
+		}
+	}
+
+	std::sort(batch_order.begin(), batch_order.end());
+
+	for (unsigned long long key : batch_order) {
+		const size_t k = (size_t)(key & 0xFFFFFFFF);
+		float t;
+		Vector2 contact;
+		if (Sweep(from[k], to[k], radius[k], t, contact)) toi[k] = t;
+	}
+}//Sweep
+
+/// <summary>
+/// Sweeps a sphere against the pyramid instead of the altitudes, for when the answer only has to be right to within
+/// a tolerance, such as for the AI's phantom shots. Each stretch of the surface uses the coarsest column over it that
+/// is within the tolerance, the same columns that get_render_columns picks. The top of each column is a flat edge from
+/// its first altitude to its last, pushed out until its middle is at the column's highest altitude, and each column is
+/// joined to the next from its last altitude to the next one's first. Every corner is then at or above the altitude
+/// under it and no edge dips below the surface, so it never misses where the altitudes would have been hit, only hits
+/// early. Where the terrain is smooth there are many times fewer edges to sweep against. There is no contact point or
+/// normal, since nothing that needs them should settle for less than the altitudes.
+/// </summary>
+/// <param name="from">Where the center of the sphere starts.</param>
+/// <param name="to">Where the center of the sphere ends up.</param>
+/// <param name="radius">Radius of the sphere.</param>
+/// <param name="tolerance">How far off the surface the columns may be. 0 is the same as the other Sweep.</param>
+/// <param name="toi">[out] Time of impact, as a fraction of the way from start to end.</param>
+/// <returns>TRUE if the sphere touches the columns anywhere along the line.</returns>
+bool CPlanetObject::Sweep(const Vector2& from, const Vector2& to, float radius, float tolerance, float& toi) {
+	if (tolerance <= 0) {
+		Vector2 contact;
+		return Sweep(from, to, radius, toi, contact);
+	}
+
+	//Already under the top of the column that it starts over?
+	const Vector2 rel = from - m_vPos;
+	const float distance = sqrtf(rel.Dot(rel));
+	if (distance <= m_Sphere.Radius + radius) {
+		toi = 0;
+		return TRUE;
+	}
+	const int under = get_sector_under(rel);
+	const int under_level = get_column_level(under, tolerance);
+	if (distance - radius <= get_column_high(under_level, under >> under_level)) {
+		toi = 0;
+		return TRUE;
+	}
+
+	//Clip the line to the sphere that the highest hill fits in, plus the radius, as the other Sweep does, and plus how
+	//far the tops of the columns are pushed out, which is a little more than their sag and so less than twice the tolerance.
+	const Vector2 d = to - from;
+	const float reach = maximum_altitude_sphere.Radius + 2 * tolerance + radius;
+	const float a = d.Dot(d);
+	if (a == 0) return FALSE;
+	const float half_b = rel.Dot(d);
+	const float disc = half_b * half_b - a * (rel.Dot(rel) - reach * reach);
+	if (disc < 0) return FALSE;
+	const float t0 = max(0.0f, (-half_b - sqrtf(disc)) / a);
+	const float t1 = min(1.0f, (-half_b + sqrtf(disc)) / a);
+	if (t0 > t1) return FALSE;
+
+	//The altitudes that the clipped line passes over, the short way round, plus enough to cover the radius.
+	const Vector2 p0 = rel + t0 * d;
+	const Vector2 p1 = rel + t1 * d;
+	const float angle0 = det_atan2(p0.y, p0.x);
+	float span = det_atan2(p1.y, p1.x) - angle0;
+	if (span > (float)PI) span -= 2 * (float)PI;
+	else if (span < -(float)PI) span += 2 * (float)PI;
+	const int extra = 1 + (int)ceilf(radius / (angle_step * max(core_radius, 1)));
+	const int first = (int)floorf(min(angle0, angle0 + span) / angle_step) - extra;
+	const int last = (int)floorf(max(angle0, angle0 + span) / angle_step) + extra;
+
+	//Walk the columns over that range, sweeping against the top of each one and the edge that joins it to the last.
+	float best = 2.0f;
+	Vector2 v0;
+	for (int i = first; i <= last + 1;) {
+		const int s = modulo(i, number_of_altitudes);
+		const int level = get_column_level(s, tolerance);
+		const int width = 1 << level;
+		const int start = i - (s & (width - 1)); //first altitude in the column, unwrapped like i
+		Vector2 v1, v2; //the top of the column, from its first altitude to its last
+		if (level == 0) v1 = v2 = get_surface_vector_at_index(start);
+		else {
+			const float angle1 = angle_step * start;
+			const float angle2 = angle_step * (start + width - 1);
+			const float r = (float)get_column_high(level, s >> level) / det_cos((angle2 - angle1) / 2);
+			v1 = m_vPos + r * Vector2(det_cos(angle1), det_sin(angle1));
+			v2 = m_vPos + r * Vector2(det_cos(angle2), det_sin(angle2));
+		}
+
+		float t;
+		if (i > first && sweep_circle_segment(from, d, v0, v1, radius, t) && t < best) best = t;
+		if (level > 0 && sweep_circle_segment(from, d, v1, v2, radius, t) && t < best) best = t;
+		v0 = v2;
+		i = start + width;
+	}
+
+	if (best > 1.0f) return FALSE;
+	toi = best;
+	return TRUE;
+}//Sweep
+
 void CPlanetObject::draw_smoke(int start_altitude_index, int final_altitude_index) {
 	int interval = final_altitude_index - start_altitude_index;
 
@@ -271,47 +1159,182 @@ void CPlanetObject::draw_smoke(int start_altitude_index, int final_altitude_inde
 }
 
 
+#ifdef TERRAIN_USE_SSE
 /// <summary>
-/// Destroys all of the terrain of a planet that is within the explosion radius.
+/// Picks each lane from one of two vectors of ints.
+/// </summary>
+/// <param name="mask">All ones in the lanes to take from a, and all zeros in the lanes to take from b.</param>
+/// <param name="a">Lanes to take where the mask is set.</param>
+/// <param name="b">Lanes to take where it isn't.</param>
+/// <returns>The picked lanes.</returns>
+static inline __m128i select_epi32(__m128i mask, __m128i a, __m128i b) {
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}//select_epi32
+#endif
+
+/// <summary>
+/// Finds the span of altitudes that a blast can reach: the ones within the angle that it covers as seen from the
+/// center of the planet, on either side of the altitude under its center. A blast with the center of the planet
+/// inside it reaches all of them.
 /// </summary>
 /// <param name="object_boundary">BoundingSphere that represents the explosion radius.</param>
-void CPlanetObject::destroy_terrain(BoundingSphere& object_boundary) {
-	Vector2 origin = m_vPos; // use origin to represent the center of the planet.
-	Vector2 center = Vector2(object_boundary.Center.x, object_boundary.Center.y); //Center of the offending object
-	Vector2 difference = center - origin;
-	float r = (float)object_boundary.Radius; // Radius of the offending object
-	float h = (float)difference.Length(); //Distance between the planet core and offending object
-
-	float angle; //Angle from the positive x-axis to the altitude we are adjusting.
-	float delta_angle = (float)abs(asin(r / h)); //Angle in radians measuring how far we have to sweep (when centered at the planet core) from the offending object center to its radius. This can be found with a little bit of trigonometry.
-	int delta_altitude_index = (int) ceil(delta_angle * (float) number_of_altitudes / (2 * PI)); //The number of altitude indices that that angle translates to
-	Vector2 direction; //Direction from the planet center to surface at an angle
-
-	float f_length; //We will store the a float version of length here.
-
-	int altitude_index = get_altitude_index_under_point(center); //Altitude index under the center of the offending object
-	draw_smoke(altitude_index - delta_altitude_index, altitude_index + delta_altitude_index);
-
-	for (int i = altitude_index - delta_altitude_index; i < altitude_index + delta_altitude_index; i++) {
-		angle = 2 * PI * i / number_of_altitudes; //Angle from the positive x-axis to the altitude we are adjusting.
-		direction = Vector2((float)cos(angle), (float)sin(angle)); //Unit vector from the planet core to the offending object center
-		int current_index = modulo(i, number_of_altitudes); // We want to make sure we get indices that are within the proper range.
-		int& length = altitudes[current_index]; //Length from the planet center to the surface at an angle
-
-		//OutputDebugStringA(("Index: " + to_string(current_index) + "\tHeight: " + to_string(length) + "\n").c_str());
-		if (length > core_radius + 5 && object_boundary.Intersects(origin, direction, f_length)) {
-			if (length < f_length) { //altitude does not intersect with boundingsphere
-			}
-			else if (length >= f_length) {
-				//Find the second intersection point and store it in f_length2
-				float f_length2;
-				object_boundary.Intersects(origin + (f_length + 1) * direction, direction, f_length2); 
-				//OutputDebugStringA(("Index: " + to_string(current_index) + "\tLength: " + to_string(length) +"\tf_Length: " + to_string(f_length)+ "\tf_Length2: " + to_string(f_length2) + "\n").c_str());
-				length = static_cast<int>(max(f_length, length - f_length2));
+/// <param name="first">[out] First altitude in the span. Can be negative; it wraps around.</param>
+/// <returns>Number of altitudes in the span, which is never more than there are.</returns>
+int CPlanetObject::get_blast_span(const BoundingSphere& object_boundary, int& first) {
+	const Vector2 center = Vector2(object_boundary.Center.x, object_boundary.Center.y);
+	const float h = det_length(center - m_vPos); //Distance between the planet core and the blast
+	int delta_altitude_index = number_of_altitudes / 2;
+	if (object_boundary.Radius < h)
+		delta_altitude_index = (int)ceil(fabsf(det_asin(object_boundary.Radius / h)) * (float)number_of_altitudes / (2 * PI));
+	first = get_altitude_index_under_point(center) - delta_altitude_index;
+	return min(2 * delta_altitude_index, number_of_altitudes);
+}//get_blast_span
+
+/// <summary>
+/// Carves a crater out of a run of altitudes, or drops the dirt from a blast onto them, in closed form. The ray out
+/// from the center of the planet along each altitude goes into the blast at distance enter = p - q and comes out at
+/// leave = p + q, where p is how far along the ray the blast's center is and q = sqrt(r^2 - (|c|^2 - p^2)), or it
+/// misses if the square root would be of something negative. That's what the old ray casts found, with no sine,
+/// cosine or second ray cast, and the directions come from a table. A crater drops the ground above the blast down by
+/// the chord, less one, but not below where the ray goes in, and never into the core. Dirt fills the ray up to where
+/// it comes out, or piles the whole chord on top if the blast is above the ground. Four altitudes are done at a time
+/// with SSE, with the same operations in the same order as the loop that does the rest, so every build gets the same
+/// terrain. The run mustn't wrap around the end of the altitudes.
+/// </summary>
+/// <param name="begin">First altitude in the run.</param>
+/// <param name="end">One past the last altitude in the run.</param>
+/// <param name="object_boundary">BoundingSphere that represents the explosion radius.</param>
+/// <param name="deposit">TRUE to drop dirt, FALSE to carve a crater.</param>
+/// <param name="low">[in, out] Lowered to the lowest new altitude in the run.</param>
+/// <param name="high">[in, out] Raised to the highest new altitude in the run.</param>
+void CPlanetObject::blast_kernel(int begin, int end, const BoundingSphere& object_boundary, bool deposit, int& low, int& high) {
+	const float cx = object_boundary.Center.x - m_vPos.x; //center of the blast from the center of the planet
+	const float cy = object_boundary.Center.y - m_vPos.y;
+	const float l2 = cx * cx + cy * cy;
+	const float r2 = object_boundary.Radius * object_boundary.Radius;
+	const bool inside = l2 <= r2; //the rays start inside the blast, so they go in at 0
+	const int bedrock = core_radius + 5; //Don't want to expose the core
+	int i = begin;
+
+#ifdef TERRAIN_USE_SSE
+	const __m128 vcx = _mm_set1_ps(cx);
+	const __m128 vcy = _mm_set1_ps(cy);
+	const __m128 vl2 = _mm_set1_ps(l2);
+	const __m128 vr2 = _mm_set1_ps(r2);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 vinside = _mm_castsi128_ps(_mm_set1_epi32(inside ? -1 : 0));
+	const __m128i vbedrock = _mm_set1_epi32(bedrock);
+	__m128i vlow = _mm_set1_epi32(low);
+	__m128i vhigh = _mm_set1_epi32(high);
+
+	for (; i + 4 <= end; i += 4) {
+		const __m128 d01 = _mm_loadu_ps(&directions[i].x); //x and y of two directions
+		const __m128 d23 = _mm_loadu_ps(&directions[i + 2].x);
+		const __m128 dx = _mm_shuffle_ps(d01, d23, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 dy = _mm_shuffle_ps(d01, d23, _MM_SHUFFLE(3, 1, 3, 1));
+
+		const __m128 proj = _mm_add_ps(_mm_mul_ps(vcx, dx), _mm_mul_ps(vcy, dy));
+		const __m128 m2 = _mm_sub_ps(vl2, _mm_mul_ps(proj, proj));
+		const __m128 hit = _mm_and_ps(_mm_cmple_ps(m2, vr2), _mm_or_ps(_mm_cmpge_ps(proj, zero), vinside));
+		const __m128 q = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(vr2, m2), zero));
+		const __m128 enter = _mm_andnot_ps(vinside, _mm_sub_ps(proj, q));
+		const __m128 leave = _mm_add_ps(proj, q);
+
+		const __m128i length = _mm_loadu_si128((const __m128i*)&altitudes[i]);
+		const __m128 f_length = _mm_cvtepi32_ps(length);
+		__m128i result;
+
+		if (deposit) {
+			const __m128 above = _mm_cmplt_ps(f_length, enter); //the blast is above the ground
+			const __m128 fill = _mm_and_ps(_mm_cmplt_ps(f_length, leave), _mm_sub_ps(leave, f_length));
+			const __m128 dirt = _mm_or_ps(_mm_and_ps(above, _mm_sub_ps(leave, enter)), _mm_andnot_ps(above, fill));
+			result = _mm_add_epi32(length, _mm_cvttps_epi32(_mm_and_ps(hit, dirt)));
+		}
+		else {
+			const __m128 cut = _mm_max_ps(_mm_sub_ps(_mm_sub_ps(leave, enter), one), zero);
+			const __m128i carved = _mm_cvttps_epi32(_mm_max_ps(enter, _mm_sub_ps(f_length, cut)));
+			const __m128i reached = _mm_and_si128(_mm_castps_si128(_mm_and_ps(hit, _mm_cmpge_ps(f_length, enter))),
+				_mm_cmpgt_epi32(length, vbedrock));
+			result = select_epi32(reached, carved, length);
+			result = select_epi32(_mm_cmpgt_epi32(result, vbedrock), result, vbedrock);
+		}
+
+		_mm_storeu_si128((__m128i*)&altitudes[i], result);
+		vlow = select_epi32(_mm_cmplt_epi32(result, vlow), result, vlow);
+		vhigh = select_epi32(_mm_cmpgt_epi32(result, vhigh), result, vhigh);
+	}
+
+	int lanes[4];
+	_mm_storeu_si128((__m128i*)lanes, vlow);
+	for (int lane : lanes) low = min(low, lane);
+	_mm_storeu_si128((__m128i*)lanes, vhigh);
+	for (int lane : lanes) high = max(high, lane);
+#endif
+
+	//Whatever is left over, or everything if there's no SSE.
+	for (; i < end; i++) {
+		const float proj = cx * directions[i].x + cy * directions[i].y;
+		const float m2 = l2 - proj * proj;
+		int length = altitudes[i];
+
+		if (m2 <= r2 && (proj >= 0 || inside)) {
+			const float q = sqrtf(max(r2 - m2, 0.0f));
+			const float enter = inside ? 0.0f : proj - q;
+			const float leave = proj + q;
+			const float f_length = (float)length;
+
+			if (deposit) {
+				const float dirt = f_length < enter ? leave - enter : f_length < leave ? leave - f_length : 0.0f;
+				length += (int)dirt;
 			}
+			else if (length > bedrock && f_length >= enter)
+				length = (int)max(enter, f_length - max(leave - enter - 1, 0.0f));
 		}
-		length = max(length, core_radius + 5);// Don't want to expose the core
+		if (!deposit) length = max(length, bedrock);
+
+		altitudes[i] = length;
+		low = min(low, length);
+		high = max(high, length);
 	}
+}//blast_kernel
+
+/// <summary>
+/// Carves a crater or drops dirt over the span of altitudes that a blast reaches, splitting it where it wraps around
+/// the end of the altitudes. The minimum and maximum altitudes are widened to take in the new ground in the same
+/// pass, so that the sphere around the highest hill always has all of it inside, even while the sector updates are
+/// being held back. They aren't narrowed here, since a hill that was lowered might not have been the highest one;
+/// refresh_sectors tightens them again.
+/// </summary>
+/// <param name="object_boundary">BoundingSphere that represents the explosion radius.</param>
+/// <param name="deposit">TRUE to drop dirt, FALSE to carve a crater.</param>
+/// <param name="first">First altitude in the span, from get_blast_span.</param>
+/// <param name="count">Number of altitudes in the span.</param>
+void CPlanetObject::blast_terrain(const BoundingSphere& object_boundary, bool deposit, int first, int count) {
+	if (count <= 0) return;
+
+	int low = INT_MAX, high = INT_MIN;
+	const int start = modulo(first, number_of_altitudes);
+	blast_kernel(start, min(start + count, number_of_altitudes), object_boundary, deposit, low, high);
+	if (start + count > number_of_altitudes) //the rest, from the start
+		blast_kernel(0, start + count - number_of_altitudes, object_boundary, deposit, low, high);
+
+	maximum_altitude = max(maximum_altitude, high);
+	minimum_altitude = min(minimum_altitude, low);
+	maximum_altitude_sphere.Radius = (float)maximum_altitude;
+
+	terrain_changed(first, first + count - 1);
+}//blast_terrain
+
+/// <summary>
+/// Destroys all of the terrain of a planet that is within the explosion radius.
+/// </summary>
+/// <param name="object_boundary">BoundingSphere that represents the explosion radius.</param>
+void CPlanetObject::destroy_terrain(BoundingSphere& object_boundary) {
+	int first;
+	const int count = get_blast_span(object_boundary, first);
+	draw_smoke(first, first + count);
+	blast_terrain(object_boundary, FALSE, first, count);
 } //destroy_terrain
 
 /// <summary>
@@ -319,46 +1342,11 @@ void CPlanetObject::destroy_terrain(BoundingSphere& object_boundary) {
 /// </summary>
 /// <param name="object_boundary">BoundingSphere that represents the explosion radius.</param>
 void CPlanetObject::generate_terrain(BoundingSphere& object_boundary) {
-	Vector2 origin = m_vPos; // use origin to represent the center of the planet.
-	Vector2 center = Vector2(object_boundary.Center.x, object_boundary.Center.y); //Center of the offending object
-	Vector2 difference = center - origin;
-	float r = (float)object_boundary.Radius; // Radius of the offending object
-	float h = (float)difference.Length(); //Distance between the planet core and offending object
-
-	float angle; //Angle from the positive x-axis to the altitude we are adjusting.
-	float delta_angle = (float)abs(asin(r / h)); //Angle in radians measuring how far we have to sweep (when centered at the planet core) from the offending object center to its radius. This can be found with a little bit of trigonometry.
-	int delta_altitude_index = (int)ceil(delta_angle * (float)number_of_altitudes / (2 * PI)); //The number of altitude indices that that angle translates to
-	Vector2 direction; //Direction from the planet center to surface at an angle
-
-	float f_length; //We will store the a float version of length here. The compiler doesn't like it when we do an implicit cast in the function call
-
-	int altitude_index = get_altitude_index_under_point(center); //Altitude index under the center of the offending object
-	for (int i = altitude_index - delta_altitude_index; i < altitude_index + delta_altitude_index; i++) {
-		angle = 2 * PI * i / number_of_altitudes; //Angle from the positive x-axis to the altitude we are adjusting.
-		direction = Vector2((float)cos(angle), (float)sin(angle)); //Unit vector from the planet core to the offending object center
-		int current_index = modulo(i, number_of_altitudes); // We want to make sure we get indices that are within the proper range.
-		int& length = altitudes[current_index]; //Length from the planet center to the surface at an angle
-		f_length = static_cast<float>(length); //That altitude length as a float.
-
-		if (object_boundary.Intersects(origin, direction, f_length)) {
-			//f_length tells us the distance from the center of the planet to the first intersection with the boundingsphere along the ray pointing along the angle
-			if (length > f_length) { // the bounding sphere's first intersection is underground
-				if (object_boundary.Intersects(origin + static_cast<float>(length) * direction, direction, f_length)) { //Find the far intersection point so we know how much dirt to drop
-					//The distance of the chord connecting the two intersection points is stored in f_length
-					length += (int)f_length;
-				}
-			}
-			else if (length < f_length) { //The bounding sphere is completely above the surface at this altitude
-				if (object_boundary.Intersects(origin + f_length * direction, direction, f_length)) { //Find the far intersection point so we know how much dirt to drop
-					//The distance of the chord connecting the two intersection points is stored in f_length
-					length += (int)f_length;
-				}
-			}
-		}
-	}
+	int first;
+	const int count = get_blast_span(object_boundary, first);
+	blast_terrain(object_boundary, TRUE, first, count);
 } //generate_terrain
 
-
 /// <summary>
 /// Calculates the angular slope of the planet at a given longitude. Uses a basic difference quotient to calculate the linear slope of the terrain at that point, and then uses atan2 to get that as an angle.
 /// </summary>
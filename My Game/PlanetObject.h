@@ -1,9 +1,33 @@
 #pragma once
 #include "Object.h"
+#include "DirtySpans.h"
+#include "TerrainSnapshot.h"
 #include <vector>
 
 enum class PlanetGenerationAlgo {FractalNoise, PlanetaryNoise};
 
+/// \brief Counters for how terrain queries get settled.
+///
+/// Level 0 is the core and the sphere around the highest hill, levels 1
+/// to 3 are the 8, 32 and 128 bins of the sector hierarchy, and level 4
+/// is the full test against the surface edges.
+
+struct CSectorStats{
+  unsigned long long m_nAccepted[5] = {}; ///< Number of spheres found to intersect at each level.
+  unsigned long long m_nRejected[5] = {}; ///< Number of spheres found not to intersect at each level.
+  unsigned long long m_nSweepBins = 0; ///< Number of 128 bins that sweeps passed over.
+  unsigned long long m_nSweepBinsSkipped = 0; ///< Number of those that were skipped because the sweep stays above them.
+
+  void add(const CSectorStats& other){ ///< Add another set of counters to these.
+    for(int l=0; l<5; l++){
+      m_nAccepted[l] += other.m_nAccepted[l];
+      m_nRejected[l] += other.m_nRejected[l];
+    } //for
+    m_nSweepBins += other.m_nSweepBins;
+    m_nSweepBinsSkipped += other.m_nSweepBinsSkipped;
+  }; //add
+}; //CSectorStats
+
 class CPlanetObject :
   public CObject
 {
@@ -11,35 +35,121 @@ class CPlanetObject :
   friend class CObjectManager;
 private:
   //int altitudes[720];
-  int number_of_altitudes = 360*2;
+  int number_of_altitudes = 360*2; ///< Set from the circumference by the constructor, see get_altitudes_for_radius.
   std::vector<int> altitudes;
   int sealevel_radius=500;
   int maximum_altitude = sealevel_radius;
   int minimum_altitude = sealevel_radius;
   int core_radius = static_cast<int>(sealevel_radius * .3);
+  unsigned terrain_seed = 0; ///< Seed that the terrain is generated from, so that the same seed always gives the same planet.
 
   BoundingSphere maximum_altitude_sphere;
 
+  //Tables for testing spheres against the terrain without atan2 or triangles. See Intersects.
+  float angle_step = 0; ///< Angle in radians between neighboring altitudes.
+  std::vector<Vector2> directions; ///< Unit vector from the center towards each altitude.
+  std::vector<float> sector_inner; ///< For each sector, which is the wedge between an altitude and the next, the closest that the surface in it comes to the center.
+  std::vector<float> sector_outer; ///< For each sector, the furthest that the surface in it goes from the center.
+  std::vector<Vector2> normals; ///< For each sector, the outward normal of the surface in it.
+  std::vector<int> sector_table; ///< For each slice of pseudo-angle, a sector at or just before the one that the slice starts in.
+  std::vector<unsigned> undecided; ///< Scratch space for the batched Intersects.
+  std::vector<float> batch_gap; ///< Scratch space for the batched Sweep: how far each line stays above the highest hill.
+  std::vector<unsigned long long> batch_order; ///< Scratch space for the batched Sweep: the lines that get near, keyed by sector.
+
+  //Min/max altitude hierarchy. Level l has 8*4^l bins, each covering the sectors from bin*n/bins up to (bin + 1)*n/bins, rounded up,
+  //so each bin is exactly 4 bins of the level below.
+  static const int SECTOR_LEVELS = 3; ///< Number of levels: 8, 32 and 128 bins.
+  std::vector<float> level_inner[SECTOR_LEVELS]; ///< For each bin at each level, the lowest sector_inner in it.
+  std::vector<float> level_outer[SECTOR_LEVELS]; ///< For each bin at each level, the highest sector_outer in it.
+  CSectorStats sector_stats; ///< How queries got settled, since the last reset.
+
+  int get_level_bins(int level) { return 8 << (2 * level); }; ///< Number of bins at a level.
+  int get_bin(int sector, int level) { return sector * get_level_bins(level) / number_of_altitudes; }; ///< Bin that a sector is in at a level.
+  int get_bin_start(int bin, int level) { return (bin * number_of_altitudes + get_level_bins(level) - 1) / get_level_bins(level); }; ///< First sector in a bin at a level.
+  void update_levels(int first, int last); ///< Recompute the bins above a span of sectors.
+
+  //Altitude pyramid. Level 0 is the altitudes themselves, and each column at level l + 1 covers 2 columns of level l,
+  //so a column at level l covers 2^l altitudes. The number of altitudes is always a multiple of 64, so they divide evenly.
+  static const int MIN_PYRAMID_COLUMNS = 16; ///< Fewest columns that the top level of the pyramid may have.
+  std::vector<std::vector<int>> pyramid_low; ///< For each level from 1 up, the lowest altitude in each column.
+  std::vector<std::vector<int>> pyramid_high; ///< For each level from 1 up, the highest altitude in each column.
+
+  int get_column_low(int level, int column) { return level == 0 ? altitudes[column] : pyramid_low[level - 1][column]; }; ///< Lowest altitude in a column.
+  int get_column_high(int level, int column) { return level == 0 ? altitudes[column] : pyramid_high[level - 1][column]; }; ///< Highest altitude in a column.
+  float get_column_error(int level, int column); ///< How far a column's highest altitude can be off the surface under it.
+  int get_column_level(int altitude, float tolerance); ///< Coarsest level whose column over an altitude is within a tolerance of the surface.
+  void update_pyramid(int first, int last); ///< Recompute the columns above a span of altitudes.
+  void add_render_columns(int level, int column, float tolerance, std::vector<std::pair<int, int>>& result); ///< Add a column, or the columns under it that are within a tolerance.
+  std::vector<std::pair<int, int>> render_columns; ///< Scratch space for draw_planet: the level and column of each column to draw.
+
+  int edit_depth = 0; ///< Number of calls to begin_edits that haven't been matched by end_edits yet.
+  CDirtySpans dirty_spans; ///< Spans of altitudes changed by the terrain edits, for everything that is built from them.
+  unsigned sector_version = 0; ///< Version of dirty_spans that the sectors, the hierarchy and the pyramid are up to.
+  std::vector<std::pair<int, int>> sector_spans; ///< Scratch space for refresh_sectors.
+  CTerrainSnapshot terrain_snapshot; ///< Snapshot of the terrain as of snapshot_version, which the next snapshot shares its unchanged chunks with.
+  unsigned snapshot_version = 0; ///< Version of dirty_spans that terrain_snapshot is up to.
+  std::vector<std::pair<int, int>> snapshot_spans; ///< Scratch space for get_terrain_snapshot.
+  void terrain_changed(int first, int last); ///< Record a span of altitudes that changed, and update the sectors over it unless edits are being held back.
+  int refresh_sectors(); ///< Update the sectors over the spans of altitudes changed since sector_version.
+
+  void update_altitude_bounds(); ///< Set the minimum and maximum altitudes from the top of the pyramid.
+  void blast_kernel(int begin, int end, const BoundingSphere& object_boundary, bool deposit, int& low, int& high); ///< Carve a crater or drop dirt over a run of altitudes that doesn't wrap.
+  void blast_terrain(const BoundingSphere& object_boundary, bool deposit, int first, int count); ///< Carve a crater or drop dirt over a span of altitudes, and widen the altitude bounds.
+
+  void build_polar_tables(); ///< Build the tables that don't depend on the terrain.
+  void update_sectors(int first, int last); ///< Recompute the sector bounds and normals after the terrain changes.
+  Vector2 get_edge_normal(int sector, float t); ///< Outward normal at a point on the surface in a sector.
+  int get_sector_under(const Vector2& offset); ///< Sector that a vector from the center points into.
+  bool intersects_polar(const Vector2& offset, float distance_squared, float radius, CSectorStats& stats); ///< The part of Intersects after the quick tests.
+
   //TODO: Write a more sophisticated procedurally generated noise algorithm, potentially based on perlin noise?
   void generate_noise_fractal_naive(int num_iterations, float step_size); ///< Generates a procedurally generated planet surface using a simple 1D fractal noise algorithm
-  void generate_noise_planetary_method(int num_iterations, int height_step, int indices_to_move=0);
+  void generate_noise_planetary_method(int num_iterations, int height_step, int indices_to_move=0); ///< Generates a planet surface from terrain_seed with the planetary method, in time proportional to the iterations plus the altitudes.
 
   void draw_smoke(int start_altitude_index, int final_altitude_index);
 
 public:
   //CPlanetObject(const Vector2& p); ///< Constructor.
-  CPlanetObject(const Vector2& p, int radius = 500, float step_size=2.718); ///< Constructor with radius
+  CPlanetObject(const Vector2& p, int radius = 500, unsigned seed = 0, bool deferred = false); ///< Constructor with radius and terrain seed. A deferred planet has no terrain until generate is called.
+  void generate(); ///< Generate the terrain and everything built from it. Touches nothing but this planet, so planets can be generated on different threads.
+  static int get_altitude_limit(int radius); ///< Highest that the terrain of a newly generated planet of a given radius can be.
   void draw_planet(); ///< Tells the renderer how to draw the planet
+  void get_render_columns(float tolerance, std::vector<std::pair<int, int>>& result); ///< The coarsest pyramid columns that are all within a tolerance of the surface.
+
+  static int get_altitudes_for_radius(int radius); ///< Number of altitudes for a planet of a given radius.
+  int get_number_of_altitudes() { return number_of_altitudes; }; ///< Number of altitudes around the planet.
+  int get_altitude_at_index(int index) { return altitudes[modulo(index, number_of_altitudes)]; }; ///< Distance from the center to the surface at an altitude. The index wraps around.
+  int get_minimum_altitude() { return minimum_altitude; }; ///< Returns the distance from the center to the bottom of the deepest crater
+  int get_pyramid_levels() { return (int)pyramid_high.size() + 1; }; ///< Number of levels in the pyramid, counting the altitudes.
+  size_t get_memory_bytes(); ///< Memory used by the terrain and the tables built from it.
 
   int get_altitude_at_angle(float angle); ///< Get the distance at a given angle in degrees
   int get_altitude_index_under_point(Vector2 p);
   Vector2 get_surface_vector_at_index(int altitude_index);
 
   int get_radius() { return sealevel_radius; }; ///< Returns the radius of the planet
+  int get_maximum_altitude() { return maximum_altitude; }; ///< Returns the distance from the center to the top of the highest hill
+  const BoundingSphere& get_maximum_altitude_sphere() { return maximum_altitude_sphere; }; ///< Returns the sphere that the highest hill fits in
 
   bool Intersects(BoundingSphere &object_boundary); ///< Check if a Bounding Sphere intersects the planet.
+  bool Intersects(const BoundingSphere &object_boundary, CSectorStats& stats); ///< Check if a Bounding Sphere intersects the planet, counting in the caller's stats. Safe on worker threads.
+  void Intersects(const BoundingSphere* spheres, size_t count, bool* results); ///< Check a lot of Bounding Spheres against the planet at once.
+  bool Sweep(const Vector2& from, const Vector2& to, float radius, float& toi, Vector2& contact, Vector2* normal = nullptr); ///< Check if a sphere moving along a line hits the planet, and find where and when.
+  void Sweep(const Vector2* from, const Vector2* to, const float* radius, size_t count, float* toi); ///< Sweep a lot of spheres against the planet at once.
+  bool Sweep(const Vector2& from, const Vector2& to, float radius, float tolerance, float& toi); ///< Sweep a sphere against the coarsest pyramid columns within a tolerance.
+  float get_signed_distance(const Vector2& point, Vector2& normal); ///< Distance from a point to the surface, negative underground, and the surface normal there.
+  const CSectorStats& get_sector_stats() { return sector_stats; }; ///< How terrain queries got settled.
+  void reset_sector_stats() { sector_stats = CSectorStats(); }; ///< Zero the terrain query counters.
+  void add_sector_stats(const CSectorStats& stats) { sector_stats.add(stats); }; ///< Add counters kept elsewhere, such as on a worker thread, to the terrain query counters.
+  int get_blast_span(const BoundingSphere& object_boundary, int& first); ///< Span of altitudes that a blast can reach.
   void destroy_terrain(BoundingSphere& object_boundary); ///< Destroys terrain within the bounding sphere
   void generate_terrain(BoundingSphere& object_boundary); ///< Adds terrain within the bounding sphere, which then immediately falls downward.
+  void begin_edits(); ///< Hold back updating the sectors until end_edits, so that overlapping edits update them once.
+  unsigned get_terrain_version() { return dirty_spans.get_version(); }; ///< Version number of the latest terrain edit.
+  bool get_dirty_spans(unsigned& version, std::vector<std::pair<int, int>>& spans) { return dirty_spans.collect(version, spans); }; ///< Spans of altitudes changed since a version, which is brought up to date.
+  int end_edits(); ///< Update the sectors for all of the edits since begin_edits. Returns the number of spans updated.
+  const CTerrainSnapshot& get_terrain_snapshot(); ///< Snapshot of the terrain as it is now, sharing the chunks that haven't changed since the last one.
+  int restore_terrain(const CTerrainSnapshot& snapshot); ///< Put the terrain back the way it was in a snapshot. Returns the number of chunks copied back.
 
   float get_slope_at_longitude(float longitude); ///< Calculates the slope of the terrain at the longitude
 };
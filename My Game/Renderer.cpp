@@ -141,18 +141,24 @@ void CRenderer::SetCameraYaw(float a) {
   m_pCamera->SetYaw(a);
 } //SetCameraYaw
 
-/// Reader function for camera position.
+/// Reader function for camera position. This is where the camera would
+/// be if it weren't kept at the origin, that is, the position passed to
+/// SetCameraPos scaled by the scaling factor.
 /// \return Camera position.
 
 const Vector3& CRenderer::GetCameraPos() {
-	return m_pCamera->GetPos();
+	return m_vCameraPos;
 } //GetCameraPos
 
-/// Writer function for camera position.
+/// Writer function for camera position. The camera in the base class
+/// stays at the origin, and the position is remembered so that Draw can
+/// subtract it from everything.
 /// \param pos New camera position.
 
 void CRenderer::SetCameraPos(const Vector3& pos) {
-  m_pCamera->MoveTo(pos * m_fScalingFactor);
+  m_dCameraPos = CVector2d(pos.x, pos.y);
+  m_vCameraPos = pos * m_fScalingFactor;
+  m_pCamera->MoveTo(Vector3(0.0f, 0.0f, m_vCameraPos.z));
   //m_pCamera->MoveTo(pos);
   m_pCamera->SetPerspective(1.333f, 1.14f, 1.0f, 1000.0f);
 } //SetCameraPos
@@ -163,9 +169,10 @@ void CRenderer::SetCameraPos(const Vector3& pos) {
 
 
 void CRenderer::draw_triangle(const Vector2& v1, const Vector2& v2, const Vector2& v3) {
-  VertexPositionColor vertex1 = VertexPositionColor(XMFLOAT3(v1.x, v1.y, 0.0f), XMFLOAT4(Colors::Red));
-  VertexPositionColor vertex2 = VertexPositionColor(XMFLOAT3(v2.x, v2.y, 0.0f), XMFLOAT4(Colors::Red));
-  VertexPositionColor vertex3 = VertexPositionColor(XMFLOAT3(v3.x, v3.y, 0.0f), XMFLOAT4(Colors::Red));
+  const float x = m_vCameraPos.x, y = m_vCameraPos.y; //the camera is really at the origin
+  VertexPositionColor vertex1 = VertexPositionColor(XMFLOAT3(v1.x - x, v1.y - y, 0.0f), XMFLOAT4(Colors::Red));
+  VertexPositionColor vertex2 = VertexPositionColor(XMFLOAT3(v2.x - x, v2.y - y, 0.0f), XMFLOAT4(Colors::Red));
+  VertexPositionColor vertex3 = VertexPositionColor(XMFLOAT3(v3.x - x, v3.y - y, 0.0f), XMFLOAT4(Colors::Red));
   m_pPrimitiveBatch->DrawTriangle(vertex1, vertex2, vertex3);
 }
 
@@ -185,14 +192,25 @@ void CRenderer::EndFrame() {
 } //EndFrame
 
 void CRenderer::Draw(const CSpriteDesc2D& sd) {
+  Draw(sd, CVector2d(sd.m_vPos));
+}//Draw
+
+/// Draw a sprite at a position in world coordinates given in double
+/// precision, instead of at the sprite's own position. The offset from
+/// the camera is worked out in double precision and then scaled.
+/// \param sd Sprite descriptor.
+/// \param pos Position to draw it at.
+
+void CRenderer::Draw(const CSpriteDesc2D& sd, const CVector2d& pos) {
   CSpriteDesc2D sd_scaled = sd;
   sd_scaled.m_fXScale *= m_fScalingFactor;
   sd_scaled.m_fYScale *= m_fScalingFactor;
-  sd_scaled.m_vPos *= m_fScalingFactor;
+  sd_scaled.m_vPos = Vector2((pos - m_dCameraPos) * m_fScalingFactor);
   CSpriteRenderer::Draw(sd_scaled);
 }//Draw
 
 void CRenderer::DrawUnscaled(CSpriteDesc2D sd) {
+	sd.m_vPos -= Vector2(m_vCameraPos.x, m_vCameraPos.y); //the camera is really at the origin
 	CSpriteRenderer::Draw(sd);
 }//DrawUnscaled
 
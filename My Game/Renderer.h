@@ -5,15 +5,27 @@
 
 #include "GameDefines.h"
 #include "SpriteRenderer.h"
+#include "Vector2d.h"
 
 /// \brief The renderer.
 ///
 /// CRenderer handles the game-specific rendering tasks, relying on
 /// the base class to do all of the actual API-specific rendering.
+///
+/// The camera that the base class sees never leaves the origin. Instead,
+/// sprites are moved by minus the camera position before they are drawn,
+/// and that subtraction is done in double precision. Far out in a large
+/// world, a sprite and the camera are both at big coordinates that a
+/// float can only just represent, and if the GPU were left to subtract
+/// them they would jitter against each other by a pixel or so. The
+/// difference between them is small, so once it has been worked out it
+/// fits in a float with room to spare.
 
 class CRenderer: public CSpriteRenderer{
 private:
   float m_fScalingFactor = .6f;
+  CVector2d m_dCameraPos; ///< Camera position in world coordinates, in double precision.
+  Vector3 m_vCameraPos; ///< Camera position scaled by m_fScalingFactor, which is where the rest of the game thinks the camera is.
 
   public:
     CRenderer(); ///< Constructor.
@@ -32,6 +44,7 @@ private:
     void EndFrame();
 
     void Draw(const CSpriteDesc2D& sd); //Overload, so we can do cool scaling!
+    void Draw(const CSpriteDesc2D& sd, const CVector2d& pos); ///< Draw at a position in double precision.
     void DrawUnscaled(CSpriteDesc2D sd); //Draw unscaled for UI elements
 
     HWND GetWindowHandler() { return m_Hwnd; };
@@ -0,0 +1,125 @@
+/// \file SpatialHash.cpp
+/// \brief Code for the spatial hash CSpatialHash.
+
+#include "SpatialHash.h"
+
+#include <algorithm>
+#include <climits>
+
+/// Hash a cell into a bucket.
+/// \param i Column of the cell.
+/// \param j Row of the cell.
+/// \return Bucket number.
+
+unsigned CSpatialHash::bucket(int i, int j) const{
+  return ((unsigned)i*73856093u ^ (unsigned)j*19349663u) & m_nMask;
+} //bucket
+
+/// File a set of points under the cells that they are in, throwing away
+/// whatever was filed before.
+/// \param centers Positions of the items. Item n is at centers[n].
+/// \param cell_size Width and height of a cell. Should be at least the diameter of the biggest item.
+
+void CSpatialHash::build(const std::vector<Vector2>& centers, float cell_size){
+  const size_t n = centers.size();
+  m_fCellSize = cell_size;
+
+  //at least twice as many buckets as items, so that few cells share a bucket
+  unsigned buckets = 64;
+  while(buckets < 2*n)
+    buckets *= 2;
+  m_nMask = buckets - 1;
+
+  m_vCellX.resize(n);
+  m_vCellY.resize(n);
+  m_vStart.assign(buckets + 1, 0);
+  m_vItems.resize(n);
+
+  //count the items in each bucket
+  for(size_t k=0; k<n; k++){
+    m_vCellX[k] = (int)floorf(centers[k].x/m_fCellSize);
+    m_vCellY[k] = (int)floorf(centers[k].y/m_fCellSize);
+    m_vStart[bucket(m_vCellX[k], m_vCellY[k])]++;
+  } //for
+
+  //turn the counts into starts
+  unsigned sum = 0;
+  for(unsigned b=0; b<=buckets; b++){
+    const unsigned count = m_vStart[b];
+    m_vStart[b] = sum;
+    sum += count;
+  } //for
+
+  //file the items in order, which moves the start of each bucket up to the start of the next one
+  for(size_t k=0; k<n; k++)
+    m_vItems[m_vStart[bucket(m_vCellX[k], m_vCellY[k])]++] = (unsigned)k;
+
+  for(unsigned b=buckets; b>0; b--) //move them back
+    m_vStart[b] = m_vStart[b - 1];
+  m_vStart[0] = 0;
+} //build
+
+/// Add the items in a cell to a list. Other cells that share its bucket
+/// are skipped.
+/// \param i Column of the cell.
+/// \param j Row of the cell.
+/// \param after Only add items numbered higher than this, or all of them if it is UINT_MAX.
+/// \param result [in, out] The list.
+
+void CSpatialHash::gather(int i, int j, unsigned after, std::vector<unsigned>& result) const{
+  const unsigned b = bucket(i, j);
+  for(unsigned s=m_vStart[b]; s<m_vStart[b + 1]; s++){
+    const unsigned k = m_vItems[s];
+    if(m_vCellX[k] == i && m_vCellY[k] == j && (after == UINT_MAX || k > after))
+      result.push_back(k);
+  } //for
+} //gather
+
+/// Find the items numbered after an item that are in its cell or one of
+/// the eight cells around it, which is all of the ones that might touch it.
+/// \param item The item.
+/// \param result [out] Their numbers, in increasing order.
+
+void CSpatialHash::neighbors(unsigned item, std::vector<unsigned>& result) const{
+  result.clear();
+  const int ci = m_vCellX[item];
+  const int cj = m_vCellY[item];
+
+  for(int j=cj - 1; j<=cj + 1; j++)
+    for(int i=ci - 1; i<=ci + 1; i++)
+      gather(i, j, item, result);
+
+  std::sort(result.begin(), result.end());
+} //neighbors
+
+/// Find the items that might touch a circle. If the circle covers more
+/// cells than there are items, it's quicker to let the caller test them
+/// all, so that is what is returned.
+/// \param center Center of the circle.
+/// \param radius Radius of the circle.
+/// \param result [out] Item numbers, in increasing order.
+
+void CSpatialHash::query(const Vector2& center, float radius, std::vector<unsigned>& result) const{
+  result.clear();
+  const size_t n = size();
+
+  //an item touching the circle has its center within half a cell of it, since no item is wider than a cell
+  const float reach = radius + 0.5f*m_fCellSize;
+  const int i0 = (int)floorf((center.x - reach)/m_fCellSize);
+  const int i1 = (int)floorf((center.x + reach)/m_fCellSize);
+  const int j0 = (int)floorf((center.y - reach)/m_fCellSize);
+  const int j1 = (int)floorf((center.y + reach)/m_fCellSize);
+
+  if((double)(i1 - i0 + 1)*(j1 - j0 + 1) > n){ //everything
+    result.resize(n);
+    for(size_t k=0; k<n; k++)
+      result[k] = (unsigned)k;
+    return;
+  } //if
+
+  for(int j=j0; j<=j1; j++)
+    for(int i=i0; i<=i1; i++)
+      gather(i, j, UINT_MAX, result);
+
+  std::sort(result.begin(), result.end());
+} //query
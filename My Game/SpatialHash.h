@@ -0,0 +1,46 @@
+/// \file SpatialHash.h
+/// \brief Interface for the spatial hash CSpatialHash.
+
+#pragma once
+
+#include <vector>
+
+#include "Defines.h"
+
+/// \brief A uniform grid of cells, hashed into a table of buckets.
+///
+/// The broad phase uses CSpatialHash to find out which objects are close
+/// enough to each other to be worth a narrow phase test. Items are points
+/// numbered from 0, each filed under the cell that it is in. Only the
+/// cells that have something in them cost anything, so the grid can be
+/// as fine as it likes however big the world is. The table is rebuilt
+/// from scratch by a counting sort, which is linear in the number of
+/// items and doesn't allocate once the vectors have grown big enough.
+///
+/// Items have a size too, but they are filed by their centers only. As
+/// long as the cells are at least as wide as the biggest item, an item
+/// can only touch items in the cells next to its own. Queries always
+/// return item numbers in increasing order, without duplicates, so that
+/// the caller can visit them in the same order that it numbered them.
+
+class CSpatialHash{
+  private:
+    float m_fCellSize = 64.0f; ///< Width and height of a cell.
+    unsigned m_nMask = 0; ///< Number of buckets minus one. The number of buckets is a power of 2.
+
+    std::vector<int> m_vCellX; ///< Column of the cell that each item is in.
+    std::vector<int> m_vCellY; ///< Row of the cell that each item is in.
+    std::vector<unsigned> m_vStart; ///< Where each bucket starts in m_vItems, with one extra entry for the end of the last one.
+    std::vector<unsigned> m_vItems; ///< Item numbers, sorted by bucket.
+
+    unsigned bucket(int i, int j) const; ///< Bucket that a cell hashes to.
+    void gather(int i, int j, unsigned after, std::vector<unsigned>& result) const; ///< Add the items in a cell to a list.
+
+  public:
+    void build(const std::vector<Vector2>& centers, float cell_size); ///< File a set of points.
+    void neighbors(unsigned item, std::vector<unsigned>& result) const; ///< Items numbered after an item that might touch it.
+    void query(const Vector2& center, float radius, std::vector<unsigned>& result) const; ///< Items that might touch a circle.
+
+    size_t size() const { return m_vCellX.size(); }; ///< Number of items.
+    float get_cell_size() const { return m_fCellSize; }; ///< Width and height of a cell.
+}; //CSpatialHash
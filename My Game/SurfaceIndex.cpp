@@ -0,0 +1,381 @@
+/// \file SurfaceIndex.cpp
+/// \brief Code for the planet and tank index CSurfaceIndex.
+
+#include "SurfaceIndex.h"
+#include "PlanetObject.h"
+#include "TankObject.h"
+#include "Deterministic.h"
+
+#include <algorithm>
+#include <cfloat>
+
+/// Put a longitude in degrees into the range 0 to 360.
+/// \param degrees Longitude in degrees.
+/// \return The same longitude, from 0 up to but not including 360.
+
+static float wrap_longitude(float degrees){
+  degrees = fmodf(degrees, 360.0f);
+  if(degrees < 0)degrees += 360.0f;
+  return degrees >= 360.0f? 0.0f: degrees;
+} //wrap_longitude
+
+/// Longitude of a point as seen from a planet's center.
+/// \param offset The point less the center.
+/// \return Longitude in degrees, from 0 up to but not including 360.
+
+static float longitude_of(const Vector2& offset){
+  if(offset.x == 0 && offset.y == 0)return 0;
+  return wrap_longitude(det_atan2(offset.y, offset.x)*180.0f/XM_PI);
+} //longitude_of
+
+/// Order entries by longitude, then by the order that their tanks were
+/// created in.
+
+struct CEntryLess{
+  template<class E> bool operator()(const E& a, const E& b) const{
+    if(a.m_fLongitude != b.m_fLongitude)return a.m_fLongitude < b.m_fLongitude;
+    return a.m_nSerial < b.m_nSerial;
+  } //operator()
+}; //CEntryLess
+
+/// Forget all of the planets and tanks.
+
+void CSurfaceIndex::clear(){
+  m_vPlanets.clear();
+  m_vX.clear();
+  m_vY.clear();
+  m_vTanks.clear();
+  m_mWhere.clear();
+  m_fTankRadius = 0;
+} //clear
+
+/// Find the slot that a planet was added in.
+/// \param planet The planet.
+/// \return Its slot, or the number of planets if it was never added.
+
+size_t CSurfaceIndex::slot(const CPlanetObject* planet) const{
+  for(size_t i=0; i<m_vPlanets.size(); i++)
+    if(m_vPlanets[i] == planet)
+      return i;
+  return m_vPlanets.size();
+} //slot
+
+/// Add a planet, with no tanks on it yet.
+/// \param planet The planet.
+
+void CSurfaceIndex::add_planet(CPlanetObject* planet){
+  m_vPlanets.push_back(planet);
+  m_vX.push_back(planet->GetPos().x);
+  m_vY.push_back(planet->GetPos().y);
+  m_vTanks.emplace_back();
+} //add_planet
+
+/// Copy a planet's center into the packed arrays after it moves. Its tanks
+/// are filed by longitude, which doesn't change when the planet moves.
+/// \param planet The planet.
+
+void CSurfaceIndex::update_planet(const CPlanetObject* planet){
+  const size_t i = slot(planet);
+  if(i == m_vPlanets.size())return;
+  m_vX[i] = m_vPlanets[i]->GetPos().x;
+  m_vY[i] = m_vPlanets[i]->GetPos().y;
+} //update_planet
+
+/// Find the planet whose center is nearest to a point. Ties go to the
+/// planet that was added first.
+/// \param pos The point.
+/// \return The nearest planet, or nullptr if there are none.
+
+CPlanetObject* CSurfaceIndex::nearest_planet(const Vector2& pos) const{
+  CPlanetObject* nearest = nullptr;
+  float best = FLT_MAX;
+
+  for(size_t i=0; i<m_vPlanets.size(); i++){
+    const float dx = m_vX[i] - pos.x;
+    const float dy = m_vY[i] - pos.y;
+    const float d2 = dx*dx + dy*dy;
+    if(d2 < best){
+      best = d2;
+      nearest = m_vPlanets[i];
+    } //if
+  } //for
+
+  return nearest;
+} //nearest_planet
+
+/// Find the planets whose centers are nearest to a point.
+/// \param pos The point.
+/// \param k How many to find.
+/// \param result [out] Up to k planets, nearest first. Ties go to the planet that was added first.
+
+void CSurfaceIndex::nearest_planets(const Vector2& pos, size_t k, std::vector<CPlanetObject*>& result) const{
+  std::vector<std::pair<float, size_t>> order(m_vPlanets.size());
+  for(size_t i=0; i<m_vPlanets.size(); i++){
+    const float dx = m_vX[i] - pos.x;
+    const float dy = m_vY[i] - pos.y;
+    order[i] = std::make_pair(dx*dx + dy*dy, i);
+  } //for
+
+  k = min(k, order.size());
+  std::partial_sort(order.begin(), order.begin() + k, order.end());
+
+  result.resize(k);
+  for(size_t i=0; i<k; i++)
+    result[i] = m_vPlanets[order[i].second];
+} //nearest_planets
+
+/// Find the planets whose highest hill reaches into a circle.
+/// \param center Center of the circle.
+/// \param radius Radius of the circle.
+/// \param result [out] The planets, in the order that they were added.
+
+void CSurfaceIndex::planets_in_sphere(const Vector2& center, float radius, std::vector<CPlanetObject*>& result) const{
+  result.clear();
+
+  for(size_t i=0; i<m_vPlanets.size(); i++){
+    const float dx = m_vX[i] - center.x;
+    const float dy = m_vY[i] - center.y;
+    const float reach = (float)max(m_vPlanets[i]->get_maximum_altitude(), m_vPlanets[i]->get_radius()) + radius;
+    if(dx*dx + dy*dy <= reach*reach)
+      result.push_back(m_vPlanets[i]);
+  } //for
+} //planets_in_sphere
+
+/// File a tank in the sorted list for its home planet.
+/// \param tank The tank.
+/// \param serial Order that it was created in.
+
+void CSurfaceIndex::file(const std::shared_ptr<CTankObject>& tank, unsigned serial){
+  const size_t i = slot(tank->get_planet_index());
+  if(i == m_vPlanets.size())return; //not on a planet we know about
+
+  CEntry e;
+  e.m_fLongitude = wrap_longitude(tank->get_angle_relative_to_planet());
+  e.m_nSerial = serial;
+  e.m_pTank = tank;
+
+  std::vector<CEntry>& list = m_vTanks[i];
+  list.insert(std::upper_bound(list.begin(), list.end(), e, CEntryLess()), e);
+
+  CWhere where;
+  where.m_nPlanet = i;
+  where.m_fLongitude = e.m_fLongitude;
+  m_mWhere[tank.get()] = where;
+} //file
+
+/// Take a tank out of the sorted list that it was filed in.
+/// \param tank The tank.
+
+void CSurfaceIndex::unfile(const CTankObject* tank){
+  auto w = m_mWhere.find(tank);
+  if(w == m_mWhere.end())return;
+
+  std::vector<CEntry>& list = m_vTanks[w->second.m_nPlanet];
+  CEntry key;
+  key.m_fLongitude = w->second.m_fLongitude;
+  key.m_nSerial = tank->GetSerial();
+  auto e = std::lower_bound(list.begin(), list.end(), key, CEntryLess());
+  if(e != list.end() && e->m_pTank.get() == tank)
+    list.erase(e);
+
+  m_mWhere.erase(w);
+} //unfile
+
+/// Add a tank, filed under its home planet and longitude.
+/// \param tank The tank.
+
+void CSurfaceIndex::add_tank(const std::shared_ptr<CTankObject>& tank){
+  unfile(tank.get()); //in case it was already there
+  m_fTankRadius = max(m_fTankRadius, tank->GetBoundingSphere().Radius);
+  file(tank, tank->GetSerial());
+} //add_tank
+
+/// Refile a tank that may have changed longitude or home planet. This is
+/// cheap if it hasn't.
+/// \param tank The tank.
+
+void CSurfaceIndex::update_tank(CTankObject* tank){
+  auto w = m_mWhere.find(tank);
+  if(w == m_mWhere.end())return;
+
+  const size_t i = slot(tank->get_planet_index());
+  const float longitude = wrap_longitude(tank->get_angle_relative_to_planet());
+  if(i == w->second.m_nPlanet && longitude == w->second.m_fLongitude)return; //hasn't moved
+
+  std::vector<CEntry>& list = m_vTanks[w->second.m_nPlanet];
+  CEntry key;
+  key.m_fLongitude = w->second.m_fLongitude;
+  key.m_nSerial = tank->GetSerial();
+  auto e = std::lower_bound(list.begin(), list.end(), key, CEntryLess());
+  if(e == list.end() || e->m_pTank.get() != tank)return; //shouldn't happen
+
+  const std::shared_ptr<CTankObject> keep = e->m_pTank;
+  unfile(tank);
+  file(keep, keep->GetSerial());
+} //update_tank
+
+/// Remove a tank, such as one that has died.
+/// \param tank The tank.
+
+void CSurfaceIndex::remove_tank(const CTankObject* tank){
+  unfile(tank);
+} //remove_tank
+
+/// Find the tanks that might touch a circle. A tank touching the circle
+/// has its center within the circle's radius plus its own of the circle's
+/// center, and so is within a known angle of it as seen from the planet's
+/// center. Only the tanks within that angle are looked at.
+/// \param center Center of the circle.
+/// \param radius Radius of the circle.
+/// \param result [out] The tanks, in the order that they were created.
+
+void CSurfaceIndex::tanks_in_sphere(const Vector2& center, float radius, std::vector<CTankObject*>& result) const{
+  result.clear();
+  const float reach = radius + m_fTankRadius;
+
+  for(size_t i=0; i<m_vPlanets.size(); i++){
+    const std::vector<CEntry>& list = m_vTanks[i];
+    if(list.empty())continue;
+
+    const Vector2 offset = center - Vector2(m_vX[i], m_vY[i]);
+    const float d = det_length(offset);
+
+    if(d <= reach){ //the circle covers the planet's center, so any longitude will do
+      for(const CEntry& e: list)
+        result.push_back(e.m_pTank.get());
+      continue;
+    } //if
+
+    const float half = det_asin(reach/d)*180.0f/XM_PI + 0.01f; //half the angle, with a little to spare for round-off
+    if(half >= 180.0f){
+      for(const CEntry& e: list)
+        result.push_back(e.m_pTank.get());
+      continue;
+    } //if
+
+    //walk round from the first tank past the start of the angle, wrapping at 360
+    CEntry key;
+    key.m_fLongitude = wrap_longitude(longitude_of(offset) - half);
+    key.m_nSerial = 0;
+    const size_t n = list.size();
+    const size_t first = std::lower_bound(list.begin(), list.end(), key, CEntryLess()) - list.begin();
+
+    for(size_t s=0; s<n; s++){
+      const CEntry& e = list[(first + s)%n];
+      if(wrap_longitude(e.m_fLongitude - key.m_fLongitude) > 2*half)break;
+      result.push_back(e.m_pTank.get());
+    } //for
+  } //for
+
+  std::sort(result.begin(), result.end(), [](const CTankObject* a, const CTankObject* b){
+    return a->GetSerial() < b->GetSerial();
+  }); //sort
+} //tanks_in_sphere
+
+/// Find the tanks on a planet, dead or alive.
+/// \param planet The planet.
+/// \param result [out] The tanks, in order of longitude.
+
+void CSurfaceIndex::tanks_on_planet(const CPlanetObject* planet, std::vector<CTankObject*>& result) const{
+  result.clear();
+  const size_t i = slot(planet);
+  if(i == m_vPlanets.size())return;
+
+  for(const CEntry& e: m_vTanks[i])
+    result.push_back(e.m_pTank.get());
+} //tanks_on_planet
+
+/// Find the k tanks nearest to a point, leaving them in m_vHits nearest
+/// first. On each planet the walk starts at the point's longitude and goes
+/// both ways round, taking whichever side is closer in angle next. A tank
+/// at an angle a from the point, as seen from the planet's center, can be
+/// no closer than d sin(a), or d once a is past a right angle, where d is
+/// how far the point is from the center. Once that is further than the
+/// k-th nearest tank so far, the rest of the planet can be skipped.
+/// \param pos The point.
+/// \param k How many to find.
+/// \param exclude A tank to leave out, or nullptr.
+/// \param skip_dead Whether to leave out dead tanks.
+
+void CSurfaceIndex::search(const Vector2& pos, size_t k, const CTankObject* exclude, bool skip_dead) const{
+  m_vHits.clear();
+  if(k == 0)return;
+
+  for(size_t i=0; i<m_vPlanets.size(); i++){
+    const std::vector<CEntry>& list = m_vTanks[i];
+    const size_t n = list.size();
+    if(n == 0)continue;
+
+    const Vector2 offset = pos - Vector2(m_vX[i], m_vY[i]);
+    const float d = det_length(offset);
+
+    CEntry key;
+    key.m_fLongitude = longitude_of(offset);
+    key.m_nSerial = 0;
+    const size_t start = std::lower_bound(list.begin(), list.end(), key, CEntryLess()) - list.begin();
+    size_t up = 0, down = 0; //steps taken each way
+
+    while(up + down < n){
+      const CEntry& u = list[(start + up)%n];
+      const CEntry& w = list[(start + n - 1 - down)%n];
+      const float gap_up = wrap_longitude(u.m_fLongitude - key.m_fLongitude);
+      const float gap_down = wrap_longitude(key.m_fLongitude - w.m_fLongitude);
+      const bool go_up = gap_up <= gap_down;
+      const float gap = go_up? gap_up: gap_down; //nothing left is any closer in angle than this
+
+      if(m_vHits.size() == k){
+        const float bound = (gap >= 90.0f? d: d*det_sin(gap*XM_PI/180.0f)) - 1.0f; //a unit to spare for round-off
+        if(bound > 0 && bound*bound > m_vHits.back().m_fDistanceSq)break;
+      } //if
+
+      const CEntry& e = go_up? u: w;
+      if(go_up)up++;
+      else down++;
+
+      CTankObject* tank = e.m_pTank.get();
+      if(tank == exclude || (skip_dead && tank->IsDead()))continue;
+
+      const Vector2 v = tank->GetPos() - pos;
+      CHit hit;
+      hit.m_fDistanceSq = v.Dot(v);
+      hit.m_nSerial = e.m_nSerial;
+      hit.m_pEntry = &e;
+
+      auto where = std::upper_bound(m_vHits.begin(), m_vHits.end(), hit, [](const CHit& a, const CHit& b){
+        if(a.m_fDistanceSq != b.m_fDistanceSq)return a.m_fDistanceSq < b.m_fDistanceSq;
+        return a.m_nSerial < b.m_nSerial;
+      }); //upper_bound
+
+      if(m_vHits.size() < k)m_vHits.insert(where, hit);
+      else if(where != m_vHits.end()){
+        m_vHits.insert(where, hit);
+        m_vHits.pop_back();
+      } //else if
+    } //while
+  } //for
+} //search
+
+/// Find the tank nearest to a point. Ties go to the tank that was created
+/// first.
+/// \param pos The point.
+/// \param exclude A tank to leave out, or nullptr.
+/// \param skip_dead Whether to leave out dead tanks.
+/// \return The nearest tank, or nullptr if there isn't one.
+
+std::shared_ptr<CTankObject> CSurfaceIndex::nearest_tank(const Vector2& pos, const CTankObject* exclude, bool skip_dead) const{
+  search(pos, 1, exclude, skip_dead);
+  return m_vHits.empty()? nullptr: m_vHits[0].m_pEntry->m_pTank;
+} //nearest_tank
+
+/// Find the k tanks nearest to a point.
+/// \param pos The point.
+/// \param k How many to find.
+/// \param result [out] Up to k tanks, nearest first. Ties go to the tank that was created first.
+/// \param skip_dead Whether to leave out dead tanks.
+
+void CSurfaceIndex::nearest_tanks(const Vector2& pos, size_t k, std::vector<CTankObject*>& result, bool skip_dead) const{
+  search(pos, k, nullptr, skip_dead);
+  result.resize(m_vHits.size());
+  for(size_t i=0; i<m_vHits.size(); i++)
+    result[i] = m_vHits[i].m_pEntry->m_pTank.get();
+} //nearest_tanks
@@ -0,0 +1,92 @@
+/// \file SurfaceIndex.h
+/// \brief Interface for the planet and tank index CSurfaceIndex.
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "Defines.h"
+
+class CPlanetObject;
+class CTankObject;
+
+/// \brief An index of the planets, and of the tanks on each planet by longitude.
+///
+/// Tanks always sit on the ray out from their home planet's center at
+/// their longitude, even while they are falling, so the tanks on a planet
+/// are kept in a list sorted by longitude. Finding the tanks near a point
+/// is then a binary search for the point's longitude and a walk outwards
+/// in both directions, which can stop as soon as the angle gets too wide
+/// for anything further round to be close enough. Nothing here depends on
+/// how high the terrain is, so craters and dirt don't invalidate it.
+///
+/// The planets are kept in packed arrays of their centers. There are never
+/// more than a few dozen of them, so a straight walk over the arrays beats
+/// anything cleverer.
+///
+/// The index has to be told when a tank changes longitude or planet, and
+/// when a planet moves. Dead tanks stay in it until they are removed, and
+/// the queries can be asked to skip them. Results come back in the order
+/// the objects were created in, or in order of distance with ties broken
+/// by that, so that they match a walk down the object manager's lists.
+
+class CSurfaceIndex{
+  private:
+    /// \brief A tank, filed under its longitude.
+
+    struct CEntry{
+      float m_fLongitude; ///< Longitude in degrees when it was filed.
+      unsigned m_nSerial; ///< Order that the tank was created in.
+      std::shared_ptr<CTankObject> m_pTank; ///< The tank.
+    }; //CEntry
+
+    /// \brief Where a tank is filed.
+
+    struct CWhere{
+      size_t m_nPlanet; ///< Planet slot.
+      float m_fLongitude; ///< Longitude in degrees when it was filed.
+    }; //CWhere
+
+    std::vector<CPlanetObject*> m_vPlanets; ///< The planets, in the order they were added.
+    std::vector<float> m_vX; ///< x coordinate of the center of each planet.
+    std::vector<float> m_vY; ///< y coordinate of the center of each planet.
+    std::vector<std::vector<CEntry>> m_vTanks; ///< For each planet, the tanks on it sorted by longitude.
+    std::unordered_map<const CTankObject*, CWhere> m_mWhere; ///< Where each tank is filed.
+    float m_fTankRadius = 0; ///< Radius of the biggest tank ever filed.
+
+    /// \brief A tank found by a k-nearest search.
+
+    struct CHit{
+      float m_fDistanceSq; ///< Squared distance from the query.
+      unsigned m_nSerial; ///< Order that the tank was created in, to break ties.
+      const CEntry* m_pEntry; ///< The tank.
+    }; //CHit
+
+    mutable std::vector<CHit> m_vHits; ///< Scratch space for the k-nearest searches.
+
+    size_t slot(const CPlanetObject* planet) const; ///< Slot of a planet, or the number of planets if it isn't there.
+    void file(const std::shared_ptr<CTankObject>& tank, unsigned serial); ///< File a tank under its current planet and longitude.
+    void unfile(const CTankObject* tank); ///< Take a tank out of its planet's list.
+    void search(const Vector2& pos, size_t k, const CTankObject* exclude, bool skip_dead) const; ///< k-nearest search into m_vHits.
+
+  public:
+    void clear(); ///< Forget everything.
+
+    void add_planet(CPlanetObject* planet); ///< Add a planet.
+    void update_planet(const CPlanetObject* planet); ///< Refile a planet after it moves.
+    CPlanetObject* nearest_planet(const Vector2& pos) const; ///< Planet with the nearest center.
+    void nearest_planets(const Vector2& pos, size_t k, std::vector<CPlanetObject*>& result) const; ///< Planets with the k nearest centers.
+    void planets_in_sphere(const Vector2& center, float radius, std::vector<CPlanetObject*>& result) const; ///< Planets whose highest hill reaches into a circle.
+
+    void add_tank(const std::shared_ptr<CTankObject>& tank); ///< Add a tank.
+    void update_tank(CTankObject* tank); ///< Refile a tank after it moves or teleports.
+    void remove_tank(const CTankObject* tank); ///< Remove a tank.
+    void tanks_in_sphere(const Vector2& center, float radius, std::vector<CTankObject*>& result) const; ///< Tanks that might touch a circle.
+    void tanks_on_planet(const CPlanetObject* planet, std::vector<CTankObject*>& result) const; ///< Tanks on a planet.
+    std::shared_ptr<CTankObject> nearest_tank(const Vector2& pos, const CTankObject* exclude = nullptr, bool skip_dead = false) const; ///< Nearest tank to a point.
+    void nearest_tanks(const Vector2& pos, size_t k, std::vector<CTankObject*>& result, bool skip_dead = true) const; ///< The k nearest tanks to a point.
+
+    size_t get_tank_count() const { return m_mWhere.size(); }; ///< Number of tanks filed.
+}; //CSurfaceIndex
@@ -7,6 +7,7 @@
 #include "Random.h"
 #include "SmoothCamera.h"
 #include <algorithm>
+#include "Deterministic.h"
 
 #define PI XM_PI
 
@@ -17,10 +18,11 @@ const T& clamp(const T& x, const T& lower, const T& upper) {
 
 
 CTankObject::CTankObject(const Vector2& p, CPlanetObject* planet_pointer) : CObject(PLAYER_SPRITE, p) {
+  SetCollisionLayer(TANK_LAYER);
   this->home_planet_pointer = planet_pointer;
   Vector2 planet_center = home_planet_pointer->GetPos();
   Vector2 difference = m_vPos - planet_center;
-  angle_relative_to_planet = (float) atan2(difference.y, difference.x) * 180 / PI;
+  angle_relative_to_planet = det_atan2(difference.y, difference.x) * 180 / PI;
 
   //Internal AI state parameters
   //desired_angle = angle;
@@ -29,6 +31,7 @@ CTankObject::CTankObject(const Vector2& p, CPlanetObject* planet_pointer) : CObj
 }
 
 CTankObject::CTankObject(float angle_relative_to_planet, CPlanetObject* planet_pointer) : CObject(GREY1_SPRITE, Vector2::Zero) {
+  SetCollisionLayer(TANK_LAYER);
   this->home_planet_pointer = planet_pointer;
   this->angle_relative_to_planet = angle_relative_to_planet;
 
@@ -42,12 +45,13 @@ CTankObject::CTankObject(float angle_relative_to_planet, CPlanetObject* planet_p
 
   Vector2 planet_center = home_planet_pointer->GetPos();
   Vector2 direction_unit_vector = m_vPos - planet_center;
-  direction_unit_vector.Normalize();
+  det_normalize(direction_unit_vector);
   int altitude = home_planet_pointer->get_altitude_at_angle(angle_relative_to_planet);
-  m_vPos = planet_center + (altitude + m_vRadius.y) * direction_unit_vector; //No animation, just jump to proper spot
+  SetPrecisePos(home_planet_pointer->GetPrecisePos() + CVector2d(direction_unit_vector) * (altitude + m_vRadius.y)); //No animation, just jump to proper spot
 }
 
 CTankObject::CTankObject(float angle_relative_to_planet, CPlanetObject* planet_pointer, XMFLOAT4 color) : CObject(GREY1_SPRITE, Vector2::Zero) {
+  SetCollisionLayer(TANK_LAYER);
   CTankObject::CTankObject(angle_relative_to_planet, planet_pointer);
   smoke_color = color;
   m_f4Tint = color;
@@ -57,7 +61,8 @@ CTankObject::CTankObject(float angle_relative_to_planet, CPlanetObject* planet_p
 void CTankObject::draw_tank()
 {
     Vector2 middle = GetPos();
-    Vector2 difference = middle - home_planet_pointer->GetPos();
+    const CVector2d precise_middle = GetPrecisePos(); //where the sprites are really drawn
+    Vector2 difference = Vector2(precise_middle - home_planet_pointer->GetPrecisePos());
     difference.Normalize();
 
     float render_angle = PI + (angle_relative_to_planet) * PI / 180;
@@ -73,7 +78,7 @@ void CTankObject::draw_tank()
     sd1.m_f4Tint = m_f4Tint;
     //sd1.m_fRoll = get_angle() * (M_PI / 180.0f) + (PI+angle_relative_to_planet*PI/180);
 
-    m_pRenderer->Draw(sd1);
+    m_pRenderer->Draw(sd1, precise_middle);
 
     CSpriteDesc2D sd3; //treads
     float height = m_pRenderer->GetHeight(TREADS1_SPRITE);
@@ -85,7 +90,7 @@ void CTankObject::draw_tank()
     sd3.m_fRoll = render_angle;
     sd3.m_f4Tint = m_f4Tint;
 
-    m_pRenderer->Draw(sd3);
+    m_pRenderer->Draw(sd3, precise_middle - 0.3f*height*difference);
 
     CSpriteDesc2D sd2; //tank body
     sd2.m_fXScale = 1.0f;
@@ -96,7 +101,7 @@ void CTankObject::draw_tank()
     sd2.m_fRoll = render_angle;
     sd2.m_f4Tint = m_f4Tint;
 
-    m_pRenderer->Draw(sd2);
+    m_pRenderer->Draw(sd2, precise_middle);
 }
 
 
@@ -117,10 +122,11 @@ int CTankObject::take_damage(int damage) {
 
 void CTankObject::teleport(Vector2& bpos, CPlanetObject* planet) {
     home_planet_pointer = planet;
-    m_vPos=bpos;
-    //Vector2 dif = m_vPos - planet_center;
-    //dif.Normalize();
-    //angle_relative_to_planet = (float)atan2(dif.y, dif.x) * 180 / PI;
+    SetPrecisePos(bpos);
+    const Vector2 dif = bpos - planet->GetPos();
+    angle_relative_to_planet = modulo(det_atan2(dif.y, dif.x) * 180 / PI, 360.0f); //move() puts the tank back on the ray at its longitude, so it has to be the one it landed at
+    desired_angle_relative_to_planet = angle_relative_to_planet; //stay put rather than drive back
+    m_pObjectManager->tank_moved(this);
 }
 
 void CTankObject::move() {
@@ -148,23 +154,22 @@ void CTankObject::move() {
     angle_relative_to_planet += delta;
   angle_relative_to_planet = modulo(angle_relative_to_planet, 360.0f);
 
-  Vector2 planet_center = home_planet_pointer->GetPos();
-  Vector2 direction_unit_vector = Vector2(cosf(angle_relative_to_planet * PI / 180), sinf(angle_relative_to_planet * PI / 180));
+  //work in double precision from the planet's center, so that a tank far out in a large world sits still on the ground
+  const CVector2d planet_center = home_planet_pointer->GetPrecisePos();
+  const CVector2d direction_unit_vector = CVector2d(det_cos(angle_relative_to_planet * PI / 180), det_sin(angle_relative_to_planet * PI / 180));
   int altitude = home_planet_pointer->get_altitude_at_angle(angle_relative_to_planet);
   //m_vPos = planet_center + (altitude + m_vRadius.y)* direction_unit_vector; //No animation, just jump to proper spot
-  Vector2 desired_pos = planet_center + (altitude + m_vRadius.y) * direction_unit_vector;
-  float current_altitude = (m_vPos - planet_center).Length();
+  float current_altitude = det_length(Vector2(m_dPos - planet_center));
   if ( current_altitude - (float)altitude - m_vRadius.y > 10 && !m_bStrafeLeft && !m_bStrafeRight) { //We are currently more than 10 units higher than where we should be, and we're not currently moving
     animation_state = TankAnimationState::Falling;
-    m_vPos = planet_center + (current_altitude - 3) * direction_unit_vector; //Move 1 unit down
+    SetPrecisePos(planet_center + direction_unit_vector * (current_altitude - 3)); //Move 1 unit down
   }
   else {
     animation_state = TankAnimationState::Normal;
-    m_vPos = planet_center + (altitude + m_vRadius.y) * direction_unit_vector; //No animation, just jump to proper spot
+    SetPrecisePos(planet_center + direction_unit_vector * (altitude + m_vRadius.y)); //No animation, just jump to proper spot
   }
   
   m_bStrafeLeft = m_bStrafeRight = m_bStrafeBack = false;
-  m_Sphere.Center = (Vector3)m_vPos; //update bounding sphere
 }
 
 void CTankObject::SetSmokeColor(XMFLOAT4 color) {
@@ -407,6 +412,7 @@ void CTankObject::Think() {
 
     //Think==Make a plan for this turn
   case TankState::Think:
+    m_pObjectManager->reset_phantom_stats(); //count the phantom bullets fired for this turn, for the debug text
     adjust_aim();
     current_state = TankState::Move;
     break;
@@ -557,7 +563,7 @@ void CTankObject::adjust_aim(bool monte_carlo) {
   float test_longitude = desired_angle_relative_to_planet;
   float test_power = desired_power;
   float test_roll = PI + (test_angle + test_longitude) * PI / 180;  // Set the roll so that it compensates for the inclination on the planet
-  Vector2 view = Vector2(-sinf(test_roll), cosf(test_roll)); //Orientation of the phantom bullet.
+  Vector2 view = Vector2(-det_sin(test_roll), det_cos(test_roll)); //Orientation of the phantom bullet.
   previous_distance = FirePhantomGun(WATER_SPRITE, view, test_power); //Initial guess, so we have something to compare to.
   float new_distance;
   float gradient_step_size = 1;
@@ -572,7 +578,7 @@ void CTankObject::adjust_aim(bool monte_carlo) {
       test_longitude = test_longitude; //For now, let's not move the tank around.
       test_power = (float)m_pRandom->randn(50, 1000);
       test_roll = PI + (test_angle + test_longitude) * PI / 180;  // Set the roll so that it compensates for the inclination on the planet
-      view = Vector2(-sinf(test_roll), cosf(test_roll)); //Orientation of the phantom bullet.
+      view = Vector2(-det_sin(test_roll), det_cos(test_roll)); //Orientation of the phantom bullet.
       new_distance = FirePhantomGun(WATER_SPRITE, view, test_power);
       //string test_string = "Previous: " + to_string(previous_distance) + "\tNew: " + to_string(new_distance) + "\n";
       //OutputDebugStringA(test_string.c_str());
@@ -608,20 +614,20 @@ void CTankObject::adjust_aim(bool monte_carlo) {
     for (int i = 0; i < iterations * accuracy_multiplier && m_pStepTimer->GetElapsedSeconds() - start_time < .5f; i++) {
       //Calculate DF (The gradient of the distance function calculated at the current 
       //Angle
-      view = Vector2(-sinf(test_roll), cosf(test_roll)); //Orientation of the phantom bullet.
+      view = Vector2(-det_sin(test_roll), det_cos(test_roll)); //Orientation of the phantom bullet.
       float d_roll = PI + (test_angle + gradient_step_size + test_longitude) * PI / 180;
-      Vector2 d_view = Vector2(-sinf(d_roll), cosf(d_roll)); //Orientation of the phantom bullet.
+      Vector2 d_view = Vector2(-det_sin(d_roll), det_cos(d_roll)); //Orientation of the phantom bullet.
       d_angle = (FirePhantomGun(WATER_SPRITE, d_view, test_power) - FirePhantomGun(WATER_SPRITE, view, test_power)) / gradient_step_size; // Derivative of distance w.r.t. angle
 
       //Longitude
       //Find the new location to fire from with that longitude
       Vector2 planet_center = home_planet_pointer->GetPos();
-      Vector2 direction_unit_vector = Vector2((float)cos((test_longitude + gradient_step_size )* PI / 180), (float)sinf((test_longitude + gradient_step_size) * PI / 180));
+      Vector2 direction_unit_vector = Vector2(det_cos((test_longitude + gradient_step_size )* PI / 180), det_sin((test_longitude + gradient_step_size) * PI / 180));
       int altitude = home_planet_pointer->get_altitude_at_angle((test_longitude + gradient_step_size));
       Vector2 temp_position = planet_center + (altitude + m_vRadius.y) * direction_unit_vector;
 
       d_roll = PI + (test_angle + test_longitude + gradient_step_size) * PI / 180;
-      d_view = Vector2(-sinf(d_roll), cosf(d_roll)); //Orientation of the phantom bullet.
+      d_view = Vector2(-det_sin(d_roll), det_cos(d_roll)); //Orientation of the phantom bullet.
       //d_longitude = (FirePhantomGun(WATER_SPRITE, d_view, test_power, temp_position) - FirePhantomGun(WATER_SPRITE, view, test_power)) / gradient_step_size; // Derivative of distance w.r.t. longitude
       
 
@@ -641,7 +647,7 @@ void CTankObject::adjust_aim(bool monte_carlo) {
       //test_power = std::max(test_power, 50.f); //Don't let power get close to zero. Gradient Descent suffers from a vanishing gradient near 0.
       test_power = clamp(test_power, 50.f, 1000.f); //Don't let the power get close to zero or bigger than 1000. Gradient descent suffers from a vanishing gradient.
       test_roll = PI + (test_angle + test_longitude) * PI / 180;  // Set the roll so that it compensates for the inclination on the planet
-      view = Vector2(-sinf(test_roll), cosf(test_roll)); //Orientation of the phantom bullet.
+      view = Vector2(-det_sin(test_roll), det_cos(test_roll)); //Orientation of the phantom bullet.
       new_distance = FirePhantomGun(WATER_SPRITE, view, test_power);
       if (new_distance < previous_distance) { //Our test shot was better! WooHoo! Let's use that to refine our shots.
         //string test_string = "Previous distance: " + to_string(previous_distance) + "\tNew distance: " + to_string(new_distance) + "\n";
@@ -0,0 +1,65 @@
+/// \file TerrainSnapshot.cpp
+/// \brief Code for the terrain snapshot CTerrainSnapshot.
+
+#include "TerrainSnapshot.h"
+
+#include <algorithm>
+
+/// Point at the altitudes as they are now, making new chunks for the
+/// spans that changed and sharing the rest with the chunks from before.
+/// If the number of values changed, every chunk is made anew. Snapshots
+/// copied from this one before the update still point at the old chunks.
+/// \param values The altitudes as they are now.
+/// \param spans Spans of values that changed, in order and not wrapping, as from CDirtySpans::collect.
+
+void CTerrainSnapshot::update(const std::vector<int>& values, const std::vector<std::pair<int, int>>& spans){
+  const int size = (int)values.size();
+  const int chunks = (size + CHUNK_SIZE - 1)/CHUNK_SIZE;
+  const bool all = !m_pChunks || size != m_nSize;
+
+  std::shared_ptr<CChunkTable> table = all?
+    std::make_shared<CChunkTable>(chunks): std::make_shared<CChunkTable>(*m_pChunks);
+
+  auto make_chunk = [&](int c){
+    const int first = c*CHUNK_SIZE;
+    const int last = first + CHUNK_SIZE < size? first + CHUNK_SIZE: size;
+    (*table)[c] = std::make_shared<const CChunk>(values.begin() + first, values.begin() + last);
+  }; //make_chunk
+
+  if(all)
+    for(int c=0; c<chunks; c++)
+      make_chunk(c);
+
+  else{
+    int done = -1; //last chunk made, since neighbouring spans can share one
+    for(const std::pair<int, int>& span: spans)
+      for(int c=span.first/CHUNK_SIZE; c<=span.second/CHUNK_SIZE && c<chunks; c++)
+        if(c > done){
+          make_chunk(c);
+          done = c;
+        } //if
+  } //else
+
+  m_pChunks = table;
+  m_nSize = size;
+} //update
+
+/// Copy the altitudes in a chunk over the same part of a vector.
+/// \param chunk The chunk.
+/// \param values [in, out] Altitudes, which must be the same size as the snapshot.
+
+void CTerrainSnapshot::copy_chunk(int chunk, std::vector<int>& values) const{
+  const CChunk& altitudes = *(*m_pChunks)[chunk];
+  std::copy(altitudes.begin(), altitudes.end(), values.begin() + chunk*CHUNK_SIZE);
+} //copy_chunk
+
+/// Whether a chunk is the very same one in another snapshot, in which
+/// case its altitudes are the same too. Different chunks may still happen
+/// to hold the same altitudes.
+/// \param other The other snapshot, which must be the same size.
+/// \param chunk The chunk.
+/// \return true if it is shared.
+
+bool CTerrainSnapshot::same_chunk(const CTerrainSnapshot& other, int chunk) const{
+  return m_pChunks && other.m_pChunks && (*m_pChunks)[chunk] == (*other.m_pChunks)[chunk];
+} //same_chunk
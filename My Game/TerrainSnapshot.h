@@ -0,0 +1,46 @@
+/// \file TerrainSnapshot.h
+/// \brief Interface for the terrain snapshot CTerrainSnapshot.
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <utility>
+
+/// \brief A read-only copy of a planet's altitudes that shares what it can.
+///
+/// The altitudes are cut into chunks of CHUNK_SIZE, and a snapshot is a
+/// table of pointers to chunks that never change once they are made.
+/// Copying a snapshot copies one pointer to the table, so it costs the
+/// same however big the planet is. A planet keeps the snapshot of its
+/// latest terrain, and when the terrain changes it makes new chunks only
+/// for the ones that the dirty spans say were touched, and a new table
+/// that shares the rest with the old one. Old snapshots keep the chunks
+/// they point to alive for as long as they are held, and no longer.
+///
+/// Nothing in a snapshot changes after it is made, and the counts that
+/// keep the chunks alive are atomic, so a snapshot can be read on another
+/// thread, such as by the AI, while the planet carves craters.
+
+class CTerrainSnapshot{
+  public:
+    static const int CHUNK_SIZE = 64; ///< Altitudes per chunk. The number of altitudes is always a multiple of this.
+
+  private:
+    typedef std::vector<int> CChunk; ///< Altitudes in a chunk.
+    typedef std::vector<std::shared_ptr<const CChunk>> CChunkTable; ///< The chunks, in order.
+
+    std::shared_ptr<const CChunkTable> m_pChunks; ///< The chunks, or null if there are none.
+    int m_nSize = 0; ///< Number of altitudes.
+
+  public:
+    void update(const std::vector<int>& values, const std::vector<std::pair<int, int>>& spans); ///< Point at new chunks for the spans of values that changed.
+    void copy_chunk(int chunk, std::vector<int>& values) const; ///< Copy a chunk's altitudes over values.
+    bool same_chunk(const CTerrainSnapshot& other, int chunk) const; ///< Whether a chunk is shared with another snapshot.
+
+    int get_altitude(int index) const { return (*(*m_pChunks)[index/CHUNK_SIZE])[index%CHUNK_SIZE]; }; ///< Altitude at an index from 0 to one less than the size.
+    int size() const { return m_nSize; }; ///< Number of altitudes.
+    bool empty() const { return m_nSize == 0; }; ///< Whether there are no altitudes, as in a snapshot that was never taken.
+    int get_chunk_count() const { return m_pChunks? (int)m_pChunks->size(): 0; }; ///< Number of chunks.
+}; //CTerrainSnapshot
@@ -43,6 +43,7 @@ void CTurnManager::SetTankList(list<std::shared_ptr<CTankObject>> tankList) {
 	m_currentTank = m_tanks_list.front();
 	m_currentTank->set_in_control(true);
 
+	m_pObjectManager->save_terrain(); //the first turn, so that it can be rewound to
 }
 
 /// Increment the turn counters and updates the current tank.
@@ -84,6 +85,8 @@ std::shared_ptr<CTankObject> CTurnManager::NextTurn() {
 	createWormholes();
 	cullDeadWormholes();
 
+	m_pObjectManager->save_terrain(); //so that the turn can be rewound to
+
 	//unlock controls
 	m_bControlLock = false;
 
@@ -143,6 +146,8 @@ std::shared_ptr<CTankObject> CTurnManager::SetTurn(int tankNo) {
 		return m_currentTank;
 	}
 
+	m_pObjectManager->save_terrain(); //so that the turn can be rewound to
+
 	//unlock controls
 	m_bControlLock = false;
 
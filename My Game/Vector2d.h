@@ -0,0 +1,37 @@
+/// \file Vector2d.h
+/// \brief Interface for the double precision vector CVector2d.
+
+#pragma once
+
+#include "Defines.h"
+
+/// \brief A 2D vector in double precision.
+///
+/// Positions in a large world need more bits than a float has. A float
+/// only has 24 bits of mantissa, so out at 45,000 units from the origin
+/// it can't tell positions less than 1/256 of a unit apart, and moving
+/// a little at a time from there loses a little every time. CVector2d
+/// is just enough of a vector to keep positions in double precision.
+/// It converts from Vector2 without being asked, but converting back
+/// loses precision, so that has to be asked for with Vector2(v).
+
+struct CVector2d{
+  double x = 0; ///< x coordinate.
+  double y = 0; ///< y coordinate.
+
+  CVector2d(){}; ///< Constructor.
+  CVector2d(double a, double b): x(a), y(b){}; ///< Constructor.
+  CVector2d(const Vector2& v): x(v.x), y(v.y){}; ///< Constructor.
+
+  explicit operator Vector2() const { return Vector2((float)x, (float)y); }; ///< Round to single precision.
+
+  CVector2d operator+(const CVector2d& v) const { return CVector2d(x + v.x, y + v.y); }; ///< Sum.
+  CVector2d operator-(const CVector2d& v) const { return CVector2d(x - v.x, y - v.y); }; ///< Difference.
+  CVector2d operator*(double s) const { return CVector2d(x*s, y*s); }; ///< Scale.
+  CVector2d& operator+=(const CVector2d& v){ x += v.x; y += v.y; return *this; }; ///< Add.
+  CVector2d& operator-=(const CVector2d& v){ x -= v.x; y -= v.y; return *this; }; ///< Subtract.
+  bool operator==(const CVector2d& v) const { return x == v.x && y == v.y; }; ///< Equality.
+  bool operator!=(const CVector2d& v) const { return !(*this == v); }; ///< Inequality.
+
+  double Length() const { return sqrt(x*x + y*y); }; ///< Length.
+}; //CVector2d
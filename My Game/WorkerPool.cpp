@@ -0,0 +1,117 @@
+/// \file WorkerPool.cpp
+/// \brief Code for the worker thread pool CWorkerPool.
+
+#include "WorkerPool.h"
+
+/// Start the workers.
+/// \param threads Number of threads, counting the caller. 0 means one per core.
+
+CWorkerPool::CWorkerPool(unsigned threads){
+  set_threads(threads);
+} //constructor
+
+CWorkerPool::~CWorkerPool(){
+  stop();
+} //destructor
+
+/// Tell the workers to quit, and wait for them. Must not be called
+/// while a job is running.
+
+void CWorkerPool::stop(){
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bQuit = true;
+  }
+  m_cvStart.notify_all();
+
+  for(auto& t: m_vThreads)
+    t.join();
+
+  m_vThreads.clear();
+  m_bQuit = false;
+} //stop
+
+/// Change the number of threads. The old workers are stopped and new
+/// ones started, so don't call this every frame.
+/// \param threads Number of threads, counting the caller. 0 means one per core.
+
+void CWorkerPool::set_threads(unsigned threads){
+  if(threads == 0)
+    threads = std::thread::hardware_concurrency();
+  if(threads == 0) //couldn't tell
+    threads = 1;
+  if(threads == get_threads())
+    return;
+
+  stop();
+  for(unsigned i=1; i<threads; i++)
+    m_vThreads.emplace_back(&CWorkerPool::worker, this);
+} //set_threads
+
+/// Body of a worker thread. Sleep until there are chunks to be done, and
+/// do them until there are none left.
+
+void CWorkerPool::worker(){
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  while(true){
+    m_cvStart.wait(lock, [this](){ return m_bQuit || m_nNextChunk < m_nChunks; });
+    if(m_bQuit)return;
+
+    while(m_nNextChunk < m_nChunks)
+      do_chunk(lock);
+  } //while
+} //worker
+
+/// Take the next chunk of the current job and do it, without holding
+/// the lock while it runs.
+/// \param lock Lock on m_mutex, held on entry and on exit.
+
+void CWorkerPool::do_chunk(std::unique_lock<std::mutex>& lock){
+  const size_t chunk = m_nNextChunk++;
+  const size_t begin = chunk*m_nSize/m_nChunks;
+  const size_t end = (chunk + 1)*m_nSize/m_nChunks;
+  const std::function<void(size_t, size_t)>* job = m_pJob;
+
+  lock.unlock();
+  (*job)(begin, end);
+  lock.lock();
+
+  if(++m_nDone == m_nChunks)
+    m_cvDone.notify_all();
+} //do_chunk
+
+/// Run a loop over the indices from 0 up to but not including size, split
+/// into one chunk per thread, and wait for all of it to finish. Chunks
+/// are never smaller than min_chunk, so short loops use fewer threads,
+/// and a loop that fits in one chunk is run right here without waking
+/// anybody. Not reentrant: the job mustn't call run.
+/// \param size Number of indices.
+/// \param min_chunk Fewest indices worth handing to a thread.
+/// \param job Loop body, called with the start and end of a chunk.
+
+void CWorkerPool::run(size_t size, size_t min_chunk, const std::function<void(size_t begin, size_t end)>& job){
+  if(min_chunk == 0)min_chunk = 1;
+  size_t chunks = (size + min_chunk - 1)/min_chunk;
+  if(chunks > get_threads())chunks = get_threads();
+
+  if(chunks <= 1){ //not worth the trouble
+    if(size > 0)job(0, size);
+    return;
+  } //if
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_pJob = &job;
+  m_nSize = size;
+  m_nChunks = chunks;
+  m_nNextChunk = 0;
+  m_nDone = 0;
+  m_cvStart.notify_all();
+
+  while(m_nNextChunk < m_nChunks) //pitch in
+    do_chunk(lock);
+
+  m_cvDone.wait(lock, [this](){ return m_nDone == m_nChunks; });
+  m_nChunks = m_nNextChunk = 0;
+  m_pJob = nullptr;
+} //run
@@ -0,0 +1,48 @@
+/// \file WorkerPool.h
+/// \brief Interface for the worker thread pool CWorkerPool.
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/// \brief A pool of worker threads.
+///
+/// CWorkerPool keeps some threads waiting, so that a loop can be split
+/// into chunks and run on all of them at once without paying to start
+/// threads every frame. The thread that calls run does chunks too, and
+/// doesn't return until every chunk is done. A chunk is a contiguous
+/// range of the loop, so if the loop body only writes to its own element
+/// the result doesn't depend on how many threads there are or which of
+/// them did what.
+
+class CWorkerPool{
+  private:
+    std::vector<std::thread> m_vThreads; ///< The workers. There is one fewer of them than the thread count, since the caller works too.
+    std::mutex m_mutex; ///< Guards everything below.
+    std::condition_variable m_cvStart; ///< Signalled when there is a new job or it's time to quit.
+    std::condition_variable m_cvDone; ///< Signalled when the last chunk of a job is done.
+
+    const std::function<void(size_t, size_t)>* m_pJob = nullptr; ///< Loop body over a range of indices, from begin up to but not including end.
+    size_t m_nSize = 0; ///< Number of indices in the job.
+    size_t m_nChunks = 0; ///< Number of chunks the job is split into.
+    size_t m_nNextChunk = 0; ///< Next chunk to hand out.
+    size_t m_nDone = 0; ///< Number of chunks finished.
+    bool m_bQuit = false; ///< Tells the workers to exit.
+
+    void worker(); ///< Body of a worker thread.
+    void do_chunk(std::unique_lock<std::mutex>& lock); ///< Take the next chunk and do it.
+    void stop(); ///< Stop and join the workers.
+
+  public:
+    CWorkerPool(unsigned threads = 0); ///< Constructor.
+    ~CWorkerPool(); ///< Destructor.
+
+    void set_threads(unsigned threads); ///< Set the number of threads, counting the caller. 0 means one per core.
+    unsigned get_threads() const { return (unsigned)m_vThreads.size() + 1; }; ///< Number of threads, counting the caller.
+
+    void run(size_t size, size_t min_chunk, const std::function<void(size_t begin, size_t end)>& job); ///< Run a loop in parallel and wait for it.
+}; //CWorkerPool
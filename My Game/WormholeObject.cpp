@@ -11,11 +11,13 @@ CWormholeObject::CWormholeObject(const Vector2& pos, int turnsToLive, CWormholeO
 	correspondingWormhole = nextWormhole;
 	m_fXScale = m_fYScale = m_Sphere.Radius = radius;
 	turns_before_death = turnsToLive;
+	SetCollisionLayer(WORMHOLE_LAYER);
 }
 
 CWormholeObject::CWormholeObject(const Vector2& pos, int turnsToLive) : CObject(BULLET2_SPRITE, pos) {
 	m_fXScale = m_fYScale = m_Sphere.Radius = radius;
 	turns_before_death = turnsToLive;
+	SetCollisionLayer(WORMHOLE_LAYER);
 }
 
 void CWormholeObject::DrawWormhole() {
@@ -30,7 +32,7 @@ void CWormholeObject::DrawWormhole() {
 	spr.m_fRoll = angle;
 	spr.m_vPos = GetPos();
 
-	m_pRenderer->Draw(spr);
+	m_pRenderer->Draw(spr, GetPrecisePos());
 
 }
 